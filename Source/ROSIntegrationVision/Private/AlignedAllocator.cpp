@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "AlignedAllocator.h"
+
+#if PLATFORM_WINDOWS
+  #include "Windows/AllowWindowsPlatformTypes.h"
+  #include <windows.h>
+  #include "Windows/HideWindowsPlatformTypes.h"
+#else
+  #include <sys/mman.h>
+#endif
+
+const size_t AlignedMemory::Alignment;
+const size_t AlignedMemory::HugePageSize;
+const size_t AlignedMemory::LargeSize;
+
+void *AlignedMemory::Allocate(const size_t Size, const bool HugePages)
+{
+  if(Size < LargeSize)
+  {
+    return FMemory::Malloc(Size, Alignment);
+  }
+
+  // Large allocations are page aligned and mapped on first touch
+  void *Pointer = nullptr;
+#if PLATFORM_WINDOWS
+  // Large pages need the SeLockMemoryPrivilege, so Windows uses regular pages
+  Pointer = VirtualAlloc(nullptr, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  // Huge pages are only used for 2 MiB aligned ranges, so the mapping is aligned by unmapping the excess
+  const size_t Mapped = (Size + HugePageSize - 1) / HugePageSize * HugePageSize;
+  const size_t Excess = HugePages ? HugePageSize : 0;
+  uint8 *Mapping = static_cast<uint8 *>(mmap(nullptr, Mapped + Excess, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if(Mapping != MAP_FAILED)
+  {
+    uint8 *Aligned = Mapping;
+    if(HugePages)
+    {
+      Aligned = reinterpret_cast<uint8 *>(((UPTRINT)Mapping + HugePageSize - 1) / HugePageSize * HugePageSize);
+      if(Aligned > Mapping)
+      {
+        munmap(Mapping, Aligned - Mapping);
+      }
+      if(Aligned + Mapped < Mapping + Mapped + Excess)
+      {
+        munmap(Aligned + Mapped, Mapping + Mapped + Excess - (Aligned + Mapped));
+      }
+#if defined(MADV_HUGEPAGE)
+      // Only a hint, the kernel falls back to regular pages if transparent huge pages are disabled
+      madvise(Aligned, Mapped, MADV_HUGEPAGE);
+#endif
+    }
+    Pointer = Aligned;
+  }
+#endif
+
+  if(!Pointer)
+  {
+    FPlatformMemory::OnOutOfMemory(Size, Alignment);
+  }
+  return Pointer;
+}
+
+void AlignedMemory::Free(void *Pointer, const size_t Size)
+{
+  if(!Pointer)
+  {
+    return;
+  }
+  if(Size < LargeSize)
+  {
+    FMemory::Free(Pointer);
+    return;
+  }
+
+#if PLATFORM_WINDOWS
+  VirtualFree(Pointer, 0, MEM_RELEASE);
+#else
+  munmap(Pointer, (Size + HugePageSize - 1) / HugePageSize * HugePageSize);
+#endif
+}
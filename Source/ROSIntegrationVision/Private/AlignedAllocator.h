@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+/**
+ * Allocator for the per-frame image storage. Every allocation starts at a cache line, so that the payloads of a
+ * packet, which are aligned relative to its beginning, are also aligned in memory. Allocations of at least
+ * LargeSize are taken from the OS directly and, with HugePages, backed by 2 MiB pages where the OS supports it,
+ * which reduces TLB misses on high resolution images. The elements are left uninitialized, so that the pages are
+ * first touched by the threads writing them.
+ */
+class ROSINTEGRATIONVISION_API AlignedMemory
+{
+public:
+  static const size_t Alignment = 64;
+  static const size_t HugePageSize = 2 * 1024 * 1024;
+  static const size_t LargeSize = 4 * 1024 * 1024;
+
+  static void *Allocate(const size_t Size, const bool HugePages);
+  static void Free(void *Pointer, const size_t Size);
+};
+
+template<typename T>
+class AlignedAllocator : public std::allocator<T>
+{
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template<typename U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U> other;
+  };
+
+  bool HugePages;
+
+  AlignedAllocator(const bool HugePages = false) : HugePages(HugePages)
+  {
+  }
+
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U> &Other) : HugePages(Other.HugePages)
+  {
+  }
+
+  T *allocate(const size_t Count)
+  {
+    return static_cast<T *>(AlignedMemory::Allocate(Count * sizeof(T), HugePages));
+  }
+
+  void deallocate(T *Pointer, const size_t Count)
+  {
+    AlignedMemory::Free(Pointer, Count * sizeof(T));
+  }
+
+  template<typename U>
+  void construct(U *Pointer)
+  {
+    ::new(static_cast<void *>(Pointer)) U;
+  }
+
+  template<typename U, typename... Args>
+  void construct(U *Pointer, Args&&... Arguments)
+  {
+    ::new(static_cast<void *>(Pointer)) U(std::forward<Args>(Arguments)...);
+  }
+
+  // Memory of either allocator can be freed by the other, the flag only affects new allocations
+  template<typename U>
+  bool operator==(const AlignedAllocator<U> &) const
+  {
+    return true;
+  }
+
+  template<typename U>
+  bool operator!=(const AlignedAllocator<U> &) const
+  {
+    return false;
+  }
+};
+
+typedef std::vector<uint8, AlignedAllocator<uint8>> AlignedBytes;
@@ -0,0 +1,597 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CaptureFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Misc/Compression.h"
+
+#include "PacketBuffer.h"
+
+#if PLATFORM_WINDOWS
+  #include "Windows/AllowWindowsPlatformTypes.h"
+  #include <windows.h>
+  #include "Windows/HideWindowsPlatformTypes.h"
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#if PLATFORM_WINDOWS
+  #define CAPTURE_FILE_VALID(Handle) ((Handle) != INVALID_HANDLE_VALUE)
+  #define CAPTURE_FILE_INVALID INVALID_HANDLE_VALUE
+#else
+  #define CAPTURE_FILE_VALID(Handle) ((Handle) >= 0)
+  #define CAPTURE_FILE_INVALID -1
+#endif
+
+CaptureFileWriter::CaptureFileWriter(const FString &Filename, const uint32 ChunkSize, const CaptureFile::CompressionType Compression) :
+  FileHandle(CAPTURE_FILE_INVALID), FileSize(0), ChunkSize(CaptureFile::Align(ChunkSize, CaptureFile::Alignment)), Compression(Compression),
+  Chunks(QueueLength), ChunkCount(0), FileOffset(CaptureFile::Alignment), Running(true), Failed(false)
+{
+#if PLATFORM_WINDOWS
+  FileHandle = CreateFileW(*Filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+  FileHandle = open(TCHAR_TO_UTF8(*Filename), O_RDWR | O_CREAT | O_TRUNC, 0644);
+#endif
+  CaptureFile::FileHeader FileHeader;
+  FileHeader.Magic = CaptureFile::FileMagic;
+  FileHeader.Version = CaptureFile::Version;
+  FileHeader.Compression = Compression;
+  FileHeader.Reserved = 0;
+  // The rest of the header space reads as zeros after the file was grown
+  if(!CAPTURE_FILE_VALID(FileHandle) || !WriteMapped(0, reinterpret_cast<const uint8 *>(&FileHeader), sizeof(FileHeader)))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Could not create capture file %s."), *Filename);
+    if(CAPTURE_FILE_VALID(FileHandle))
+    {
+#if PLATFORM_WINDOWS
+      CloseHandle(FileHandle);
+#else
+      close(FileHandle);
+#endif
+      FileHandle = CAPTURE_FILE_INVALID;
+    }
+    Running = false;
+    Current = nullptr;
+    return;
+  }
+
+  for(Chunk &Elem : Chunks)
+  {
+    Elem.Data.resize(this->ChunkSize);
+    Free.push_back(&Elem);
+  }
+  Current = Free.front();
+  Free.pop_front();
+  Current->Used = CaptureFile::ChunkHeaderSize;
+  Current->Frames = 0;
+  Current->Number = ChunkCount++;
+
+  ThreadIO = std::thread(&CaptureFileWriter::WriteChunks, this);
+}
+
+CaptureFileWriter::~CaptureFileWriter()
+{
+  Close();
+}
+
+bool CaptureFileWriter::IsOpen() const
+{
+  return CAPTURE_FILE_VALID(FileHandle) && Running && !Failed;
+}
+
+bool CaptureFileWriter::Append(const uint8 *Packet, const uint32 Size, const uint64 TimestampCapture, const uint32 Sequence)
+{
+  if(!IsOpen())
+  {
+    return false;
+  }
+
+  uint32 Offset = CaptureFile::Align(Current->Used, CaptureFile::PacketAlignment);
+  // A chunk holds at least one packet, even if the packet is larger than the chunk size
+  if(Current->Frames > 0 && Offset + Size > ChunkSize)
+  {
+    Submit();
+    Offset = CaptureFile::Align(Current->Used, CaptureFile::PacketAlignment);
+  }
+  if(Offset + Size > Current->Data.size())
+  {
+    Current->Data.resize(CaptureFile::Align(Offset + Size, CaptureFile::Alignment));
+  }
+
+  memset(Current->Data.data() + Current->Used, 0, Offset - Current->Used);
+  memcpy(Current->Data.data() + Offset, Packet, Size);
+
+  CaptureFile::IndexEntry Entry;
+  Entry.TimestampCapture = TimestampCapture;
+  Entry.Chunk = Current->Number;
+  Entry.Offset = Offset - CaptureFile::ChunkHeaderSize;
+  Entry.Size = Size;
+  Entry.Sequence = Sequence;
+  Entry.Reserved = 0;
+  Index.push_back(Entry);
+
+  Current->Used = Offset + Size;
+  ++Current->Frames;
+  return true;
+}
+
+void CaptureFileWriter::Submit()
+{
+  std::unique_lock<std::mutex> Lock(LockQueue);
+  Pending.push_back(Current);
+  CVPending.notify_one();
+
+  CVFree.wait(Lock, [this] {return !Free.empty(); });
+  Current = Free.front();
+  Free.pop_front();
+  Current->Used = CaptureFile::ChunkHeaderSize;
+  Current->Frames = 0;
+  Current->Number = ChunkCount++;
+}
+
+void CaptureFileWriter::WriteChunks()
+{
+  std::vector<uint8> Compressed;
+
+  while(true)
+  {
+    Chunk *Next;
+    {
+      std::unique_lock<std::mutex> Lock(LockQueue);
+      CVPending.wait(Lock, [this] {return !Pending.empty() || !Running; });
+      if(Pending.empty())
+      {
+        break;
+      }
+      Next = Pending.front();
+      Pending.pop_front();
+    }
+
+    CaptureFile::ChunkHeader *Header = reinterpret_cast<CaptureFile::ChunkHeader *>(&Next->Data[0]);
+    Header->Magic = CaptureFile::ChunkMagic;
+    Header->Compression = CaptureFile::CompressionNone;
+    Header->Frames = Next->Frames;
+    Header->Reserved = 0;
+    Header->RawSize = Next->Used - CaptureFile::ChunkHeaderSize;
+    Header->StoredSize = Header->RawSize;
+    memset(&Next->Data[sizeof(CaptureFile::ChunkHeader)], 0, CaptureFile::ChunkHeaderSize - sizeof(CaptureFile::ChunkHeader));
+
+    const uint8 *Data = &Next->Data[0];
+    uint64 Size = Next->Used;
+
+    if(Compression == CaptureFile::CompressionLZ4)
+    {
+      const int32 RawSize = (int32)Header->RawSize;
+      int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, RawSize);
+      Compressed.resize(CaptureFile::Align(CaptureFile::ChunkHeaderSize + CompressedSize, CaptureFile::Alignment));
+
+      // Only keep the compressed data if it is actually smaller
+      if(FCompression::CompressMemory(NAME_LZ4, &Compressed[CaptureFile::ChunkHeaderSize], CompressedSize, &Next->Data[CaptureFile::ChunkHeaderSize], RawSize) && CompressedSize < RawSize)
+      {
+        Header->Compression = CaptureFile::CompressionLZ4;
+        Header->StoredSize = CompressedSize;
+        memcpy(&Compressed[0], Header, CaptureFile::ChunkHeaderSize);
+        Data = &Compressed[0];
+        Size = CaptureFile::ChunkHeaderSize + CompressedSize;
+      }
+    }
+
+    // The next chunk starts aligned, the padding in between is never written and stays zero
+    ChunkOffsets.push_back(FileOffset);
+    const bool Written = WriteMapped(FileOffset, Data, Size);
+    FileOffset += CaptureFile::Align(Size, CaptureFile::Alignment);
+
+    {
+      std::unique_lock<std::mutex> Lock(LockQueue);
+      if(!Written)
+      {
+        Failed = true;
+      }
+      Free.push_back(Next);
+    }
+    CVFree.notify_one();
+  }
+}
+
+void CaptureFileWriter::Close()
+{
+  if(!CAPTURE_FILE_VALID(FileHandle))
+  {
+    return;
+  }
+
+  if(ThreadIO.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> Lock(LockQueue);
+      if(Current->Frames > 0)
+      {
+        Pending.push_back(Current);
+      }
+      Running = false;
+    }
+    CVPending.notify_one();
+    ThreadIO.join();
+  }
+
+  // Replace the chunk numbers with the file offsets of the chunks
+  for(CaptureFile::IndexEntry &Entry : Index)
+  {
+    Entry.Chunk = ChunkOffsets[Entry.Chunk];
+  }
+
+  CaptureFile::FileFooter Footer;
+  Footer.IndexOffset = FileOffset;
+  Footer.Frames = Index.size();
+  Footer.Magic = CaptureFile::FileMagic;
+  Footer.Version = CaptureFile::Version;
+
+  const uint64 IndexSize = Index.size() * sizeof(CaptureFile::IndexEntry);
+  if((!Index.empty() && !WriteMapped(FileOffset, reinterpret_cast<const uint8 *>(Index.data()), IndexSize))
+     || !WriteMapped(FileOffset + IndexSize, reinterpret_cast<const uint8 *>(&Footer), sizeof(Footer))
+     || !Resize(FileOffset + IndexSize + sizeof(Footer)))
+  {
+    Failed = true;
+  }
+#if PLATFORM_WINDOWS
+  CloseHandle(FileHandle);
+#else
+  close(FileHandle);
+#endif
+  FileHandle = CAPTURE_FILE_INVALID;
+
+  if(Failed)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Writing the capture file failed, the recording is incomplete."));
+  }
+  UE_LOG(LogTemp, Display, TEXT("Closed capture file with %d frames in %d chunks."), (int32)Index.size(), (int32)ChunkOffsets.size());
+}
+
+bool CaptureFileWriter::Resize(const uint64 Size)
+{
+#if PLATFORM_WINDOWS
+  LARGE_INTEGER Position;
+  Position.QuadPart = Size;
+  if(!SetFilePointerEx(FileHandle, Position, nullptr, FILE_BEGIN) || !SetEndOfFile(FileHandle))
+  {
+    return false;
+  }
+#else
+  if(ftruncate(FileHandle, Size) != 0)
+  {
+    return false;
+  }
+#endif
+  FileSize = Size;
+  return true;
+}
+
+bool CaptureFileWriter::WriteMapped(const uint64 Offset, const uint8 *Data, const uint64 Size)
+{
+  if(Offset + Size > FileSize && !Resize(CaptureFile::Align(Offset + Size, ReserveSize)))
+  {
+    return false;
+  }
+
+  // Views have to start at a multiple of the mapping granularity, which may be larger than the chunk alignment
+#if PLATFORM_WINDOWS
+  SYSTEM_INFO SystemInfo;
+  GetSystemInfo(&SystemInfo);
+  const uint64 Granularity = SystemInfo.dwAllocationGranularity;
+#else
+  const uint64 Granularity = sysconf(_SC_PAGESIZE);
+#endif
+  const uint64 ViewOffset = Offset / Granularity * Granularity;
+  const uint64 ViewSize = Offset + Size - ViewOffset;
+
+#if PLATFORM_WINDOWS
+  HANDLE MappingHandle = CreateFileMappingW(FileHandle, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+  if(!MappingHandle)
+  {
+    return false;
+  }
+  uint8 *View = reinterpret_cast<uint8 *>(MapViewOfFile(MappingHandle, FILE_MAP_WRITE, (DWORD)(ViewOffset >> 32), (DWORD)ViewOffset, ViewSize));
+  CloseHandle(MappingHandle);
+  if(!View)
+  {
+    return false;
+  }
+  memcpy(View + Offset - ViewOffset, Data, Size);
+  UnmapViewOfFile(View);
+#else
+  void *View = mmap(nullptr, ViewSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileHandle, ViewOffset);
+  if(View == MAP_FAILED)
+  {
+    return false;
+  }
+  memcpy(reinterpret_cast<uint8 *>(View) + Offset - ViewOffset, Data, Size);
+  // The dirty pages are written back by the OS, unmapping does not wait for the disk
+  munmap(View, ViewSize);
+#endif
+  return true;
+}
+
+CaptureFileReader::CaptureFileReader(const FString &Filename) :
+  Mapping(nullptr), MappingSize(0), CachedChunk(0)
+{
+#if PLATFORM_WINDOWS
+  HANDLE FileHandle = CreateFileW(*Filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if(FileHandle != INVALID_HANDLE_VALUE)
+  {
+    LARGE_INTEGER FileSize;
+    GetFileSizeEx(FileHandle, &FileSize);
+    HANDLE MappingHandle = CreateFileMappingW(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(MappingHandle)
+    {
+      // The view keeps the mapping alive after the handles are closed
+      Mapping = reinterpret_cast<const uint8 *>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+      MappingSize = Mapping ? FileSize.QuadPart : 0;
+      CloseHandle(MappingHandle);
+    }
+    CloseHandle(FileHandle);
+  }
+#else
+  const int FileHandle = open(TCHAR_TO_UTF8(*Filename), O_RDONLY);
+  if(FileHandle >= 0)
+  {
+    struct stat FileStat;
+    if(fstat(FileHandle, &FileStat) == 0 && FileStat.st_size > 0)
+    {
+      void *Ptr = mmap(nullptr, FileStat.st_size, PROT_READ, MAP_SHARED, FileHandle, 0);
+      if(Ptr != MAP_FAILED)
+      {
+        Mapping = reinterpret_cast<const uint8 *>(Ptr);
+        MappingSize = FileStat.st_size;
+        // Packets are mostly read in order, so a larger read ahead pays off
+        madvise(Ptr, MappingSize, MADV_SEQUENTIAL);
+      }
+    }
+    // The mapping stays valid after the file is closed
+    close(FileHandle);
+  }
+#endif
+
+  if(!Mapping)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Could not map capture file %s."), *Filename);
+    return;
+  }
+
+  const CaptureFile::FileHeader *Header = reinterpret_cast<const CaptureFile::FileHeader *>(Mapping);
+  if(MappingSize < CaptureFile::Alignment || Header->Magic != CaptureFile::FileMagic || Header->Version != CaptureFile::Version)
+  {
+    UE_LOG(LogTemp, Error, TEXT("%s is not a capture file of version %d."), *Filename, CaptureFile::Version);
+    Index.clear();
+  }
+  else if(!ReadIndex())
+  {
+    UE_LOG(LogTemp, Warning, TEXT("Capture file %s was not closed properly, rebuilding frame index."), *Filename);
+    RebuildIndex();
+  }
+  UE_LOG(LogTemp, Display, TEXT("Opened capture file %s with %d frames."), *Filename, (int32)Index.size());
+}
+
+CaptureFileReader::~CaptureFileReader()
+{
+  if(Mapping)
+  {
+#if PLATFORM_WINDOWS
+    UnmapViewOfFile(Mapping);
+#else
+    munmap(const_cast<uint8 *>(Mapping), MappingSize);
+#endif
+  }
+}
+
+bool CaptureFileReader::ValidChunk(const uint64 Chunk) const
+{
+  if(Chunk < CaptureFile::Alignment || Chunk % CaptureFile::Alignment != 0 || Chunk > MappingSize - CaptureFile::ChunkHeaderSize)
+  {
+    return false;
+  }
+
+  const CaptureFile::ChunkHeader *Header = reinterpret_cast<const CaptureFile::ChunkHeader *>(Mapping + Chunk);
+  if(Header->Magic != CaptureFile::ChunkMagic || Header->StoredSize > MappingSize - Chunk - CaptureFile::ChunkHeaderSize)
+  {
+    return false;
+  }
+  // Uncompressed data is read directly from the mapping, compressed data is decompressed at once
+  if(Header->Compression == CaptureFile::CompressionNone)
+  {
+    return Header->RawSize == Header->StoredSize;
+  }
+  return Header->Compression == CaptureFile::CompressionLZ4 && Header->RawSize <= MAX_int32 && Header->StoredSize <= MAX_int32;
+}
+
+bool CaptureFileReader::ValidEntry(const CaptureFile::IndexEntry &Entry) const
+{
+  if(!ValidChunk(Entry.Chunk))
+  {
+    return false;
+  }
+
+  const CaptureFile::ChunkHeader *Header = reinterpret_cast<const CaptureFile::ChunkHeader *>(Mapping + Entry.Chunk);
+  return Entry.Size >= sizeof(PacketBuffer::PacketHeader) && (uint64)Entry.Offset + Entry.Size <= Header->RawSize;
+}
+
+bool CaptureFileReader::ReadIndex()
+{
+  if(MappingSize < CaptureFile::Alignment + sizeof(CaptureFile::FileFooter))
+  {
+    return false;
+  }
+
+  const CaptureFile::FileFooter *Footer = reinterpret_cast<const CaptureFile::FileFooter *>(Mapping + MappingSize - sizeof(CaptureFile::FileFooter));
+  if(Footer->Magic != CaptureFile::FileMagic || Footer->Version != CaptureFile::Version
+     || Footer->Frames > MappingSize / sizeof(CaptureFile::IndexEntry)
+     || Footer->IndexOffset + Footer->Frames * sizeof(CaptureFile::IndexEntry) + sizeof(CaptureFile::FileFooter) != MappingSize)
+  {
+    return false;
+  }
+
+  const CaptureFile::IndexEntry *Entries = reinterpret_cast<const CaptureFile::IndexEntry *>(Mapping + Footer->IndexOffset);
+  Index.assign(Entries, Entries + Footer->Frames);
+  for(const CaptureFile::IndexEntry &Entry : Index)
+  {
+    if(!ValidEntry(Entry))
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Invalid frame index entry for chunk at offset %llu."), Entry.Chunk);
+      Index.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CaptureFileReader::RebuildIndex()
+{
+  Index.clear();
+
+  uint64 Chunk = CaptureFile::Alignment;
+  while(Chunk + CaptureFile::ChunkHeaderSize <= MappingSize)
+  {
+    if(!ValidChunk(Chunk))
+    {
+      break;
+    }
+    const CaptureFile::ChunkHeader *Header = reinterpret_cast<const CaptureFile::ChunkHeader *>(Mapping + Chunk);
+
+    const uint8 *Data = ChunkData(Chunk);
+    if(!Data)
+    {
+      break;
+    }
+
+    uint64 Offset = 0;
+    bool Valid = true;
+    for(uint32 Frame = 0; Frame < Header->Frames && Offset + sizeof(PacketBuffer::PacketHeader) <= Header->RawSize; ++Frame)
+    {
+      const PacketBuffer::PacketHeader *Packet = reinterpret_cast<const PacketBuffer::PacketHeader *>(Data + Offset);
+      // A packet written only partially ends the index
+      if(Offset > MAX_uint32 || Packet->Size < sizeof(PacketBuffer::PacketHeader) || Offset + Packet->Size > Header->RawSize)
+      {
+        Valid = false;
+        break;
+      }
+
+      CaptureFile::IndexEntry Entry;
+      Entry.TimestampCapture = Packet->TimestampCapture;
+      Entry.Chunk = Chunk;
+      Entry.Offset = Offset;
+      Entry.Size = Packet->Size;
+      Entry.Sequence = Packet->Sequence;
+      Entry.Reserved = 0;
+      Index.push_back(Entry);
+
+      Offset = CaptureFile::Align(Offset + Packet->Size, CaptureFile::PacketAlignment);
+    }
+    if(!Valid)
+    {
+      break;
+    }
+
+    Chunk += CaptureFile::Align(CaptureFile::ChunkHeaderSize + Header->StoredSize, CaptureFile::Alignment);
+  }
+  return !Index.empty();
+}
+
+bool CaptureFileReader::IsOpen() const
+{
+  return Mapping != nullptr && !Index.empty();
+}
+
+uint32 CaptureFileReader::GetFrames() const
+{
+  return Index.size();
+}
+
+const CaptureFile::IndexEntry &CaptureFileReader::GetEntry(const uint32 Frame) const
+{
+  return Index[Frame];
+}
+
+uint32 CaptureFileReader::FindFrame(const uint64 TimestampCapture) const
+{
+  auto It = std::lower_bound(Index.begin(), Index.end(), TimestampCapture, [](const CaptureFile::IndexEntry &Entry, const uint64 Value) {
+    return Entry.TimestampCapture < Value;
+  });
+  return It - Index.begin();
+}
+
+const uint8 *CaptureFileReader::ChunkData(const uint64 Chunk)
+{
+  const CaptureFile::ChunkHeader *Header = reinterpret_cast<const CaptureFile::ChunkHeader *>(Mapping + Chunk);
+  const uint8 *Data = Mapping + Chunk + CaptureFile::ChunkHeaderSize;
+
+  // Uncompressed chunks are read directly from the mapping
+  if(Header->Compression == CaptureFile::CompressionNone)
+  {
+    return Data;
+  }
+
+  if(CachedChunk != Chunk || ChunkCache.empty())
+  {
+    ChunkCache.resize(Header->RawSize);
+    if(Header->Compression != CaptureFile::CompressionLZ4
+       || !FCompression::UncompressMemory(NAME_LZ4, &ChunkCache[0], (int32)Header->RawSize, Data, (int32)Header->StoredSize))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Could not decompress chunk at offset %llu."), Chunk);
+      ChunkCache.clear();
+      return nullptr;
+    }
+    CachedChunk = Chunk;
+  }
+  return &ChunkCache[0];
+}
+
+const uint8 *CaptureFileReader::ReadFrame(const uint32 Frame)
+{
+  if(Frame >= Index.size())
+  {
+    return nullptr;
+  }
+
+  const CaptureFile::IndexEntry &Entry = Index[Frame];
+  const uint8 *Data = ChunkData(Entry.Chunk);
+  return Data ? Data + Entry.Offset : nullptr;
+}
+
+void CaptureFileReader::Prefetch(const uint32 Frame) const
+{
+  if(Frame >= Index.size())
+  {
+    return;
+  }
+
+  const CaptureFile::IndexEntry &Entry = Index[Frame];
+  const CaptureFile::ChunkHeader *Header = reinterpret_cast<const CaptureFile::ChunkHeader *>(Mapping + Entry.Chunk);
+
+  // Compressed chunks are needed as a whole, uncompressed ones only for the range of the packet
+  uint64 Begin = Entry.Chunk + CaptureFile::ChunkHeaderSize;
+  uint64 End = Begin + Header->StoredSize;
+  if(Header->Compression == CaptureFile::CompressionNone)
+  {
+    Begin += Entry.Offset;
+    End = Begin + Entry.Size;
+  }
+  End = std::min<uint64>(End, MappingSize);
+  Begin = Begin / CaptureFile::Alignment * CaptureFile::Alignment;
+  if(Begin >= End)
+  {
+    return;
+  }
+
+#if PLATFORM_WINDOWS
+  WIN32_MEMORY_RANGE_ENTRY Range;
+  Range.VirtualAddress = const_cast<uint8 *>(Mapping + Begin);
+  Range.NumberOfBytes = End - Begin;
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &Range, 0);
+#else
+  madvise(const_cast<uint8 *>(Mapping + Begin), End - Begin, MADV_WILLNEED);
+#endif
+}
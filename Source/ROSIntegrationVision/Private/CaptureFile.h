@@ -0,0 +1,197 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Container format for recorded packets of the PacketBuffer.
+ *
+ * file format:
+ * - FileHeader, padded to Alignment
+ * - Chunks, each one starting at a multiple of Alignment
+ *   - ChunkHeader, padded to ChunkHeaderSize
+ *   - Complete packets, each one starting at a multiple of PacketAlignment inside the chunk data.
+ *     The chunk data is optionally compressed as a whole.
+ * - Frame index, one IndexEntry per packet, sorted by the order of recording
+ * - FileFooter
+ */
+class ROSINTEGRATIONVISION_API CaptureFile
+{
+public:
+  static const uint32 FileMagic = 0x43564952; // "RIVC"
+  static const uint32 ChunkMagic = 0x4B4E4843; // "CHNK"
+  static const uint32 Version = 2; // 2 since the packets carry the versioned header of PacketFormat
+  static const uint32 Alignment = 4096;
+  static const uint32 ChunkHeaderSize = 64;
+  static const uint32 PacketAlignment = 64;
+
+  enum CompressionType : uint32
+  {
+    CompressionNone = 0,
+    CompressionLZ4 = 1
+  };
+
+  struct FileHeader
+  {
+    uint32 Magic; // FileMagic
+    uint32 Version; // Version of the container format
+    uint32 Compression; // Compression requested for the chunks, each chunk stores its own
+    uint32 Reserved;
+  };
+
+  struct ChunkHeader
+  {
+    uint32 Magic; // ChunkMagic
+    uint32 Compression; // Compression of the chunk data
+    uint32 Frames; // Number of packets in the chunk
+    uint32 Reserved;
+    uint64 RawSize; // Size of the uncompressed chunk data
+    uint64 StoredSize; // Size of the chunk data in the file
+  };
+
+  struct IndexEntry
+  {
+    uint64 TimestampCapture; // Timestamp from capture of the packet
+    uint64 Chunk; // File offset of the chunk containing the packet
+    uint32 Offset; // Offset of the packet inside the uncompressed chunk data
+    uint32 Size; // Size of the packet
+    uint32 Sequence; // Sequence number of the packet
+    uint32 Reserved;
+  };
+
+  struct FileFooter
+  {
+    uint64 IndexOffset; // File offset of the frame index
+    uint64 Frames; // Number of entries in the frame index
+    uint32 Magic; // FileMagic
+    uint32 Version; // Version of the container format
+  };
+
+  static inline uint64 Align(const uint64 Value, const uint64 To)
+  {
+    return (Value + To - 1) / To * To;
+  }
+};
+
+/**
+ * Appends complete packets to a capture file. Packets are collected in chunks, which are compressed by a background
+ * thread and copied into a memory mapping of the file at offsets aligned to CaptureFile::Alignment. The file is grown
+ * in large steps ahead of the chunks and truncated to its final size when it is closed. Append only blocks if the
+ * background thread falls behind by more than QueueLength chunks.
+ */
+class ROSINTEGRATIONVISION_API CaptureFileWriter
+{
+private:
+  struct Chunk
+  {
+    std::vector<uint8> Data; // Chunk header space followed by the packets
+    uint32 Used; // Bytes used in Data, including the chunk header space
+    uint32 Frames; // Number of packets in the chunk
+    uint64 Number; // Number of the chunk in the file
+  };
+
+  static const uint32 QueueLength = 4;
+  // The file is grown in steps of this size, so that it is not resized for every chunk
+  static const uint64 ReserveSize = 256 * 1024 * 1024;
+
+#if PLATFORM_WINDOWS
+  void *FileHandle;
+#else
+  int FileHandle;
+#endif
+  // Current size of the file, the space after FileOffset is reserved and reads as zeros
+  uint64 FileSize;
+  const uint32 ChunkSize;
+  const CaptureFile::CompressionType Compression;
+  std::vector<Chunk> Chunks;
+  std::deque<Chunk *> Pending, Free;
+  Chunk *Current;
+  uint64 ChunkCount;
+  // Frame index, the chunk field contains the chunk number until the file is closed
+  std::vector<CaptureFile::IndexEntry> Index;
+  // File offsets of the written chunks, only accessed by the background thread until it is joined
+  std::vector<uint64> ChunkOffsets;
+  uint64 FileOffset;
+  std::mutex LockQueue;
+  std::condition_variable CVPending, CVFree;
+  std::thread ThreadIO;
+  bool Running;
+  std::atomic<bool> Failed;
+
+  // Hands the current chunk to the background thread and waits for a free one
+  void Submit();
+
+  // Background thread compressing and writing the chunks
+  void WriteChunks();
+
+  // Copies the data into a mapping of the file at the given offset, growing the file if needed
+  bool WriteMapped(const uint64 Offset, const uint8 *Data, const uint64 Size);
+  bool Resize(const uint64 Size);
+
+public:
+  // Creates the file, ChunkSize is the size of the uncompressed chunk data
+  CaptureFileWriter(const FString &Filename, const uint32 ChunkSize = 64 * 1024 * 1024, const CaptureFile::CompressionType Compression = CaptureFile::CompressionNone);
+  ~CaptureFileWriter();
+
+  bool IsOpen() const;
+
+  // Copies a complete packet into the current chunk
+  bool Append(const uint8 *Packet, const uint32 Size, const uint64 TimestampCapture, const uint32 Sequence);
+
+  // Writes the remaining chunks, the frame index and the footer
+  void Close();
+};
+
+/**
+ * Reads a capture file through a memory mapping. The frame index is taken from the end of the file, if the file
+ * was not closed properly it is rebuilt by scanning the chunks.
+ */
+class ROSINTEGRATIONVISION_API CaptureFileReader
+{
+private:
+  const uint8 *Mapping;
+  uint64 MappingSize;
+  std::vector<CaptureFile::IndexEntry> Index;
+  // Last decompressed chunk
+  std::vector<uint8> ChunkCache;
+  uint64 CachedChunk;
+
+  // Returns the uncompressed data of the chunk at the given offset
+  const uint8 *ChunkData(const uint64 Chunk);
+
+  // Returns true if a chunk starts at the offset and its data lies inside the mapping
+  bool ValidChunk(const uint64 Chunk) const;
+  // Returns true if the packet of the entry lies inside the data of a valid chunk
+  bool ValidEntry(const CaptureFile::IndexEntry &Entry) const;
+
+  // The index is only kept if all its entries are valid, the rebuilt one ends at the first invalid chunk or packet
+  bool ReadIndex();
+  bool RebuildIndex();
+
+public:
+  CaptureFileReader(const FString &Filename);
+  ~CaptureFileReader();
+
+  bool IsOpen() const;
+
+  uint32 GetFrames() const;
+
+  const CaptureFile::IndexEntry &GetEntry(const uint32 Frame) const;
+
+  // Returns the first frame captured at or after the timestamp, GetFrames() if there is none
+  uint32 FindFrame(const uint64 TimestampCapture) const;
+
+  // Returns a pointer to the complete packet, valid until the next call or the reader is destroyed
+  const uint8 *ReadFrame(const uint32 Frame);
+
+  // Asks the OS to read the frame ahead, so that the following ReadFrame does not wait for the disk
+  void Prefetch(const uint32 Frame) const;
+};
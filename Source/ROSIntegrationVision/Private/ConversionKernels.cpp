@@ -0,0 +1,920 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ConversionKernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define VISION_X86 1
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+  #include <immintrin.h>
+#else
+  #define VISION_X86 0
+#endif
+
+// Compiles a function for the given instruction set without changing the flags of the whole module
+#if defined(__GNUC__) || defined(__clang__)
+  #define VISION_TARGET(Target) __attribute__((target(Target)))
+#else
+  #define VISION_TARGET(Target)
+#endif
+
+// NaN becomes 0 like in the SIMD kernels, which clamp with max(Value, 0) first
+static inline uint8 ToByte(const float Value)
+{
+  return Value == Value ? (uint8)FMath::Clamp(std::round(Value * 255.f), 0.f, 255.f) : 0;
+}
+
+static void HalfToFloatScalar(const uint16 *In, float *Out, const uint32 Count, const float Scale)
+{
+  FFloat16 Value;
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    Value.Encoded = In[i];
+    Out[i] = (float)Value * Scale;
+  }
+}
+
+static void FloatToHalfScalar(const float *In, uint16 *Out, const uint32 Count)
+{
+  const uint32 Infinity = 255 << 23;
+  const uint32 HalfMax = (127 + 16) << 23;
+  const uint32 DenormMagicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+  float DenormMagic;
+  memcpy(&DenormMagic, &DenormMagicBits, 4);
+
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    uint32 Bits;
+    memcpy(&Bits, &In[i], 4);
+    const uint32 Sign = Bits & 0x80000000u;
+    Bits ^= Sign;
+
+    uint32 Half;
+    if(Bits >= HalfMax)
+    {
+      // Infinity or NaN
+      Half = Bits > Infinity ? 0x7E00 : 0x7C00;
+    }
+    else if(Bits < (113 << 23))
+    {
+      // Subnormal or zero, the addition rounds the mantissa
+      float Value;
+      memcpy(&Value, &Bits, 4);
+      Value += DenormMagic;
+      memcpy(&Bits, &Value, 4);
+      Half = Bits - DenormMagicBits;
+    }
+    else
+    {
+      // Rebias the exponent and round to nearest even
+      const uint32 MantissaOdd = (Bits >> 13) & 1;
+      Bits += ((uint32)(15 - 127) << 23) + 0xFFF + MantissaOdd;
+      Half = Bits >> 13;
+    }
+    Out[i] = (uint16)(Half | (Sign >> 16));
+  }
+}
+
+static void HalfToBGR8Scalar(const FFloat16Color *In, uint8 *Out, const uint32 Count)
+{
+  for(uint32 i = 0; i < Count; ++i, ++In, Out += 3)
+  {
+    Out[0] = ToByte((float)In->B);
+    Out[1] = ToByte((float)In->G);
+    Out[2] = ToByte((float)In->R);
+  }
+}
+
+static inline uint16 ToMillimeters(const float Value, const float Scale, const float Near, const float Far)
+{
+  const float Meters = Value * Scale;
+  if(!(Meters >= Near && Meters <= Far))
+  {
+    return 0;
+  }
+  return (uint16)std::nearbyint(FMath::Min(Meters * 1000.f, 65535.f));
+}
+
+static void HalfToMillimetersScalar(const uint16 *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  FFloat16 Value;
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    Value.Encoded = In[i];
+    Out[i] = ToMillimeters((float)Value, Scale, Near, Far);
+  }
+}
+
+static void FloatToMillimetersScalar(const float *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    Out[i] = ToMillimeters(In[i], Scale, Near, Far);
+  }
+}
+
+static bool EqualRowsScalar(const uint8 *A, const uint32 StrideA, const uint8 *B, const uint32 StrideB, const uint32 RowSize, const uint32 Rows)
+{
+  for(uint32 Row = 0; Row < Rows; ++Row, A += StrideA, B += StrideB)
+  {
+    if(memcmp(A, B, RowSize) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Computes the normal of a pixel from the depth of its neighbours. A and B are the ray direction of the pixel and D
+// the increment of the ray direction between neighbouring pixels. The points of the neighbours are Depth * (A +- D, B, 1)
+// and Depth * (A, B +- D, 1), the normal is the cross product of their differences.
+static inline void NormalScalar(const float Up, const float Left, const float Center, const float Right, const float Down, const float A, const float B, const float D, float *Out)
+{
+  const float DX = Right - Left, DY = Down - Up;
+  const float UX = Right * (A + D) - Left * (A - D), UY = B * DX;
+  const float VX = A * DY, VY = Down * (B + D) - Up * (B - D);
+  const float NX = VY * DX - DY * UY, NY = DY * UX - VX * DX, NZ = VX * UY - VY * UX;
+  const float Length = std::sqrt(NX * NX + NY * NY + NZ * NZ);
+  if(Center > 0 && Left > 0 && Right > 0 && Up > 0 && Down > 0 && Length > 0)
+  {
+    Out[0] = NX / Length;
+    Out[1] = NY / Length;
+    Out[2] = NZ / Length;
+  }
+  else
+  {
+    Out[0] = Out[1] = Out[2] = std::numeric_limits<float>::quiet_NaN();
+  }
+}
+
+// Computes the normals of the pixels First to Last of a row, the first and the last pixel of the row have no neighbours
+static void DepthToNormalsRange(const float *Above, const float *Row, const float *Below, float *Out, const uint32 First, const uint32 Last, const uint32 Count, const float X, const float InvFocal, const float Y)
+{
+  for(uint32 i = First; i < Last; ++i)
+  {
+    if(i == 0 || i + 1 == Count)
+    {
+      Out[i * 3] = Out[i * 3 + 1] = Out[i * 3 + 2] = std::numeric_limits<float>::quiet_NaN();
+      continue;
+    }
+    NormalScalar(Above[i], Row[i - 1], Row[i], Row[i + 1], Below[i], X + i * InvFocal, Y, InvFocal, Out + i * 3);
+  }
+}
+
+static void DepthToNormalsScalar(const float *Above, const float *Row, const float *Below, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y)
+{
+  DepthToNormalsRange(Above, Row, Below, Out, 0, Count, Count, X, InvFocal, Y);
+}
+
+// Projects the point Depth * (A, B, 1) into the previous frame and returns its motion since then
+static inline void FlowScalar(const float Depth, const float A, const float B, const float Focal, const float *Transform, float *Out)
+{
+  const float QX = Depth * (Transform[0] * A + Transform[1] * B + Transform[2]) + Transform[3];
+  const float QY = Depth * (Transform[4] * A + Transform[5] * B + Transform[6]) + Transform[7];
+  const float QZ = Depth * (Transform[8] * A + Transform[9] * B + Transform[10]) + Transform[11];
+  if(Depth > 0 && QZ > 0)
+  {
+    Out[0] = Focal * (A - QX / QZ);
+    Out[1] = Focal * (B - QY / QZ);
+  }
+  else
+  {
+    Out[0] = Out[1] = std::numeric_limits<float>::quiet_NaN();
+  }
+}
+
+static void DepthToFlowScalar(const float *Row, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y, const float Focal, const float *Transform)
+{
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    FlowScalar(Row[i], X + i * InvFocal, Y, Focal, Transform, Out + i * 2);
+  }
+}
+
+// Clips a range in meters like REP 117, NaN stays NaN
+static inline float ToRange(const float Value, const float Near, const float Far)
+{
+  return Value < Near ? -std::numeric_limits<float>::infinity() : Value > Far ? std::numeric_limits<float>::infinity() : Value;
+}
+
+static void GatherHalfRangesScalar(const uint16 *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  FFloat16 Value;
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    Value.Encoded = Depth[Index[i]];
+    Out[i] = ToRange((float)Value * Scale * Factor[i], Near, Far);
+  }
+}
+
+static void GatherFloatRangesScalar(const float *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    Out[i] = ToRange(Depth[Index[i]] * Scale * Factor[i], Near, Far);
+  }
+}
+
+#if VISION_X86
+
+// Converts the 4 half floats in the lower 64 bits, handles denormals, infinity and NaN
+VISION_TARGET("sse2") static inline __m128 HalfToFloatSSE2(const __m128i Half)
+{
+  const __m128i MaskNoSign = _mm_set1_epi32(0x7fff);
+  const __m128 Magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+  const __m128i WasInfNan = _mm_set1_epi32(0x7bff);
+  const __m128i ExpInfNan = _mm_set1_epi32(255 << 23);
+
+  const __m128i Wide = _mm_unpacklo_epi16(Half, _mm_setzero_si128());
+  const __m128i ExpMant = _mm_and_si128(MaskNoSign, Wide);
+  const __m128i Sign = _mm_slli_epi32(_mm_xor_si128(Wide, ExpMant), 16);
+  const __m128 Scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(ExpMant, 13)), Magic);
+  const __m128i InfNan = _mm_and_si128(_mm_cmpgt_epi32(ExpMant, WasInfNan), ExpInfNan);
+  return _mm_or_ps(Scaled, _mm_castsi128_ps(_mm_or_si128(Sign, InfNan)));
+}
+
+// Scales RGBA floats to [0, 255] and converts them to integers. Clamping before the conversion keeps infinity from
+// turning into the integer indefinite value, max returns its second operand for NaN, so NaN becomes 0.
+VISION_TARGET("sse2") static inline __m128i ScaleToByteSSE2(const __m128 Value)
+{
+  const __m128 Max = _mm_set1_ps(255.f);
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(Value, Max), _mm_setzero_ps()), Max));
+}
+
+// Converts 4 RGBA float pixels to 16 saturated RGBA bytes
+VISION_TARGET("sse2") static inline __m128i PackRGBA8(const __m128 P0, const __m128 P1, const __m128 P2, const __m128 P3)
+{
+  const __m128i P01 = _mm_packs_epi32(ScaleToByteSSE2(P0), ScaleToByteSSE2(P1));
+  const __m128i P23 = _mm_packs_epi32(ScaleToByteSSE2(P2), ScaleToByteSSE2(P3));
+  return _mm_packus_epi16(P01, P23);
+}
+
+// Converts 8 floats to meters, clips them and converts them to saturated millimeters. SSE2 has no unsigned
+// saturation for 32 bit, so the values are biased into the signed range and back.
+VISION_TARGET("sse2") static inline __m128i MillimetersSSE2(const __m128 A, const __m128 B, const __m128 Scale, const __m128 Near, const __m128 Far)
+{
+  const __m128 Milli = _mm_set1_ps(1000.f);
+  const __m128 Max = _mm_set1_ps(65535.f);
+  const __m128i Bias = _mm_set1_epi32(32768);
+
+  const __m128 MetersA = _mm_mul_ps(A, Scale);
+  const __m128 MetersB = _mm_mul_ps(B, Scale);
+  const __m128 ValidA = _mm_and_ps(_mm_cmpge_ps(MetersA, Near), _mm_cmple_ps(MetersA, Far));
+  const __m128 ValidB = _mm_and_ps(_mm_cmpge_ps(MetersB, Near), _mm_cmple_ps(MetersB, Far));
+  const __m128 MilliA = _mm_and_ps(_mm_min_ps(_mm_mul_ps(MetersA, Milli), Max), ValidA);
+  const __m128 MilliB = _mm_and_ps(_mm_min_ps(_mm_mul_ps(MetersB, Milli), Max), ValidB);
+  const __m128i Packed = _mm_packs_epi32(_mm_sub_epi32(_mm_cvtps_epi32(MilliA), Bias), _mm_sub_epi32(_mm_cvtps_epi32(MilliB), Bias));
+  return _mm_add_epi16(Packed, _mm_set1_epi16(-32768));
+}
+
+VISION_TARGET("sse2") static void HalfToFloatSSE2(const uint16 *In, float *Out, const uint32 Count, const float Scale)
+{
+  const __m128 ScaleVec = _mm_set1_ps(Scale);
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4)
+  {
+    _mm_storeu_ps(Out + i, _mm_mul_ps(HalfToFloatSSE2(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(In + i))), ScaleVec));
+  }
+  HalfToFloatScalar(In + i, Out + i, Count - i, Scale);
+}
+
+VISION_TARGET("sse2") static void HalfToBGR8SSE2(const FFloat16Color *In, uint8 *Out, const uint32 Count)
+{
+  alignas(16) uint8 RGBA[16];
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4, In += 4, Out += 12)
+  {
+    const __m128i Half01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In));
+    const __m128i Half23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 2));
+    _mm_store_si128(reinterpret_cast<__m128i *>(RGBA), PackRGBA8(HalfToFloatSSE2(Half01), HalfToFloatSSE2(_mm_srli_si128(Half01, 8)),
+                                                                 HalfToFloatSSE2(Half23), HalfToFloatSSE2(_mm_srli_si128(Half23, 8))));
+    for(uint32 p = 0; p < 4; ++p)
+    {
+      Out[p * 3 + 0] = RGBA[p * 4 + 2];
+      Out[p * 3 + 1] = RGBA[p * 4 + 1];
+      Out[p * 3 + 2] = RGBA[p * 4 + 0];
+    }
+  }
+  HalfToBGR8Scalar(In, Out, Count - i);
+}
+
+VISION_TARGET("sse2") static void HalfToMillimetersSSE2(const uint16 *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m128 ScaleVec = _mm_set1_ps(Scale), NearVec = _mm_set1_ps(Near), FarVec = _mm_set1_ps(Far);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    const __m128i Half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Out + i), MillimetersSSE2(HalfToFloatSSE2(Half), HalfToFloatSSE2(_mm_srli_si128(Half, 8)), ScaleVec, NearVec, FarVec));
+  }
+  HalfToMillimetersScalar(In + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+VISION_TARGET("sse2") static void FloatToMillimetersSSE2(const float *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m128 ScaleVec = _mm_set1_ps(Scale), NearVec = _mm_set1_ps(Near), FarVec = _mm_set1_ps(Far);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Out + i), MillimetersSSE2(_mm_loadu_ps(In + i), _mm_loadu_ps(In + i + 4), ScaleVec, NearVec, FarVec));
+  }
+  FloatToMillimetersScalar(In + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+VISION_TARGET("f16c") static void HalfToFloatF16C(const uint16 *In, float *Out, const uint32 Count, const float Scale)
+{
+  const __m128 ScaleVec = _mm_set1_ps(Scale);
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4)
+  {
+    _mm_storeu_ps(Out + i, _mm_mul_ps(_mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(In + i))), ScaleVec));
+  }
+  HalfToFloatScalar(In + i, Out + i, Count - i, Scale);
+}
+
+VISION_TARGET("f16c") static void FloatToHalfF16C(const float *In, uint16 *Out, const uint32 Count)
+{
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4)
+  {
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(Out + i), _mm_cvtps_ph(_mm_loadu_ps(In + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  FloatToHalfScalar(In + i, Out + i, Count - i);
+}
+
+VISION_TARGET("avx,f16c") static void FloatToHalfAVX(const float *In, uint16 *Out, const uint32 Count)
+{
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Out + i), _mm256_cvtps_ph(_mm256_loadu_ps(In + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  FloatToHalfF16C(In + i, Out + i, Count - i);
+}
+
+VISION_TARGET("f16c,ssse3") static void HalfToBGR8F16C(const FFloat16Color *In, uint8 *Out, const uint32 Count)
+{
+  // Picks B, G and R of each of the 4 RGBA pixels
+  const __m128i ShuffleBGR = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4, In += 4, Out += 12)
+  {
+    const __m128i Half01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In));
+    const __m128i Half23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 2));
+    const __m128i RGBA = PackRGBA8(_mm_cvtph_ps(Half01), _mm_cvtph_ps(_mm_srli_si128(Half01, 8)),
+                                   _mm_cvtph_ps(Half23), _mm_cvtph_ps(_mm_srli_si128(Half23, 8)));
+    const __m128i BGR = _mm_shuffle_epi8(RGBA, ShuffleBGR);
+    // Store exactly 12 Bytes, so that the last pixels do not write past the end
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(Out), BGR);
+    const int32 Last = _mm_cvtsi128_si32(_mm_srli_si128(BGR, 8));
+    memcpy(Out + 8, &Last, 4);
+  }
+  HalfToBGR8Scalar(In, Out, Count - i);
+}
+
+VISION_TARGET("avx,f16c") static void HalfToFloatAVX(const uint16 *In, float *Out, const uint32 Count, const float Scale)
+{
+  const __m256 ScaleVec = _mm256_set1_ps(Scale);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    _mm256_storeu_ps(Out + i, _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(In + i))), ScaleVec));
+  }
+  HalfToFloatF16C(In + i, Out + i, Count - i, Scale);
+}
+
+// Converts 2 RGBA half float pixels to 8 integers in [0, 255], NaN becomes 0 like in ScaleToByteSSE2
+VISION_TARGET("avx2,f16c") static inline __m256i ScaleToByteAVX2(const __m128i Half)
+{
+  const __m256 Max = _mm256_set1_ps(255.f);
+  return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtph_ps(Half), Max), _mm256_setzero_ps()), Max));
+}
+
+VISION_TARGET("avx2,f16c") static void HalfToBGR8AVX2(const FFloat16Color *In, uint8 *Out, const uint32 Count)
+{
+  // Packing works per 128 bit lane and leaves the pixels in the order 0 2 4 6 | 1 3 5 7, the permutation restores it
+  const __m256i Order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  // Picks B, G and R of each of the 4 RGBA pixels per lane
+  const __m256i ShuffleBGR = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8, In += 8, Out += 24)
+  {
+    const __m128i Half01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In));
+    const __m128i Half23 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 2));
+    const __m128i Half45 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 4));
+    const __m128i Half67 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 6));
+    const __m256i P0123 = _mm256_packs_epi32(ScaleToByteAVX2(Half01), ScaleToByteAVX2(Half23));
+    const __m256i P4567 = _mm256_packs_epi32(ScaleToByteAVX2(Half45), ScaleToByteAVX2(Half67));
+    const __m256i RGBA = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(P0123, P4567), Order);
+    const __m256i BGR = _mm256_shuffle_epi8(RGBA, ShuffleBGR);
+    // The 4 Bytes past the first 12 are overwritten by the second lane, which stores exactly 12 Bytes
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Out), _mm256_castsi256_si128(BGR));
+    const __m128i High = _mm256_extracti128_si256(BGR, 1);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(Out + 12), High);
+    const int32 Last = _mm_cvtsi128_si32(_mm_srli_si128(High, 8));
+    memcpy(Out + 20, &Last, 4);
+  }
+  HalfToBGR8F16C(In, Out, Count - i);
+}
+
+// Converts 16 floats to meters, clips them and converts them to saturated millimeters
+VISION_TARGET("avx2") static inline __m256i MillimetersAVX2(const __m256 A, const __m256 B, const __m256 Scale, const __m256 Near, const __m256 Far)
+{
+  const __m256 Milli = _mm256_set1_ps(1000.f);
+  const __m256 Max = _mm256_set1_ps(65535.f);
+
+  const __m256 MetersA = _mm256_mul_ps(A, Scale);
+  const __m256 MetersB = _mm256_mul_ps(B, Scale);
+  const __m256 ValidA = _mm256_and_ps(_mm256_cmp_ps(MetersA, Near, _CMP_GE_OQ), _mm256_cmp_ps(MetersA, Far, _CMP_LE_OQ));
+  const __m256 ValidB = _mm256_and_ps(_mm256_cmp_ps(MetersB, Near, _CMP_GE_OQ), _mm256_cmp_ps(MetersB, Far, _CMP_LE_OQ));
+  const __m256 MilliA = _mm256_and_ps(_mm256_min_ps(_mm256_mul_ps(MetersA, Milli), Max), ValidA);
+  const __m256 MilliB = _mm256_and_ps(_mm256_min_ps(_mm256_mul_ps(MetersB, Milli), Max), ValidB);
+  // Packing works per 128 bit lane, the permutation restores the order
+  const __m256i Packed = _mm256_packus_epi32(_mm256_cvtps_epi32(MilliA), _mm256_cvtps_epi32(MilliB));
+  return _mm256_permute4x64_epi64(Packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+VISION_TARGET("avx2,f16c") static void HalfToMillimetersAVX2(const uint16 *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m256 ScaleVec = _mm256_set1_ps(Scale), NearVec = _mm256_set1_ps(Near), FarVec = _mm256_set1_ps(Far);
+  uint32 i = 0;
+  for(; i + 16 <= Count; i += 16)
+  {
+    const __m256 A = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(In + i)));
+    const __m256 B = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(In + i + 8)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Out + i), MillimetersAVX2(A, B, ScaleVec, NearVec, FarVec));
+  }
+  HalfToMillimetersSSE2(In + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+VISION_TARGET("avx2") static void FloatToMillimetersAVX2(const float *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m256 ScaleVec = _mm256_set1_ps(Scale), NearVec = _mm256_set1_ps(Near), FarVec = _mm256_set1_ps(Far);
+  uint32 i = 0;
+  for(; i + 16 <= Count; i += 16)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Out + i), MillimetersAVX2(_mm256_loadu_ps(In + i), _mm256_loadu_ps(In + i + 8), ScaleVec, NearVec, FarVec));
+  }
+  FloatToMillimetersSSE2(In + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+VISION_TARGET("avx512f") static void HalfToFloatAVX512(const uint16 *In, float *Out, const uint32 Count, const float Scale)
+{
+  const __m512 ScaleVec = _mm512_set1_ps(Scale);
+  uint32 i = 0;
+  for(; i + 16 <= Count; i += 16)
+  {
+    _mm512_storeu_ps(Out + i, _mm512_mul_ps(_mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(In + i))), ScaleVec));
+  }
+  HalfToFloatF16C(In + i, Out + i, Count - i, Scale);
+}
+
+VISION_TARGET("sse2") static bool EqualRowsSSE2(const uint8 *A, const uint32 StrideA, const uint8 *B, const uint32 StrideB, const uint32 RowSize, const uint32 Rows)
+{
+  for(uint32 Row = 0; Row < Rows; ++Row, A += StrideA, B += StrideB)
+  {
+    uint32 i = 0;
+    for(; i + 16 <= RowSize; i += 16)
+    {
+      const __m128i Equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(A + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(B + i)));
+      if(_mm_movemask_epi8(Equal) != 0xFFFF)
+      {
+        return false;
+      }
+    }
+    if(memcmp(A + i, B + i, RowSize - i) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+VISION_TARGET("avx2") static bool EqualRowsAVX2(const uint8 *A, const uint32 StrideA, const uint8 *B, const uint32 StrideB, const uint32 RowSize, const uint32 Rows)
+{
+  for(uint32 Row = 0; Row < Rows; ++Row, A += StrideA, B += StrideB)
+  {
+    uint32 i = 0;
+    for(; i + 32 <= RowSize; i += 32)
+    {
+      const __m256i Equal = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(A + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(B + i)));
+      if(_mm256_movemask_epi8(Equal) != -1)
+      {
+        return false;
+      }
+    }
+    if(!EqualRowsSSE2(A + i, 0, B + i, 0, RowSize - i, 1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Byte compares need AVX-512BW, comparing 32 bit lanes only needs AVX-512F and is equivalent for equality
+VISION_TARGET("avx512f") static bool EqualRowsAVX512(const uint8 *A, const uint32 StrideA, const uint8 *B, const uint32 StrideB, const uint32 RowSize, const uint32 Rows)
+{
+  for(uint32 Row = 0; Row < Rows; ++Row, A += StrideA, B += StrideB)
+  {
+    uint32 i = 0;
+    for(; i + 64 <= RowSize; i += 64)
+    {
+      if(_mm512_cmpneq_epi32_mask(_mm512_loadu_si512(A + i), _mm512_loadu_si512(B + i)) != 0)
+      {
+        return false;
+      }
+    }
+    if(!EqualRowsSSE2(A + i, 0, B + i, 0, RowSize - i, 1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Selects Value where Mask is set and NaN elsewhere
+VISION_TARGET("sse2") static inline __m128 ValidOrNaNSSE2(const __m128 Mask, const __m128 Value)
+{
+  return _mm_or_ps(_mm_and_ps(Mask, Value), _mm_andnot_ps(Mask, _mm_set1_ps(std::numeric_limits<float>::quiet_NaN())));
+}
+
+VISION_TARGET("sse2") static void DepthToNormalsSSE2(const float *Above, const float *Row, const float *Below, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y)
+{
+  const __m128 D = _mm_set1_ps(InvFocal), B = _mm_set1_ps(Y), Zero = _mm_setzero_ps();
+  const __m128 BPlus = _mm_add_ps(B, D), BMinus = _mm_sub_ps(B, D);
+  const __m128 Ramp = _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), D);
+  alignas(16) float N[3][4];
+
+  // The first pixel has no left neighbour, the vectors start at the second one
+  DepthToNormalsRange(Above, Row, Below, Out, 0, FMath::Min(Count, 1u), Count, X, InvFocal, Y);
+  uint32 i = 1;
+  for(; i + 5 <= Count; i += 4)
+  {
+    const __m128 Center = _mm_loadu_ps(Row + i), Left = _mm_loadu_ps(Row + i - 1), Right = _mm_loadu_ps(Row + i + 1);
+    const __m128 Up = _mm_loadu_ps(Above + i), Down = _mm_loadu_ps(Below + i);
+    const __m128 A = _mm_add_ps(_mm_set1_ps(X + i * InvFocal), Ramp);
+
+    const __m128 DX = _mm_sub_ps(Right, Left), DY = _mm_sub_ps(Down, Up);
+    const __m128 UX = _mm_sub_ps(_mm_mul_ps(Right, _mm_add_ps(A, D)), _mm_mul_ps(Left, _mm_sub_ps(A, D))), UY = _mm_mul_ps(B, DX);
+    const __m128 VX = _mm_mul_ps(A, DY), VY = _mm_sub_ps(_mm_mul_ps(Down, BPlus), _mm_mul_ps(Up, BMinus));
+    const __m128 NX = _mm_sub_ps(_mm_mul_ps(VY, DX), _mm_mul_ps(DY, UY));
+    const __m128 NY = _mm_sub_ps(_mm_mul_ps(DY, UX), _mm_mul_ps(VX, DX));
+    const __m128 NZ = _mm_sub_ps(_mm_mul_ps(VX, UY), _mm_mul_ps(VY, UX));
+    const __m128 Length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(NX, NX), _mm_mul_ps(NY, NY)), _mm_mul_ps(NZ, NZ)));
+
+    const __m128 Valid = _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(Center, Zero), _mm_cmpgt_ps(Left, Zero)), _mm_and_ps(_mm_cmpgt_ps(Right, Zero), _mm_cmpgt_ps(Up, Zero))),
+                                    _mm_and_ps(_mm_cmpgt_ps(Down, Zero), _mm_cmpgt_ps(Length, Zero)));
+    _mm_store_ps(N[0], ValidOrNaNSSE2(Valid, _mm_div_ps(NX, Length)));
+    _mm_store_ps(N[1], ValidOrNaNSSE2(Valid, _mm_div_ps(NY, Length)));
+    _mm_store_ps(N[2], ValidOrNaNSSE2(Valid, _mm_div_ps(NZ, Length)));
+    for(uint32 p = 0; p < 4; ++p)
+    {
+      Out[(i + p) * 3 + 0] = N[0][p];
+      Out[(i + p) * 3 + 1] = N[1][p];
+      Out[(i + p) * 3 + 2] = N[2][p];
+    }
+  }
+  DepthToNormalsRange(Above, Row, Below, Out, i, Count, Count, X, InvFocal, Y);
+}
+
+VISION_TARGET("sse2") static void DepthToFlowSSE2(const float *Row, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y, const float Focal, const float *Transform)
+{
+  const __m128 B = _mm_set1_ps(Y), F = _mm_set1_ps(Focal), Zero = _mm_setzero_ps();
+  const __m128 Ramp = _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(InvFocal));
+  // The parts of the rotated ray that are constant along the row
+  const __m128 RX = _mm_set1_ps(Transform[1] * Y + Transform[2]), RY = _mm_set1_ps(Transform[5] * Y + Transform[6]), RZ = _mm_set1_ps(Transform[9] * Y + Transform[10]);
+  const __m128 TX = _mm_set1_ps(Transform[3]), TY = _mm_set1_ps(Transform[7]), TZ = _mm_set1_ps(Transform[11]);
+  const __m128 MX = _mm_set1_ps(Transform[0]), MY = _mm_set1_ps(Transform[4]), MZ = _mm_set1_ps(Transform[8]);
+
+  uint32 i = 0;
+  for(; i + 4 <= Count; i += 4)
+  {
+    const __m128 Depth = _mm_loadu_ps(Row + i);
+    const __m128 A = _mm_add_ps(_mm_set1_ps(X + i * InvFocal), Ramp);
+    const __m128 QX = _mm_add_ps(_mm_mul_ps(Depth, _mm_add_ps(_mm_mul_ps(MX, A), RX)), TX);
+    const __m128 QY = _mm_add_ps(_mm_mul_ps(Depth, _mm_add_ps(_mm_mul_ps(MY, A), RY)), TY);
+    const __m128 QZ = _mm_add_ps(_mm_mul_ps(Depth, _mm_add_ps(_mm_mul_ps(MZ, A), RZ)), TZ);
+    const __m128 Valid = _mm_and_ps(_mm_cmpgt_ps(Depth, Zero), _mm_cmpgt_ps(QZ, Zero));
+    const __m128 FX = ValidOrNaNSSE2(Valid, _mm_mul_ps(F, _mm_sub_ps(A, _mm_div_ps(QX, QZ))));
+    const __m128 FY = ValidOrNaNSSE2(Valid, _mm_mul_ps(F, _mm_sub_ps(B, _mm_div_ps(QY, QZ))));
+    _mm_storeu_ps(Out + i * 2, _mm_unpacklo_ps(FX, FY));
+    _mm_storeu_ps(Out + i * 2 + 4, _mm_unpackhi_ps(FX, FY));
+  }
+  DepthToFlowScalar(Row + i, Out + i * 2, Count - i, X + i * InvFocal, InvFocal, Y, Focal, Transform);
+}
+
+VISION_TARGET("avx2") static inline __m256 ValidOrNaNAVX2(const __m256 Mask, const __m256 Value)
+{
+  return _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::quiet_NaN()), Value, Mask);
+}
+
+VISION_TARGET("avx2") static void DepthToNormalsAVX2(const float *Above, const float *Row, const float *Below, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y)
+{
+  const __m256 D = _mm256_set1_ps(InvFocal), B = _mm256_set1_ps(Y), Zero = _mm256_setzero_ps();
+  const __m256 BPlus = _mm256_add_ps(B, D), BMinus = _mm256_sub_ps(B, D);
+  const __m256 Ramp = _mm256_mul_ps(_mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0), D);
+  alignas(32) float N[3][8];
+
+  DepthToNormalsRange(Above, Row, Below, Out, 0, FMath::Min(Count, 1u), Count, X, InvFocal, Y);
+  uint32 i = 1;
+  for(; i + 9 <= Count; i += 8)
+  {
+    const __m256 Center = _mm256_loadu_ps(Row + i), Left = _mm256_loadu_ps(Row + i - 1), Right = _mm256_loadu_ps(Row + i + 1);
+    const __m256 Up = _mm256_loadu_ps(Above + i), Down = _mm256_loadu_ps(Below + i);
+    const __m256 A = _mm256_add_ps(_mm256_set1_ps(X + i * InvFocal), Ramp);
+
+    const __m256 DX = _mm256_sub_ps(Right, Left), DY = _mm256_sub_ps(Down, Up);
+    const __m256 UX = _mm256_sub_ps(_mm256_mul_ps(Right, _mm256_add_ps(A, D)), _mm256_mul_ps(Left, _mm256_sub_ps(A, D))), UY = _mm256_mul_ps(B, DX);
+    const __m256 VX = _mm256_mul_ps(A, DY), VY = _mm256_sub_ps(_mm256_mul_ps(Down, BPlus), _mm256_mul_ps(Up, BMinus));
+    const __m256 NX = _mm256_sub_ps(_mm256_mul_ps(VY, DX), _mm256_mul_ps(DY, UY));
+    const __m256 NY = _mm256_sub_ps(_mm256_mul_ps(DY, UX), _mm256_mul_ps(VX, DX));
+    const __m256 NZ = _mm256_sub_ps(_mm256_mul_ps(VX, UY), _mm256_mul_ps(VY, UX));
+    const __m256 Length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(NX, NX), _mm256_mul_ps(NY, NY)), _mm256_mul_ps(NZ, NZ)));
+
+    const __m256 Valid = _mm256_and_ps(_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(Center, Zero, _CMP_GT_OQ), _mm256_cmp_ps(Left, Zero, _CMP_GT_OQ)),
+                                                     _mm256_and_ps(_mm256_cmp_ps(Right, Zero, _CMP_GT_OQ), _mm256_cmp_ps(Up, Zero, _CMP_GT_OQ))),
+                                       _mm256_and_ps(_mm256_cmp_ps(Down, Zero, _CMP_GT_OQ), _mm256_cmp_ps(Length, Zero, _CMP_GT_OQ)));
+    _mm256_store_ps(N[0], ValidOrNaNAVX2(Valid, _mm256_div_ps(NX, Length)));
+    _mm256_store_ps(N[1], ValidOrNaNAVX2(Valid, _mm256_div_ps(NY, Length)));
+    _mm256_store_ps(N[2], ValidOrNaNAVX2(Valid, _mm256_div_ps(NZ, Length)));
+    for(uint32 p = 0; p < 8; ++p)
+    {
+      Out[(i + p) * 3 + 0] = N[0][p];
+      Out[(i + p) * 3 + 1] = N[1][p];
+      Out[(i + p) * 3 + 2] = N[2][p];
+    }
+  }
+  DepthToNormalsRange(Above, Row, Below, Out, i, Count, Count, X, InvFocal, Y);
+}
+
+VISION_TARGET("avx2") static void DepthToFlowAVX2(const float *Row, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y, const float Focal, const float *Transform)
+{
+  const __m256 B = _mm256_set1_ps(Y), F = _mm256_set1_ps(Focal), Zero = _mm256_setzero_ps();
+  const __m256 Ramp = _mm256_mul_ps(_mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_ps(InvFocal));
+  const __m256 RX = _mm256_set1_ps(Transform[1] * Y + Transform[2]), RY = _mm256_set1_ps(Transform[5] * Y + Transform[6]), RZ = _mm256_set1_ps(Transform[9] * Y + Transform[10]);
+  const __m256 TX = _mm256_set1_ps(Transform[3]), TY = _mm256_set1_ps(Transform[7]), TZ = _mm256_set1_ps(Transform[11]);
+  const __m256 MX = _mm256_set1_ps(Transform[0]), MY = _mm256_set1_ps(Transform[4]), MZ = _mm256_set1_ps(Transform[8]);
+
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    const __m256 Depth = _mm256_loadu_ps(Row + i);
+    const __m256 A = _mm256_add_ps(_mm256_set1_ps(X + i * InvFocal), Ramp);
+    const __m256 QX = _mm256_add_ps(_mm256_mul_ps(Depth, _mm256_add_ps(_mm256_mul_ps(MX, A), RX)), TX);
+    const __m256 QY = _mm256_add_ps(_mm256_mul_ps(Depth, _mm256_add_ps(_mm256_mul_ps(MY, A), RY)), TY);
+    const __m256 QZ = _mm256_add_ps(_mm256_mul_ps(Depth, _mm256_add_ps(_mm256_mul_ps(MZ, A), RZ)), TZ);
+    const __m256 Valid = _mm256_and_ps(_mm256_cmp_ps(Depth, Zero, _CMP_GT_OQ), _mm256_cmp_ps(QZ, Zero, _CMP_GT_OQ));
+    const __m256 FX = ValidOrNaNAVX2(Valid, _mm256_mul_ps(F, _mm256_sub_ps(A, _mm256_div_ps(QX, QZ))));
+    const __m256 FY = ValidOrNaNAVX2(Valid, _mm256_mul_ps(F, _mm256_sub_ps(B, _mm256_div_ps(QY, QZ))));
+    // Interleaving works per 128 bit lane, the permutation restores the order
+    const __m256 Low = _mm256_unpacklo_ps(FX, FY), High = _mm256_unpackhi_ps(FX, FY);
+    _mm256_storeu_ps(Out + i * 2, _mm256_permute2f128_ps(Low, High, 0x20));
+    _mm256_storeu_ps(Out + i * 2 + 8, _mm256_permute2f128_ps(Low, High, 0x31));
+  }
+  DepthToFlowSSE2(Row + i, Out + i * 2, Count - i, X + i * InvFocal, InvFocal, Y, Focal, Transform);
+}
+
+VISION_TARGET("avx2") static inline __m256 ToRangeAVX2(const __m256 Value, const __m256 Near, const __m256 Far)
+{
+  const __m256 Infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 Clipped = _mm256_blendv_ps(Value, Infinity, _mm256_cmp_ps(Value, Far, _CMP_GT_OQ));
+  return _mm256_blendv_ps(Clipped, _mm256_sub_ps(_mm256_setzero_ps(), Infinity), _mm256_cmp_ps(Value, Near, _CMP_LT_OQ));
+}
+
+VISION_TARGET("avx2,f16c") static void GatherHalfRangesAVX2(const uint16 *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m256 ScaleVec = _mm256_set1_ps(Scale), NearVec = _mm256_set1_ps(Near), FarVec = _mm256_set1_ps(Far);
+  const __m256i Low = _mm256_set1_epi32(0xFFFF);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    // The gather reads 32 bits at the offset of each half float, the upper halves belong to the next pixel
+    const __m256i Offsets = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Index + i));
+    const __m256i Words = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(Depth), Offsets, 2), Low);
+    // Packing works per 128 bit lane, the permutation moves both halves into the lower lane
+    const __m256i Packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(Words, Words), 0x08);
+    const __m256 Value = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtph_ps(_mm256_castsi256_si128(Packed)), ScaleVec), _mm256_loadu_ps(Factor + i));
+    _mm256_storeu_ps(Out + i, ToRangeAVX2(Value, NearVec, FarVec));
+  }
+  GatherHalfRangesScalar(Depth, Index + i, Factor + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+VISION_TARGET("avx2") static void GatherFloatRangesAVX2(const float *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far)
+{
+  const __m256 ScaleVec = _mm256_set1_ps(Scale), NearVec = _mm256_set1_ps(Near), FarVec = _mm256_set1_ps(Far);
+  uint32 i = 0;
+  for(; i + 8 <= Count; i += 8)
+  {
+    const __m256i Offsets = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Index + i));
+    const __m256 Value = _mm256_mul_ps(_mm256_mul_ps(_mm256_i32gather_ps(Depth, Offsets, 4), ScaleVec), _mm256_loadu_ps(Factor + i));
+    _mm256_storeu_ps(Out + i, ToRangeAVX2(Value, NearVec, FarVec));
+  }
+  GatherFloatRangesScalar(Depth, Index + i, Factor + i, Out + i, Count - i, Scale, Near, Far);
+}
+
+static void CPUID(const uint32 Leaf, const uint32 SubLeaf, uint32 Regs[4])
+{
+#if defined(_MSC_VER)
+  __cpuidex(reinterpret_cast<int *>(Regs), Leaf, SubLeaf);
+#else
+  __cpuid_count(Leaf, SubLeaf, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+}
+
+// Returns the register states enabled by the OS
+static uint64 XGETBV()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32 Low, High;
+  __asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+  return ((uint64)High << 32) | Low;
+#endif
+}
+
+#endif // VISION_X86
+
+static ConversionKernels::KernelPath SelectedPath = ConversionKernels::PathScalar;
+
+ConversionKernels::HalfToFloatKernel ConversionKernels::HalfToFloat = &HalfToFloatScalar;
+ConversionKernels::FloatToHalfKernel ConversionKernels::FloatToHalf = &FloatToHalfScalar;
+ConversionKernels::HalfToBGR8Kernel ConversionKernels::HalfToBGR8 = &HalfToBGR8Scalar;
+ConversionKernels::HalfToMillimetersKernel ConversionKernels::HalfToMillimeters = &HalfToMillimetersScalar;
+ConversionKernels::FloatToMillimetersKernel ConversionKernels::FloatToMillimeters = &FloatToMillimetersScalar;
+ConversionKernels::EqualRowsKernel ConversionKernels::EqualRows = &EqualRowsScalar;
+ConversionKernels::DepthToNormalsKernel ConversionKernels::DepthToNormals = &DepthToNormalsScalar;
+ConversionKernels::DepthToFlowKernel ConversionKernels::DepthToFlow = &DepthToFlowScalar;
+ConversionKernels::GatherHalfRangesKernel ConversionKernels::GatherHalfRanges = &GatherHalfRangesScalar;
+ConversionKernels::GatherFloatRangesKernel ConversionKernels::GatherFloatRanges = &GatherFloatRangesScalar;
+
+bool ConversionKernels::IsSupported(const KernelPath Path)
+{
+  if(Path == PathScalar)
+  {
+    return true;
+  }
+#if VISION_X86
+  uint32 Regs[4];
+  CPUID(0, 0, Regs);
+  const uint32 MaxLeaf = Regs[0];
+
+  CPUID(1, 0, Regs);
+  const bool SSE2 = (Regs[3] & (1 << 26)) != 0;
+  const bool OSXSAVE = (Regs[2] & (1 << 27)) != 0;
+  const bool AVX = (Regs[2] & (1 << 28)) != 0;
+  const bool F16C = (Regs[2] & (1 << 29)) != 0;
+  const bool SSSE3 = (Regs[2] & (1 << 9)) != 0;
+
+  // The OS has to save the YMM and ZMM registers
+  const uint64 XCR0 = OSXSAVE ? XGETBV() : 0;
+  const bool OSAVX = (XCR0 & 0x6) == 0x6;
+  const bool OSAVX512 = (XCR0 & 0xE6) == 0xE6;
+
+  bool AVX2 = false, AVX512F = false;
+  if(MaxLeaf >= 7)
+  {
+    CPUID(7, 0, Regs);
+    AVX2 = (Regs[1] & (1 << 5)) != 0;
+    AVX512F = (Regs[1] & (1 << 16)) != 0;
+  }
+
+  switch(Path)
+  {
+  case PathSSE2:
+    return SSE2;
+  case PathF16C:
+    return SSE2 && SSSE3 && AVX && F16C && OSAVX;
+  case PathAVX2:
+    return SSE2 && SSSE3 && AVX && F16C && AVX2 && OSAVX;
+  case PathAVX512:
+    return SSE2 && SSSE3 && AVX && F16C && AVX2 && AVX512F && OSAVX512;
+  default:
+    break;
+  }
+#endif
+  return false;
+}
+
+void ConversionKernels::Select()
+{
+  for(int32 Path = PathCount - 1; Path >= PathScalar; --Path)
+  {
+    if(Select((KernelPath)Path))
+    {
+      break;
+    }
+  }
+}
+
+bool ConversionKernels::Select(const KernelPath Path)
+{
+  if(!IsSupported(Path))
+  {
+    return false;
+  }
+
+  switch(Path)
+  {
+#if VISION_X86
+  case PathSSE2:
+    HalfToFloat = &HalfToFloatSSE2;
+    FloatToHalf = &FloatToHalfScalar;
+    HalfToBGR8 = &HalfToBGR8SSE2;
+    HalfToMillimeters = &HalfToMillimetersSSE2;
+    FloatToMillimeters = &FloatToMillimetersSSE2;
+    EqualRows = &EqualRowsSSE2;
+    DepthToNormals = &DepthToNormalsSSE2;
+    DepthToFlow = &DepthToFlowSSE2;
+    GatherHalfRanges = &GatherHalfRangesScalar;
+    GatherFloatRanges = &GatherFloatRangesScalar;
+    break;
+  case PathF16C:
+    HalfToFloat = &HalfToFloatF16C;
+    FloatToHalf = &FloatToHalfF16C;
+    HalfToBGR8 = &HalfToBGR8F16C;
+    HalfToMillimeters = &HalfToMillimetersSSE2;
+    FloatToMillimeters = &FloatToMillimetersSSE2;
+    EqualRows = &EqualRowsSSE2;
+    DepthToNormals = &DepthToNormalsSSE2;
+    DepthToFlow = &DepthToFlowSSE2;
+    GatherHalfRanges = &GatherHalfRangesScalar;
+    GatherFloatRanges = &GatherFloatRangesScalar;
+    break;
+  case PathAVX2:
+    HalfToFloat = &HalfToFloatAVX;
+    FloatToHalf = &FloatToHalfAVX;
+    HalfToBGR8 = &HalfToBGR8AVX2;
+    HalfToMillimeters = &HalfToMillimetersAVX2;
+    FloatToMillimeters = &FloatToMillimetersAVX2;
+    EqualRows = &EqualRowsAVX2;
+    DepthToNormals = &DepthToNormalsAVX2;
+    DepthToFlow = &DepthToFlowAVX2;
+    GatherHalfRanges = &GatherHalfRangesAVX2;
+    GatherFloatRanges = &GatherFloatRangesAVX2;
+    break;
+  case PathAVX512:
+    HalfToFloat = &HalfToFloatAVX512;
+    FloatToHalf = &FloatToHalfAVX;
+    // AVX-512 only requires avx512f, byte shuffles on 512 bit would need avx512bw
+    HalfToBGR8 = &HalfToBGR8AVX2;
+    HalfToMillimeters = &HalfToMillimetersAVX2;
+    FloatToMillimeters = &FloatToMillimetersAVX2;
+    EqualRows = &EqualRowsAVX512;
+    DepthToNormals = &DepthToNormalsAVX2;
+    DepthToFlow = &DepthToFlowAVX2;
+    GatherHalfRanges = &GatherHalfRangesAVX2;
+    GatherFloatRanges = &GatherFloatRangesAVX2;
+    break;
+#endif
+  default:
+    HalfToFloat = &HalfToFloatScalar;
+    FloatToHalf = &FloatToHalfScalar;
+    HalfToBGR8 = &HalfToBGR8Scalar;
+    HalfToMillimeters = &HalfToMillimetersScalar;
+    FloatToMillimeters = &FloatToMillimetersScalar;
+    EqualRows = &EqualRowsScalar;
+    DepthToNormals = &DepthToNormalsScalar;
+    DepthToFlow = &DepthToFlowScalar;
+    GatherHalfRanges = &GatherHalfRangesScalar;
+    GatherFloatRanges = &GatherFloatRangesScalar;
+    break;
+  }
+
+  SelectedPath = Path;
+  UE_LOG(LogTemp, Display, TEXT("Using %s image conversion kernels."), GetPathName(Path));
+  return true;
+}
+
+ConversionKernels::KernelPath ConversionKernels::GetPath()
+{
+  return SelectedPath;
+}
+
+const TCHAR *ConversionKernels::GetPathName(const KernelPath Path)
+{
+  switch(Path)
+  {
+  case PathScalar:
+    return TEXT("scalar");
+  case PathSSE2:
+    return TEXT("SSE2");
+  case PathF16C:
+    return TEXT("F16C");
+  case PathAVX2:
+    return TEXT("AVX2");
+  case PathAVX512:
+    return TEXT("AVX-512");
+  default:
+    break;
+  }
+  return TEXT("unknown");
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Conversion kernels for the image data with implementations for several instruction sets. Each implementation is
+ * compiled for its own target, so the plugin builds with the stock toolchain flags. The fastest path supported by
+ * the CPU is selected by CPUID once at module startup.
+ */
+class ROSINTEGRATIONVISION_API ConversionKernels
+{
+public:
+  enum KernelPath
+  {
+    PathScalar = 0,
+    PathSSE2,
+    PathF16C,
+    PathAVX2,
+    PathAVX512,
+    PathCount
+  };
+
+  // Converts Count half floats to floats and multiplies them by Scale
+  typedef void (*HalfToFloatKernel)(const uint16 *In, float *Out, const uint32 Count, const float Scale);
+  // Converts Count floats to half floats, rounding to nearest even
+  typedef void (*FloatToHalfKernel)(const float *In, uint16 *Out, const uint32 Count);
+  // Converts Count RGBA half float colors in the range [0, 1] to BGR bytes, values outside of it saturate and NaN becomes 0
+  typedef void (*HalfToBGR8Kernel)(const FFloat16Color *In, uint8 *Out, const uint32 Count);
+
+  // Converts Count half floats, or floats, multiplied by Scale to meters into millimeters as used by 16UC1 depth images.
+  // Values outside of [Near, Far] meters and NaN become 0, values beyond the range of uint16 saturate.
+  typedef void (*HalfToMillimetersKernel)(const uint16 *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far);
+  typedef void (*FloatToMillimetersKernel)(const float *In, uint16 *Out, const uint32 Count, const float Scale, const float Near, const float Far);
+  // Compares Rows rows of RowSize Bytes, returns true if all of them are equal
+  typedef bool (*EqualRowsKernel)(const uint8 *A, const uint32 StrideA, const uint8 *B, const uint32 StrideB, const uint32 RowSize, const uint32 Rows);
+  // Computes the unit surface normals of a row of Count depth values in meters from the neighbouring pixels in the row
+  // and in the rows above and below, as X, Y, Z in the optical frame facing the camera. X is the ray direction
+  // (u - cx) / f of the first pixel, InvFocal its increment per pixel and Y the ray direction (v - cy) / f of the row.
+  // Pixels without valid neighbours are NaN.
+  typedef void (*DepthToNormalsKernel)(const float *Above, const float *Row, const float *Below, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y);
+  // Computes the image motion in pixels of a row of Count depth values in meters as X, Y, caused by the camera moving
+  // from the previous frame to this one. Transform (3x4, row major) maps points from the optical frame of this frame
+  // into the one of the previous frame. Pixels without valid depth are NaN.
+  typedef void (*DepthToFlowKernel)(const float *Row, float *Out, const uint32 Count, const float X, const float InvFocal, const float Y, const float Focal, const float *Transform);
+
+  // Gathers Count depth values, half floats or floats, at the element offsets Index and converts them into ranges in
+  // meters by multiplying them by Scale and the factor of each beam. Ranges below Near become -Inf and beyond Far +Inf
+  // like REP 117, NaN stays NaN. The half float gathers read 32 bits, so two more bytes have to follow the depth.
+  typedef void (*GatherHalfRangesKernel)(const uint16 *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far);
+  typedef void (*GatherFloatRangesKernel)(const float *Depth, const uint32 *Index, const float *Factor, float *Out, const uint32 Count, const float Scale, const float Near, const float Far);
+
+  static HalfToFloatKernel HalfToFloat;
+  static FloatToHalfKernel FloatToHalf;
+  static HalfToBGR8Kernel HalfToBGR8;
+  static HalfToMillimetersKernel HalfToMillimeters;
+  static FloatToMillimetersKernel FloatToMillimeters;
+  static EqualRowsKernel EqualRows;
+  static DepthToNormalsKernel DepthToNormals;
+  static DepthToFlowKernel DepthToFlow;
+  static GatherHalfRangesKernel GatherHalfRanges;
+  static GatherFloatRangesKernel GatherFloatRanges;
+
+  // Selects the fastest path supported by the CPU
+  static void Select();
+
+  // Selects the given path, e.g. for benchmarks. Returns false if it is not supported by the CPU.
+  static bool Select(const KernelPath Path);
+
+  static bool IsSupported(const KernelPath Path);
+
+  static KernelPath GetPath();
+
+  static const TCHAR *GetPathName(const KernelPath Path);
+};
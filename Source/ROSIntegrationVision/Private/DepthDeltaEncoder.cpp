@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DepthDeltaEncoder.h"
+
+#include "ConversionKernels.h"
+
+DepthDeltaEncoder::DepthDeltaEncoder(const uint32 KeyframeInterval) :
+  KeyframeInterval(FMath::Max<uint32>(KeyframeInterval, 1))
+{
+  Reset();
+}
+
+void DepthDeltaEncoder::Reset()
+{
+  Reference.clear();
+  ReferenceWidth = 0;
+  ReferenceHeight = 0;
+  ReferenceEncoding = 0;
+  ReferenceSequence = 0;
+  FramesSinceKeyframe = 0;
+}
+
+const AlignedBytes &DepthDeltaEncoder::Encode(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const float Scale, const uint32 Sequence)
+{
+  const uint32 Bytes = PacketFormat::BytesPerPixel(Stream.Encoding);
+  const uint32 Stride = Stream.Width * Bytes;
+  const uint32 MaskSize = (uint32)DepthDelta::MaskSize(Stream.Width, Stream.Height);
+  const uint32 CountX = DepthDelta::TilesX(Stream.Width);
+  const uint32 CountY = DepthDelta::TilesY(Stream.Height);
+
+  const bool Keyframe = Reference.empty() || ReferenceWidth != Stream.Width || ReferenceHeight != Stream.Height
+                        || ReferenceEncoding != Stream.Encoding || FramesSinceKeyframe + 1 >= KeyframeInterval;
+  if(Keyframe)
+  {
+    Reference.resize(Stride * Stream.Height);
+    ReferenceWidth = Stream.Width;
+    ReferenceHeight = Stream.Height;
+    ReferenceEncoding = Stream.Encoding;
+    FramesSinceKeyframe = 0;
+  }
+  else
+  {
+    ++FramesSinceKeyframe;
+  }
+
+  // Room for the worst case, every tile changed
+  Output.resize(sizeof(DepthDelta::FrameHeader) + MaskSize + Reference.size());
+  uint8 *TileMask = &Output[sizeof(DepthDelta::FrameHeader)];
+  uint8 *Samples = TileMask + MaskSize;
+  memset(TileMask, 0, MaskSize);
+  uint32 ChangedTiles = 0;
+
+  for(uint32 TileY = 0; TileY < CountY; ++TileY)
+  {
+    const uint32 Y = TileY * DepthDelta::TileSize;
+    const uint32 Rows = FMath::Min(DepthDelta::TileSize, Stream.Height - Y);
+    for(uint32 TileX = 0; TileX < CountX; ++TileX)
+    {
+      const uint32 X = TileX * DepthDelta::TileSize;
+      const uint32 RowSize = FMath::Min(DepthDelta::TileSize, Stream.Width - X) * Bytes;
+      const uint8 *In = Data + Y * Stream.Stride + X * Bytes;
+      uint8 *Ref = &Reference[Y * Stride + X * Bytes];
+
+      if(!Keyframe && ConversionKernels::EqualRows(In, Stream.Stride, Ref, Stride, RowSize, Rows))
+      {
+        continue;
+      }
+
+      const uint32 Tile = TileY * CountX + TileX;
+      TileMask[Tile / 8] |= 1 << (Tile % 8);
+      ++ChangedTiles;
+      for(uint32 Row = 0; Row < Rows; ++Row, Samples += RowSize)
+      {
+        memcpy(Samples, In + Row * Stream.Stride, RowSize);
+        memcpy(Ref + Row * Stride, In + Row * Stream.Stride, RowSize);
+      }
+    }
+  }
+
+  Output.resize(Samples - &Output[0]);
+
+  DepthDelta::FrameHeader *Header = reinterpret_cast<DepthDelta::FrameHeader *>(&Output[0]);
+  Header->Magic = DepthDelta::Magic;
+  Header->Version = DepthDelta::Version;
+  Header->Size = Output.size();
+  Header->Flags = Keyframe ? DepthDelta::FlagKeyframe : 0;
+  Header->Sequence = Sequence;
+  Header->Reference = Keyframe ? Sequence : ReferenceSequence;
+  Header->Width = Stream.Width;
+  Header->Height = Stream.Height;
+  Header->Encoding = Stream.Encoding;
+  Header->Scale = Scale;
+  Header->ChangedTiles = ChangedTiles;
+  Header->Reserved = 0;
+
+  ReferenceSequence = Sequence;
+  return Output;
+}
@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "DepthDelta.h"
+
+/**
+ * Encodes the depth stream of consecutive packets as keyframes and tile deltas, see DepthDelta.h. The previous
+ * frame is kept as reference, tiles are compared against it with ConversionKernels::EqualRows.
+ */
+class ROSINTEGRATIONVISION_API DepthDeltaEncoder
+{
+private:
+  const uint32 KeyframeInterval;
+  AlignedBytes Reference, Output;
+  uint32 ReferenceWidth, ReferenceHeight, ReferenceEncoding, ReferenceSequence;
+  uint32 FramesSinceKeyframe;
+
+public:
+  // A keyframe is emitted at least every KeyframeInterval frames, so that subscribers can join the stream
+  DepthDeltaEncoder(const uint32 KeyframeInterval);
+
+  // Encodes the samples of the stream, the result is valid until the next call
+  const AlignedBytes &Encode(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const float Scale, const uint32 Sequence);
+
+  // Forces a keyframe with the next frame
+  void Reset();
+};
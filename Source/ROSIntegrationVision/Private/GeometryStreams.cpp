@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GeometryStreams.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "Async/ParallelFor.h"
+
+#include "ConversionKernels.h"
+#include "StreamConversion.h"
+
+// Rotation matrix of a unit quaternion, row major
+static void ToMatrix(const PacketFormat::Quaternion &Q, double M[3][3])
+{
+  const double X = Q.X, Y = Q.Y, Z = Q.Z, W = Q.W;
+  M[0][0] = 1 - 2 * (Y * Y + Z * Z);
+  M[0][1] = 2 * (X * Y - Z * W);
+  M[0][2] = 2 * (X * Z + Y * W);
+  M[1][0] = 2 * (X * Y + Z * W);
+  M[1][1] = 1 - 2 * (X * X + Z * Z);
+  M[1][2] = 2 * (Y * Z - X * W);
+  M[2][0] = 2 * (X * Z - Y * W);
+  M[2][1] = 2 * (Y * Z + X * W);
+  M[2][2] = 1 - 2 * (X * X + Y * Y);
+}
+
+GeometryStreams::GeometryStreams(const uint32 Width, const uint32 Height, const double FocalLength, const double CenterX, const double CenterY) :
+  Width(Width), Height(Height), FocalLength(FocalLength), CenterX(CenterX), CenterY(CenterY), PreviousValid(false)
+{
+}
+
+const float *GeometryStreams::ToMeters(const PacketFormat::StreamDescriptor &Depth, const uint8 *Data)
+{
+  // Depth converted to meters on the GPU is used in place
+  if(Depth.Encoding == PacketFormat::EncodingF32 && Depth.Scale == 1.0f && Depth.Stride == Width * sizeof(float))
+  {
+    return reinterpret_cast<const float *>(Data);
+  }
+
+  Meters.resize(Width * Height * sizeof(float));
+  float *Out = reinterpret_cast<float *>(Meters.data());
+  const int32 Tiles = (Height + TileRows - 1) / TileRows;
+  ParallelFor(Tiles, [&](int32 Tile)
+  {
+    const uint32 FirstRow = Tile * TileRows;
+    const uint32 LastRow = FMath::Min(FirstRow + TileRows, Height);
+    for(uint32 Row = FirstRow; Row < LastRow; ++Row)
+    {
+      StreamConversion::DepthRowToMeters(Depth, Data, Row, Out + Row * Width);
+    }
+  });
+  return Out;
+}
+
+void GeometryStreams::ToPrevious(const PacketFormat::Vector &Translation, const PacketFormat::Quaternion &Rotation, float Transform[12]) const
+{
+  // Without a previous packet there is no motion
+  if(!PreviousValid)
+  {
+    const float Identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+    memcpy(Transform, Identity, sizeof(Identity));
+    return;
+  }
+
+  // The poses are the camera link in the ROS world frame, x forward, y left, z up. The optical frame has x right,
+  // y down and z forward, Optical maps its axes into the camera link.
+  const double Optical[3][3] = {{0, 0, 1}, {-1, 0, 0}, {0, -1, 0}};
+  double Current[3][3], Previous[3][3];
+  ToMatrix(Rotation, Current);
+  ToMatrix(PreviousRotation, Previous);
+  const double Delta[3] = {(double)Translation.X - PreviousTranslation.X, (double)Translation.Y - PreviousTranslation.Y, (double)Translation.Z - PreviousTranslation.Z};
+
+  // Relative pose in the camera link of the previous frame: Previous^T * Current and Previous^T * Delta
+  double Relative[3][3], Offset[3];
+  for(int32 i = 0; i < 3; ++i)
+  {
+    Offset[i] = 0;
+    for(int32 j = 0; j < 3; ++j)
+    {
+      Relative[i][j] = 0;
+      for(int32 k = 0; k < 3; ++k)
+      {
+        Relative[i][j] += Previous[k][i] * Current[k][j];
+      }
+      Offset[i] += Previous[j][i] * Delta[j];
+    }
+  }
+
+  // Same transformation between the optical frames: Optical^T * Relative * Optical and Optical^T * Offset
+  for(int32 i = 0; i < 3; ++i)
+  {
+    double Translated = 0;
+    for(int32 j = 0; j < 3; ++j)
+    {
+      double Rotated = 0;
+      for(int32 k = 0; k < 3; ++k)
+      {
+        for(int32 l = 0; l < 3; ++l)
+        {
+          Rotated += Optical[k][i] * Relative[k][l] * Optical[l][j];
+        }
+      }
+      Transform[i * 4 + j] = (float)Rotated;
+      Translated += Optical[j][i] * Offset[j];
+    }
+    Transform[i * 4 + 3] = (float)Translated;
+  }
+}
+
+void GeometryStreams::Compute(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth, const uint8 *DepthData,
+                              const PacketFormat::StreamDescriptor *Normals, uint8 *NormalsData, const PacketFormat::StreamDescriptor *Flow, uint8 *FlowData)
+{
+  if(Depth.Width != Width || Depth.Height != Height || (Depth.Encoding != PacketFormat::EncodingF16 && Depth.Encoding != PacketFormat::EncodingF32))
+  {
+    return;
+  }
+
+  const float *Depths = ToMeters(Depth, DepthData);
+  float Transform[12];
+  ToPrevious(Header.Translation, Header.Rotation, Transform);
+
+  const float Focal = FocalLength;
+  const float InvFocal = 1.0 / FocalLength;
+  const float X = -CenterX / FocalLength;
+  const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+  // Bands of rows are distributed over the task graph, the normals of a band also read the rows next to it
+  const int32 Tiles = (Height + TileRows - 1) / TileRows;
+  ParallelFor(Tiles, [&](int32 Tile)
+  {
+    const uint32 FirstRow = Tile * TileRows;
+    const uint32 LastRow = FMath::Min(FirstRow + TileRows, Height);
+    for(uint32 Row = FirstRow; Row < LastRow; ++Row)
+    {
+      const float Y = (Row - CenterY) / FocalLength;
+      if(Normals)
+      {
+        float *Out = reinterpret_cast<float *>(NormalsData + Row * Normals->Stride);
+        if(Row == 0 || Row + 1 == Height)
+        {
+          std::fill(Out, Out + Width * 3, NaN);
+        }
+        else
+        {
+          ConversionKernels::DepthToNormals(Depths + (Row - 1) * Width, Depths + Row * Width, Depths + (Row + 1) * Width, Out, Width, X, InvFocal, Y);
+        }
+      }
+      if(Flow)
+      {
+        ConversionKernels::DepthToFlow(Depths + Row * Width, reinterpret_cast<float *>(FlowData + Row * Flow->Stride), Width, X, InvFocal, Y, Focal, Transform);
+      }
+    }
+  });
+
+  PreviousTranslation = Header.Translation;
+  PreviousRotation = Header.Rotation;
+  PreviousValid = true;
+}
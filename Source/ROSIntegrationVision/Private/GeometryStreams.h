@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "AlignedAllocator.h"
+#include "PacketFormat.h"
+
+/**
+ * Computes auxiliary streams from the depth of a packet: surface normals from the depth of neighbouring pixels and
+ * the image motion since the previous packet from the camera poses of both packets, assuming a static scene. The
+ * depth is converted to meters once, then bands of rows are distributed over the task graph and processed by the
+ * SIMD kernels of ConversionKernels.
+ */
+class ROSINTEGRATIONVISION_API GeometryStreams
+{
+private:
+  // Rows processed per task
+  static const uint32 TileRows = 32;
+
+  const uint32 Width, Height;
+  const double FocalLength, CenterX, CenterY;
+  // Depth of the packet in meters
+  AlignedBytes Meters;
+  // Camera pose of the previous packet
+  PacketFormat::Vector PreviousTranslation;
+  PacketFormat::Quaternion PreviousRotation;
+  bool PreviousValid;
+
+  // Converts the depth to meters, returns the depth stream itself if it already is in meters
+  const float *ToMeters(const PacketFormat::StreamDescriptor &Depth, const uint8 *Data);
+
+  // Computes the transformation (3x4, row major) from the optical frame of the given pose into the one of the previous pose
+  void ToPrevious(const PacketFormat::Vector &Translation, const PacketFormat::Quaternion &Rotation, float Transform[12]) const;
+
+public:
+  // Images with the given size, focal length and principal point in pixels
+  GeometryStreams(const uint32 Width, const uint32 Height, const double FocalLength, const double CenterX, const double CenterY);
+
+  // Computes the normals (F32C3) and flow (F32C2) streams of a packet from its depth stream, either of them can be
+  // nullptr. Packets have to be passed in order, the pose of the header is kept for the flow of the next packet.
+  void Compute(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth, const uint8 *DepthData,
+               const PacketFormat::StreamDescriptor *Normals, uint8 *NormalsData, const PacketFormat::StreamDescriptor *Flow, uint8 *FlowData);
+};
@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LensDistortion.h"
+
+#include <cmath>
+#include <limits>
+
+#include "Async/ParallelFor.h"
+
+LensDistortion::LensDistortion(const uint32 _Width, const uint32 _Height, const double FocalLength, const double CenterX, const double CenterY, const Coefficients &Distortion) :
+  Width(FMath::Min<uint32>(_Width, 65535)), Height(FMath::Min<uint32>(_Height, 65535)), Table((size_t)Width * Height)
+{
+  const double Scale = 1 << FractionBits;
+
+  for(uint32 V = 0; V < Height; ++V)
+  {
+    for(uint32 U = 0; U < Width; ++U)
+    {
+      // Normalized coordinates of the distorted pixel
+      const double DistortedX = (U - CenterX) / FocalLength;
+      const double DistortedY = (V - CenterY) / FocalLength;
+
+      // The distortion model has no closed form inverse, the undistorted position is found by fixed-point iteration
+      double X = DistortedX, Y = DistortedY;
+      for(uint32 Iteration = 0; Iteration < 20; ++Iteration)
+      {
+        const double R2 = X * X + Y * Y;
+        const double Radial = 1 + Distortion.K1 * R2 + Distortion.K2 * R2 * R2 + Distortion.K3 * R2 * R2 * R2;
+        const double DeltaX = 2 * Distortion.P1 * X * Y + Distortion.P2 * (R2 + 2 * X * X);
+        const double DeltaY = Distortion.P1 * (R2 + 2 * Y * Y) + 2 * Distortion.P2 * X * Y;
+        X = (DistortedX - DeltaX) / Radial;
+        Y = (DistortedY - DeltaY) / Radial;
+      }
+
+      // Position in the pinhole image
+      const double SourceX = X * FocalLength + CenterX;
+      const double SourceY = Y * FocalLength + CenterY;
+
+      RemapEntry &Entry = Table[(size_t)V * Width + U];
+      memset(&Entry, 0, sizeof(Entry));
+      if(!(SourceX >= 0 && SourceY >= 0 && SourceX <= Width - 1 && SourceY <= Height - 1))
+      {
+        continue;
+      }
+
+      const int32 FixedX = FMath::Min<int32>((int32)std::lround(SourceX * Scale), (Width - 1) << FractionBits);
+      const int32 FixedY = FMath::Min<int32>((int32)std::lround(SourceY * Scale), (Height - 1) << FractionBits);
+      const uint32 IntX = FixedX >> FractionBits;
+      const uint32 IntY = FixedY >> FractionBits;
+      Entry.X = IntX;
+      Entry.Y = IntY;
+      Entry.Valid = 1;
+      // The last column and row have no neighbour to interpolate with
+      Entry.FracX = IntX + 1 < Width ? FixedX & ((1 << FractionBits) - 1) : 0;
+      Entry.FracY = IntY + 1 < Height ? FixedY & ((1 << FractionBits) - 1) : 0;
+    }
+  }
+}
+
+bool LensDistortion::IsEnabled(const Coefficients &Distortion)
+{
+  return Distortion.K1 != 0 || Distortion.K2 != 0 || Distortion.P1 != 0 || Distortion.P2 != 0 || Distortion.K3 != 0;
+}
+
+void LensDistortion::Apply(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, AlignedBytes &Scratch) const
+{
+  if(Stream.Width != Width || Stream.Height != Height)
+  {
+    return;
+  }
+
+  const uint32 Bytes = PacketFormat::BytesPerPixel(Stream.Encoding);
+  const uint32 Stride = Width * Bytes;
+  Scratch.resize(Stride * Height);
+  for(uint32 Row = 0; Row < Height; ++Row)
+  {
+    memcpy(&Scratch[Row * Stride], Data + Row * Stream.Stride, Stride);
+  }
+
+  // Invalid depth, normals and flow are NaN, everything else is black
+  uint8 Invalid[12] = {0};
+  if(Stream.Encoding == PacketFormat::EncodingF16 && Stream.Type == PacketFormat::StreamDepth)
+  {
+    const uint16 HalfNaN = 0x7E00;
+    memcpy(Invalid, &HalfNaN, sizeof(HalfNaN));
+  }
+  else if(Stream.Encoding == PacketFormat::EncodingF32 || Stream.Encoding == PacketFormat::EncodingF32C2 || Stream.Encoding == PacketFormat::EncodingF32C3)
+  {
+    const float FloatNaN = std::numeric_limits<float>::quiet_NaN();
+    for(uint32 i = 0; i < Bytes; i += sizeof(FloatNaN))
+    {
+      memcpy(Invalid + i, &FloatNaN, sizeof(FloatNaN));
+    }
+  }
+
+  // Bands of rows are distributed over the task graph, each band reads and writes contiguous memory
+  const bool Interpolate = Stream.Type == PacketFormat::StreamColor && (Stream.Encoding == PacketFormat::EncodingBGR8 || Stream.Encoding == PacketFormat::EncodingBGRA8);
+  const int32 Tiles = (Height + TileRows - 1) / TileRows;
+  ParallelFor(Tiles, [&](int32 Tile)
+  {
+    const uint32 FirstRow = Tile * TileRows;
+    const uint32 LastRow = FMath::Min(FirstRow + TileRows, Height);
+    if(Interpolate)
+    {
+      RemapBilinear(Scratch.data(), Stride, Data, Stream.Stride, Bytes, FirstRow, LastRow);
+    }
+    else
+    {
+      RemapNearest(Scratch.data(), Stride, Data, Stream.Stride, Bytes, Invalid, FirstRow, LastRow);
+    }
+  });
+}
+
+void LensDistortion::RemapBilinear(const uint8 *In, const uint32 StrideIn, uint8 *Out, const uint32 StrideOut, const uint32 Channels, const uint32 FirstRow, const uint32 LastRow) const
+{
+  const uint32 One = 1 << FractionBits;
+  const uint32 Round = 1 << (2 * FractionBits - 1);
+
+  for(uint32 V = FirstRow; V < LastRow; ++V)
+  {
+    const RemapEntry *Entry = &Table[V * Width];
+    uint8 *Target = Out + V * StrideOut;
+    for(uint32 U = 0; U < Width; ++U, ++Entry, Target += Channels)
+    {
+      if(!Entry->Valid)
+      {
+        memset(Target, 0, Channels);
+        continue;
+      }
+
+      // Fixed-point weights of the four neighbours, they add up to One * One
+      const uint32 W00 = (One - Entry->FracX) * (One - Entry->FracY);
+      const uint32 W01 = Entry->FracX * (One - Entry->FracY);
+      const uint32 W10 = (One - Entry->FracX) * Entry->FracY;
+      const uint32 W11 = Entry->FracX * Entry->FracY;
+
+      const uint8 *P00 = In + Entry->Y * StrideIn + Entry->X * Channels;
+      const uint8 *P01 = W01 | W11 ? P00 + Channels : P00;
+      const uint8 *P10 = W10 | W11 ? P00 + StrideIn : P00;
+      const uint8 *P11 = W11 ? P10 + Channels : P10;
+
+      for(uint32 C = 0; C < Channels; ++C)
+      {
+        Target[C] = (uint8)((P00[C] * W00 + P01[C] * W01 + P10[C] * W10 + P11[C] * W11 + Round) >> (2 * FractionBits));
+      }
+    }
+  }
+}
+
+void LensDistortion::RemapNearest(const uint8 *In, const uint32 StrideIn, uint8 *Out, const uint32 StrideOut, const uint32 Bytes, const uint8 *Invalid, const uint32 FirstRow, const uint32 LastRow) const
+{
+  const uint32 Half = 1 << (FractionBits - 1);
+
+  for(uint32 V = FirstRow; V < LastRow; ++V)
+  {
+    const RemapEntry *Entry = &Table[V * Width];
+    uint8 *Target = Out + V * StrideOut;
+    for(uint32 U = 0; U < Width; ++U, ++Entry, Target += Bytes)
+    {
+      if(!Entry->Valid)
+      {
+        memcpy(Target, Invalid, Bytes);
+        continue;
+      }
+
+      const uint32 X = Entry->X + (Entry->FracX >= Half ? 1 : 0);
+      const uint32 Y = Entry->Y + (Entry->FracY >= Half ? 1 : 0);
+      memcpy(Target, In + Y * StrideIn + X * Bytes, Bytes);
+    }
+  }
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "PacketFormat.h"
+
+/**
+ * Distorts the rendered pinhole images with the Brown-Conrady (plumb_bob) model used by ROS. For every pixel of
+ * the distorted image the position in the pinhole image is precomputed once per configuration and stored as a
+ * fixed-point remap table. Color is interpolated bilinearly, all other streams use the nearest pixel, so that
+ * no depth values or object colors are mixed.
+ */
+class ROSINTEGRATIONVISION_API LensDistortion
+{
+public:
+  struct Coefficients
+  {
+    float K1, K2, P1, P2, K3; // Order of CameraInfo.D
+  };
+
+private:
+  // Fractional bits of the remap positions
+  static const uint32 FractionBits = 8;
+  // Rows processed per task
+  static const uint32 TileRows = 32;
+
+  struct RemapEntry
+  {
+    uint16 X; // Column of the top left source pixel
+    uint16 Y; // Row of the top left source pixel
+    uint8 FracX; // Fractional position between the source pixel and its right neighbour
+    uint8 FracY; // Fractional position between the source pixel and the one below
+    uint8 Valid; // 0 if the pixel is outside of the pinhole image
+    uint8 Reserved;
+  };
+
+  const uint32 Width, Height;
+  std::vector<RemapEntry> Table;
+
+  void RemapBilinear(const uint8 *In, const uint32 StrideIn, uint8 *Out, const uint32 StrideOut, const uint32 Channels, const uint32 FirstRow, const uint32 LastRow) const;
+  void RemapNearest(const uint8 *In, const uint32 StrideIn, uint8 *Out, const uint32 StrideOut, const uint32 Bytes, const uint8 *Invalid, const uint32 FirstRow, const uint32 LastRow) const;
+
+public:
+  // Computes the remap table for images with the given size, focal length and principal point in pixels. The size is
+  // limited to 65535 pixels per side by the remap table, streams of other sizes are not distorted.
+  LensDistortion(const uint32 _Width, const uint32 _Height, const double FocalLength, const double CenterX, const double CenterY, const Coefficients &Distortion);
+
+  // Returns true if any of the coefficients is not 0
+  static bool IsEnabled(const Coefficients &Distortion);
+
+  // Distorts a stream of a packet in place, Scratch is used for a copy of the pinhole image
+  void Apply(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, AlignedBytes &Scratch) const;
+};
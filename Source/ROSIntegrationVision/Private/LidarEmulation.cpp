@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LidarEmulation.h"
+
+#include <cmath>
+#include <limits>
+
+#include "ConversionKernels.h"
+
+LidarEmulation::LidarEmulation(const Settings &Config) :
+  Config(Config), Width(0), Height(0), Stride(0), Encoding(0), FieldOfViewX(0), FieldOfViewY(0)
+{
+  const uint32 Rings = Config.Rings, Columns = Config.Columns;
+  Directions.resize(Rings * Columns * 3);
+  for(uint32 Ring = 0; Ring < Rings; ++Ring)
+  {
+    const double Elevation = FMath::DegreesToRadians(Rings > 1 ? Config.MinElevation + (Config.MaxElevation - Config.MinElevation) * Ring / (Rings - 1.0) : Config.MinElevation);
+    for(uint32 Column = 0; Column < Columns; ++Column)
+    {
+      const double Azimuth = FMath::DegreesToRadians(Columns > 1 ? Config.MinAzimuth + (Config.MaxAzimuth - Config.MinAzimuth) * Column / (Columns - 1.0) : Config.MinAzimuth);
+      float *Direction = &Directions[(Ring * Columns + Column) * 3];
+      Direction[0] = std::cos(Elevation) * std::cos(Azimuth);
+      Direction[1] = std::cos(Elevation) * std::sin(Azimuth);
+      Direction[2] = std::sin(Elevation);
+    }
+  }
+}
+
+const LidarEmulation::Settings &LidarEmulation::GetSettings() const
+{
+  return Config;
+}
+
+uint32 LidarEmulation::GetBeamCount() const
+{
+  return Config.Rings * Config.Columns;
+}
+
+void LidarEmulation::Build(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth)
+{
+  Width = Depth.Width;
+  Height = Depth.Height;
+  Stride = Depth.Stride;
+  Encoding = Depth.Encoding;
+  FieldOfViewX = Header.FieldOfViewX;
+  FieldOfViewY = Header.FieldOfViewY;
+
+  const uint32 Count = GetBeamCount();
+  const uint32 Pitch = Stride / PacketFormat::BytesPerPixel((PacketFormat::StreamEncoding)Encoding);
+  Index.assign(Count, 0);
+  Factor.assign(Count, std::numeric_limits<float>::quiet_NaN());
+
+  // Panoramas have the forward direction in the center with the longitude increasing to the right, like the camera
+  // info. Their depth already is the range along the ray.
+  const bool Panoramic = FieldOfViewX >= 360.0f;
+  const bool Equirectangular = Panoramic && FieldOfViewY >= 180.0f;
+  const double Focal = Width / 2.0 / std::tan(FieldOfViewX * PI / 360.0);
+  const double FocalY = Height / 2.0 / std::tan(FieldOfViewY * PI / 360.0);
+
+  for(uint32 i = 0; i < Count; ++i)
+  {
+    const float *Direction = &Directions[i * 3];
+    int64 Column, Row;
+    double Range = 1;
+    if(Panoramic)
+    {
+      const double Longitude = -std::atan2(Direction[1], Direction[0]);
+      const double Latitude = std::asin(Direction[2]);
+      Column = std::lround(Width / 2.0 + Longitude * Width / (2 * PI));
+      Column = (Column % Width + Width) % Width;
+      Row = std::lround(Height / 2.0 - (Equirectangular ? Latitude * Height / PI : std::tan(Latitude) * FocalY));
+    }
+    else
+    {
+      // Beams behind the camera are not in the image
+      if(Direction[0] <= 0)
+      {
+        continue;
+      }
+      // The optical frame has x right, y down and z forward
+      Column = std::lround(Width / 2.0 - Focal * Direction[1] / Direction[0]);
+      Row = std::lround(Height / 2.0 - Focal * Direction[2] / Direction[0]);
+      // The depth is the planar depth of the nearest pixel, scaled by the length of its ray
+      const double A = (Column - Width / 2.0) / Focal;
+      const double B = (Row - Height / 2.0) / Focal;
+      Range = std::sqrt(1 + A * A + B * B);
+    }
+
+    if(Column < 0 || Row < 0 || Column >= Width || Row >= Height)
+    {
+      continue;
+    }
+    Index[i] = Row * Pitch + Column;
+    Factor[i] = Range;
+  }
+}
+
+void LidarEmulation::Sample(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth, const uint8 *DepthData, float *Ranges)
+{
+  const uint32 Count = GetBeamCount();
+  if(Depth.Encoding != PacketFormat::EncodingF16 && Depth.Encoding != PacketFormat::EncodingF32)
+  {
+    std::fill(Ranges, Ranges + Count, std::numeric_limits<float>::quiet_NaN());
+    return;
+  }
+
+  if(Depth.Width != Width || Depth.Height != Height || Depth.Stride != Stride || Depth.Encoding != Encoding
+     || Header.FieldOfViewX != FieldOfViewX || Header.FieldOfViewY != FieldOfViewY)
+  {
+    Build(Header, Depth);
+  }
+
+  if(Depth.Encoding == PacketFormat::EncodingF16)
+  {
+    ConversionKernels::GatherHalfRanges(reinterpret_cast<const uint16 *>(DepthData), Index.data(), Factor.data(), Ranges, Count, Depth.Scale, Config.MinRange, Config.MaxRange);
+  }
+  else
+  {
+    ConversionKernels::GatherFloatRanges(reinterpret_cast<const float *>(DepthData), Index.data(), Factor.data(), Ranges, Count, Depth.Scale, Config.MinRange, Config.MaxRange);
+  }
+}
+
+void LidarEmulation::ToPoints(const float *Ranges, Point *Points) const
+{
+  const float NaN = std::numeric_limits<float>::quiet_NaN();
+  const float TimeStep = Config.ScanTime / Config.Columns;
+  for(uint32 Ring = 0; Ring < Config.Rings; ++Ring)
+  {
+    for(uint32 Column = 0; Column < Config.Columns; ++Column)
+    {
+      const uint32 i = Ring * Config.Columns + Column;
+      const float Range = Ranges[i];
+      // Comparisons with NaN are false, so -Inf, +Inf and NaN are invalid
+      const bool Valid = Range >= Config.MinRange && Range <= Config.MaxRange;
+      Point &Out = Points[i];
+      Out.X = Valid ? Range * Directions[i * 3] : NaN;
+      Out.Y = Valid ? Range * Directions[i * 3 + 1] : NaN;
+      Out.Z = Valid ? Range * Directions[i * 3 + 2] : NaN;
+      Out.Ring = Ring;
+      Out.Reserved = 0;
+      Out.Time = Column * TimeStep;
+    }
+  }
+}
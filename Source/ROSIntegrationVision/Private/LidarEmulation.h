@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "PacketFormat.h"
+
+/**
+ * Emulates a lidar by sampling the depth image of the camera along the beams of the lidar instead of casting rays
+ * into the scene. For every beam the nearest pixel and the factor that turns its depth into the range along its ray
+ * are precomputed once per image configuration, so a scan is a single gather over the depth stream by the SIMD
+ * kernels of ConversionKernels. Pinhole images and panoramas are supported, beams outside of the image are NaN.
+ */
+class ROSINTEGRATIONVISION_API LidarEmulation
+{
+public:
+  struct Settings
+  {
+    uint32 Rings, Columns; // Number of beams vertically and horizontally
+    float MinAzimuth, MaxAzimuth; // Horizontal angles in degrees of the first and last column, counter-clockwise from forward like LaserScan
+    float MinElevation, MaxElevation; // Vertical angles in degrees of the first and last ring, upwards from forward
+    float MinRange, MaxRange; // Ranges in meters outside of these are -Inf and +Inf
+    float ScanTime; // Duration of a sweep in seconds, spread over the columns in the time of the points
+  };
+
+  // Points of the published clouds, in the camera link frame (x forward, y left, z up)
+  struct Point
+  {
+    float X, Y, Z;
+    uint16 Ring;
+    uint16 Reserved;
+    float Time; // Seconds since the stamp of the scan
+  };
+
+private:
+  const Settings Config;
+  // Unit direction of every beam, ring after ring
+  std::vector<float> Directions;
+  // Element offset of the nearest pixel and range per unit of depth of every beam, for the configuration below
+  std::vector<uint32> Index;
+  std::vector<float> Factor;
+  uint32 Width, Height, Stride, Encoding;
+  float FieldOfViewX, FieldOfViewY;
+
+  // Computes the nearest pixels and factors for the image of a packet
+  void Build(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth);
+
+public:
+  LidarEmulation(const Settings &Config);
+
+  const Settings &GetSettings() const;
+
+  uint32 GetBeamCount() const;
+
+  // Samples the ranges of all beams in meters from the depth stream of a packet, ring after ring. The table is
+  // computed again if the size or the field of view of the images changed.
+  void Sample(const PacketFormat::PacketHeader &Header, const PacketFormat::StreamDescriptor &Depth, const uint8 *DepthData, float *Ranges);
+
+  // Converts the ranges of a scan into points, beams without a range within the limits are NaN
+  void ToPoints(const float *Ranges, Point *Points) const;
+};
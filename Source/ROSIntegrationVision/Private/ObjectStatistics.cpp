@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ObjectStatistics.h"
+
+#include "Async/ParallelFor.h"
+
+const uint32 ObjectStatistics::Empty;
+
+ObjectStatistics::ObjectStatistics() :
+  Mask(0), Objects(0)
+{
+  Keys.assign(1, Empty);
+  Ids.assign(1, Empty);
+}
+
+void ObjectStatistics::SetMap(const PacketFormat::MapEntry *First, const uint32 Count)
+{
+  // At most half of the slots are used, so that lookups of unknown colors end quickly
+  uint32 Size = 1;
+  while(Size < Count * 2)
+  {
+    Size <<= 1;
+  }
+  Keys.assign(Size, Empty);
+  Ids.assign(Size, Empty);
+  Mask = Size - 1;
+  Objects = Count;
+
+  const PacketFormat::MapEntry *Entry = First;
+  for(uint32 Id = 0; Id < Count; ++Id, Entry = PacketFormat::NextMapEntry(Entry))
+  {
+    const uint32 Color = Entry->B | (Entry->G << 8) | (Entry->R << 16);
+    uint32 Slot = (Color * 0x9E3779B1u) >> 8 & Mask;
+    while(Keys[Slot] != Empty && Keys[Slot] != Color)
+    {
+      Slot = (Slot + 1) & Mask;
+    }
+    // Objects sharing a color are reported with the first ID
+    if(Keys[Slot] == Empty)
+    {
+      Keys[Slot] = Color;
+      Ids[Slot] = Id;
+    }
+  }
+}
+
+void ObjectStatistics::ReduceBand(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const uint32 FirstRow, const uint32 LastRow, Partial *Result) const
+{
+  const uint32 Bytes = PacketFormat::BytesPerPixel(Stream.Encoding);
+  for(uint32 Y = FirstRow; Y < LastRow; ++Y)
+  {
+    const uint8 *Pixel = Data + Y * Stream.Stride;
+    // Neighbouring pixels mostly belong to the same object, so the last lookup is cached
+    uint32 LastColor = Empty, LastId = Empty;
+    for(uint32 X = 0; X < Stream.Width; ++X, Pixel += Bytes)
+    {
+      const uint32 Color = Pixel[0] | (Pixel[1] << 8) | (Pixel[2] << 16);
+      if(Color != LastColor)
+      {
+        LastColor = Color;
+        LastId = Lookup(Color);
+      }
+      if(LastId == Empty)
+      {
+        continue;
+      }
+
+      Partial &Object = Result[LastId];
+      if(Object.Count == 0)
+      {
+        Object.MinX = Object.MaxX = X;
+        Object.MinY = Object.MaxY = Y;
+      }
+      else
+      {
+        Object.MinX = FMath::Min(Object.MinX, X);
+        Object.MaxX = FMath::Max(Object.MaxX, X);
+        Object.MaxY = Y;
+      }
+      ++Object.Count;
+      Object.SumX += X;
+      Object.SumY += Y;
+    }
+  }
+}
+
+void ObjectStatistics::Compute(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data)
+{
+  Instances.clear();
+  if(Objects == 0 || (Stream.Encoding != PacketFormat::EncodingBGR8 && Stream.Encoding != PacketFormat::EncodingBGRA8))
+  {
+    return;
+  }
+
+  // Every band reduces into its own partial results, rows are processed top down so MinY is set by the first pixel
+  const uint32 Bands = FMath::Max<uint32>((Stream.Height + BandRows - 1) / BandRows, 1);
+  std::vector<Partial> Partials(Bands * Objects);
+  memset(Partials.data(), 0, Partials.size() * sizeof(Partial));
+
+  ParallelFor(Bands, [&](int32 Band)
+  {
+    const uint32 FirstRow = Band * BandRows;
+    const uint32 LastRow = FMath::Min(FirstRow + BandRows, Stream.Height);
+    ReduceBand(Stream, Data, FirstRow, LastRow, &Partials[Band * Objects]);
+  });
+
+  for(uint32 Id = 0; Id < Objects; ++Id)
+  {
+    Partial Merged = {0, 0, 0, 0, 0, 0, 0};
+    for(uint32 Band = 0; Band < Bands; ++Band)
+    {
+      const Partial &Part = Partials[Band * Objects + Id];
+      if(Part.Count == 0)
+      {
+        continue;
+      }
+      if(Merged.Count == 0)
+      {
+        Merged = Part;
+        continue;
+      }
+      Merged.Count += Part.Count;
+      Merged.MinX = FMath::Min(Merged.MinX, Part.MinX);
+      Merged.MinY = FMath::Min(Merged.MinY, Part.MinY);
+      Merged.MaxX = FMath::Max(Merged.MaxX, Part.MaxX);
+      Merged.MaxY = FMath::Max(Merged.MaxY, Part.MaxY);
+      Merged.SumX += Part.SumX;
+      Merged.SumY += Part.SumY;
+    }
+
+    if(Merged.Count > 0)
+    {
+      Instances.push_back({Id, Merged.Count, Merged.MinX, Merged.MinY, Merged.MaxX, Merged.MaxY,
+                           (float)((double)Merged.SumX / Merged.Count), (float)((double)Merged.SumY / Merged.Count)});
+    }
+  }
+}
+
+const std::vector<ObjectStatistics::Instance> &ObjectStatistics::GetInstances() const
+{
+  return Instances;
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "PacketFormat.h"
+
+/**
+ * Computes bounding boxes, pixel counts and centroids of the objects visible in an object image. Object colors
+ * are mapped to IDs through a hash table built from the map entries of the packet, the ID of an object is the
+ * index of its map entry. Bands of rows are reduced in parallel and merged at the end.
+ */
+class ROSINTEGRATIONVISION_API ObjectStatistics
+{
+public:
+  struct Instance
+  {
+    uint32 Id; // Index of the map entry of the object
+    uint32 Count; // Number of pixels
+    uint32 MinX, MinY, MaxX, MaxY; // Bounding box, inclusive
+    float CentroidX, CentroidY; // Mean position of the pixels
+  };
+
+private:
+  static const uint32 Empty = 0xFFFFFFFF;
+  // Rows reduced per task
+  static const uint32 BandRows = 64;
+
+  struct Partial
+  {
+    uint32 Count;
+    uint32 MinX, MinY, MaxX, MaxY;
+    uint64 SumX, SumY;
+  };
+
+  // Open addressing hash table from packed BGR colors to IDs
+  std::vector<uint32> Keys, Ids;
+  uint32 Mask, Objects;
+  std::vector<Instance> Instances;
+
+  inline uint32 Lookup(const uint32 Color) const
+  {
+    for(uint32 Slot = (Color * 0x9E3779B1u) >> 8 & Mask;; Slot = (Slot + 1) & Mask)
+    {
+      if(Keys[Slot] == Color)
+      {
+        return Ids[Slot];
+      }
+      if(Keys[Slot] == Empty)
+      {
+        return Empty;
+      }
+    }
+  }
+
+  void ReduceBand(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const uint32 FirstRow, const uint32 LastRow, Partial *Result) const;
+
+public:
+  ObjectStatistics();
+
+  // Builds the lookup table from Count map entries starting at First
+  void SetMap(const PacketFormat::MapEntry *First, const uint32 Count);
+
+  // Computes the statistics of all objects visible in an object stream (BGR8 or BGRA8)
+  void Compute(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data);
+
+  // Returns the objects with at least one pixel of the last computation, sorted by ID
+  const std::vector<Instance> &GetInstances() const;
+};
@@ -2,55 +2,212 @@
 
 #include "PacketBuffer.h"
 
-PacketBuffer::PacketBuffer(const uint32 Width, const uint32 Height, const float FieldOfView) :
-  IsDataReadable(false), SizeHeader(sizeof(PacketHeader)), SizeRGB(Width *Height * 3 * sizeof(uint8)), SizeFloat(Width *Height *sizeof(FFloat16)),
-  OffsetColor(SizeHeader), OffsetDepth(OffsetColor + SizeRGB), OffsetObject(OffsetDepth + SizeFloat), OffsetMap(OffsetObject + SizeRGB),
-  Size(SizeHeader + SizeRGB + SizeFloat + SizeRGB)
+std::vector<PacketBuffer::StreamDescriptor> PacketBuffer::Layout(const std::vector<StreamDescriptor> &Streams)
 {
-  ReadBuffer.resize(Size + 1024 * 1024);
-  WriteBuffer.resize(Size + 1024 * 1024);
+  std::vector<StreamDescriptor> Result(Streams);
+  uint32 Offset = sizeof(PacketHeader) + Result.size() * sizeof(StreamDescriptor);
 
+  // Every payload starts aligned, so that SIMD and DMA consumers can read it directly
+  for(StreamDescriptor &Stream : Result)
+  {
+    Offset = PacketFormat::Align(Offset, PacketFormat::PayloadAlignment);
+    Stream.Offset = Offset;
+    Stream.Stride = Stream.Width * PacketFormat::BytesPerPixel(Stream.Encoding);
+    Stream.Size = Stream.Stride * Stream.Height;
+    Offset += Stream.Size;
+  }
+  return Result;
+}
+
+std::vector<PacketBuffer::StreamDescriptor> PacketBuffer::DefaultStreams(const uint32 Width, const uint32 Height)
+{
+  std::vector<StreamDescriptor> Result(3);
+  Result[0] = {PacketFormat::StreamColor, PacketFormat::EncodingBGR8, Width, Height, 0, 0, 0, 1.0f};
+  Result[1] = {PacketFormat::StreamDepth, PacketFormat::EncodingF16, Width, Height, 0, 0, 0, 0.01f};
+  Result[2] = {PacketFormat::StreamObject, PacketFormat::EncodingBGR8, Width, Height, 0, 0, 0, 1.0f};
+  return Result;
+}
+
+std::vector<PacketBuffer::StreamDescriptor> PacketBuffer::GPUStreams(const uint32 Width, const uint32 Height, const float DepthScale)
+{
+  std::vector<StreamDescriptor> Result(3);
+  Result[0] = {PacketFormat::StreamColor, PacketFormat::EncodingBGRA8, Width, Height, 0, 0, 0, 1.0f};
+  Result[1] = {PacketFormat::StreamDepth, PacketFormat::EncodingF32, Width, Height, 0, 0, 0, DepthScale};
+  Result[2] = {PacketFormat::StreamObject, PacketFormat::EncodingBGRA8, Width, Height, 0, 0, 0, 1.0f};
+  return Result;
+}
+
+std::vector<PacketBuffer::StreamDescriptor> PacketBuffer::PanoramaStreams(const uint32 Width, const uint32 Height)
+{
+  std::vector<StreamDescriptor> Result(2);
+  Result[0] = {PacketFormat::StreamColor, PacketFormat::EncodingBGR8, Width, Height, 0, 0, 0, 1.0f};
+  Result[1] = {PacketFormat::StreamDepth, PacketFormat::EncodingF32, Width, Height, 0, 0, 0, 0.01f};
+  return Result;
+}
+
+std::vector<PacketBuffer::StreamDescriptor> PacketBuffer::AuxiliaryStreams(const uint32 Width, const uint32 Height, const bool Normals, const bool Flow)
+{
+  std::vector<StreamDescriptor> Result;
+  if(Normals)
+  {
+    Result.push_back({PacketFormat::StreamNormals, PacketFormat::EncodingF32C3, Width, Height, 0, 0, 0, 1.0f});
+  }
+  if(Flow)
+  {
+    Result.push_back({PacketFormat::StreamFlow, PacketFormat::EncodingF32C2, Width, Height, 0, 0, 0, 1.0f});
+  }
+  return Result;
+}
+
+PacketBuffer::PacketBuffer(const uint32 Width, const uint32 Height, const float FieldOfView, const std::vector<StreamDescriptor> &Streams,
+                           const bool HugePages, const uint32 SlotCount) :
+  Slots(FMath::Max(SlotCount, 1u), AlignedBytes(AlignedAllocator<uint8>(HugePages))), States(Slots.size(), SlotFree),
+  Leases(Slots.size(), 0), WriteSlot(0), WritingSlot(0), ReadSlot(0), LastSlot(0), ReadingSlot(0), Rereading(false), Released(false), Streams(Layout(Streams)),
+  SizeHeader(sizeof(PacketHeader) + Streams.size() * sizeof(StreamDescriptor)),
+  OffsetMap(PacketFormat::Align(this->Streams.empty() ? SizeHeader : this->Streams.back().Offset + this->Streams.back().Size, PacketFormat::MapAlignment)),
+  Size(OffsetMap)
+{
   // Create relative FOV for each axis
   const float FOVX = Height > Width ? FieldOfView * Width / Height : FieldOfView;
   const float FOVY = Width > Height ? FieldOfView * Height / Width : FieldOfView;
 
-  // Setting header information that do not change
-  HeaderRead = reinterpret_cast<PacketHeader *>(&ReadBuffer[0]);
-  HeaderRead->Size = Size;
-  HeaderRead->SizeHeader = SizeHeader;
-  HeaderRead->Width = Width;
-  HeaderRead->Height = Height;
-  HeaderRead->FieldOfViewX = FOVX;
-  HeaderRead->FieldOfViewY = FOVY;
-  HeaderWrite = reinterpret_cast<PacketHeader *>(&WriteBuffer[0]);
-  HeaderWrite->Size = Size;
-  HeaderWrite->SizeHeader = SizeHeader;
-  HeaderWrite->Width = Width;
-  HeaderWrite->Height = Height;
-  HeaderWrite->FieldOfViewX = FOVX;
-  HeaderWrite->FieldOfViewY = FOVY;
+  // Setting header information and stream descriptors that do not change
+  for(AlignedBytes &Buffer : Slots)
+  {
+    Buffer.resize(Size + 1024 * 1024);
+
+    // Only the header and the padding between the streams are cleared here, the payloads are left untouched
+    memset(&Buffer[0], 0, SizeHeader);
+    uint32 End = SizeHeader;
+    for(const StreamDescriptor &Stream : this->Streams)
+    {
+      memset(&Buffer[End], 0, Stream.Offset - End);
+      End = Stream.Offset + Stream.Size;
+    }
+    memset(&Buffer[End], 0, OffsetMap - End);
+
+    PacketHeader *Header = reinterpret_cast<PacketHeader *>(&Buffer[0]);
+    Header->Magic = PacketFormat::Magic;
+    Header->Version = PacketFormat::Version;
+    Header->Size = Size;
+    Header->SizeHeader = SizeHeader;
+    Header->StreamCount = this->Streams.size();
+    Header->MapEntries = 0;
+    Header->OffsetMap = OffsetMap;
+    Header->Width = Width;
+    Header->Height = Height;
+    Header->FieldOfViewX = FOVX;
+    Header->FieldOfViewY = FOVY;
+    if(!this->Streams.empty())
+    {
+      memcpy(&Buffer[sizeof(PacketHeader)], &this->Streams[0], this->Streams.size() * sizeof(StreamDescriptor));
+    }
+  }
 
   // Setting the pointers to the data
-  Color = &WriteBuffer[OffsetColor];
-  Depth = &WriteBuffer[OffsetDepth];
-  Object = &WriteBuffer[OffsetObject];
-  Map = &WriteBuffer[OffsetMap];
-  Read = &ReadBuffer[0];
+  UpdateWritePointers();
+  UpdateReadPointers(0);
+}
+
+void PacketBuffer::UpdateWritePointers()
+{
+  const int32 StreamColor = FindStream(PacketFormat::StreamColor);
+  const int32 StreamDepth = FindStream(PacketFormat::StreamDepth);
+  const int32 StreamObject = FindStream(PacketFormat::StreamObject);
+  AlignedBytes &Buffer = Slots[WritingSlot];
+
+  Color = StreamColor < 0 ? nullptr : &Buffer[Streams[StreamColor].Offset];
+  Depth = StreamDepth < 0 ? nullptr : &Buffer[Streams[StreamDepth].Offset];
+  Object = StreamObject < 0 ? nullptr : &Buffer[Streams[StreamObject].Offset];
+  Map = &Buffer[OffsetMap];
+  HeaderWrite = reinterpret_cast<PacketHeader *>(&Buffer[0]);
+}
 
-  IsDataReadable = false;
+void PacketBuffer::UpdateReadPointers(const uint32 Slot)
+{
+  ReadingSlot = Slot;
+  Read = &Slots[Slot][0];
+  HeaderRead = reinterpret_cast<PacketHeader *>(Read);
+}
+
+int32 PacketBuffer::FindStream(const uint32 Type) const
+{
+  for(size_t i = 0; i < Streams.size(); ++i)
+  {
+    if(Streams[i].Type == Type)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint8 *PacketBuffer::GetWriteStream(const int32 Stream)
+{
+  return &Slots[WritingSlot][Streams[Stream].Offset];
+}
+
+uint8 *PacketBuffer::GetWriteStream(const uint32 Slot, const int32 Stream)
+{
+  return &Slots[Slot][Streams[Stream].Offset];
+}
+
+PacketBuffer::PacketHeader *PacketBuffer::GetWriteHeader(const uint32 Slot)
+{
+  return reinterpret_cast<PacketHeader *>(&Slots[Slot][0]);
+}
+
+uint32 PacketBuffer::GetWriteSlot() const
+{
+  return WritingSlot;
 }
 
-void PacketBuffer::StartWriting(const TMap<FString, uint32> &ObjectToColor, const TArray<FColor> &ObjectColors)
+uint32 PacketBuffer::GetReadSlot() const
 {
+  return ReadingSlot;
+}
+
+uint32 PacketBuffer::GetSlotCount() const
+{
+  return Slots.size();
+}
+
+void PacketBuffer::SetFieldOfView(const float FieldOfViewX, const float FieldOfViewY)
+{
+  for(AlignedBytes &Buffer : Slots)
+  {
+    PacketHeader *Header = reinterpret_cast<PacketHeader *>(&Buffer[0]);
+    Header->FieldOfViewX = FieldOfViewX;
+    Header->FieldOfViewY = FieldOfViewY;
+  }
+}
+
+bool PacketBuffer::StartWriting(const TMap<FString, uint32> &ObjectToColor, const TArray<FColor> &ObjectColors)
+{
+  // Waits until the packet previously written in this slot was read, then claims it so that the next packet can be
+  // started while this one is still written
+  {
+    std::unique_lock<std::mutex> WaitLock(Lock);
+    CVWait.wait(WaitLock, [this] {return States[WriteSlot] == SlotFree || Released; });
+    if(Released)
+    {
+      return false;
+    }
+    States[WriteSlot] = SlotWriting;
+    WritingSlot = WriteSlot;
+    WriteSlot = (WriteSlot + 1) % Slots.size();
+  }
+  UpdateWritePointers();
+  AlignedBytes &WriteBuffer = Slots[WritingSlot];
+
   uint32_t Count = 0;
   uint32_t MapSize = 0;
-  uint8_t *It = Map;
 
   // Writing the obejct color map entries to the end of the packet
   for(auto &Elem : ObjectToColor)
   {
     const uint32_t NameSize = Elem.Key.Len();
-    const uint32_t ElemSize = sizeof(uint32_t) + 3 * sizeof(uint8_t) + NameSize;
+    const uint32_t ElemSize = (uint32_t)PacketFormat::MapEntrySize(NameSize);
     const FColor &ObjectColor = ObjectColors[Elem.Value];
 
     // Resize the internal buffer if necessary
@@ -58,66 +215,127 @@ void PacketBuffer::StartWriting(const TMap<FString, uint32> &ObjectToColor, cons
     {
       WriteBuffer.resize(WriteBuffer.size() + 1024 * 1024);
       // Update pointers
-      Color = &WriteBuffer[OffsetColor];
-      Depth = &WriteBuffer[OffsetDepth];
-      Object = &WriteBuffer[OffsetObject];
-      Map = &WriteBuffer[OffsetMap];
-      HeaderWrite = reinterpret_cast<PacketHeader *>(&WriteBuffer[0]);
+      UpdateWritePointers();
     }
 
-    MapEntry *Entry = reinterpret_cast<MapEntry*>(It);
+    MapEntry *Entry = reinterpret_cast<MapEntry*>(Map + MapSize);
     Entry->Size = ElemSize;
+    Entry->NameLength = NameSize;
 
     Entry->R = ObjectColor.R;
     Entry->G = ObjectColor.G;
     Entry->B = ObjectColor.B;
+    Entry->Reserved = 0;
 
-    // Convert name to ANSI and copy it to the packet (no trailing '\0', length is indirectly given by the entry size)
+    // Convert name to ANSI and copy it to the packet (no trailing '\0', length is given by NameLength)
     const char *Name = TCHAR_TO_ANSI(*Elem.Key);
     memcpy(&Entry->FirstChar, Name, NameSize);
 
-    It += ElemSize;
     MapSize += ElemSize;
     ++Count;
   }
   HeaderWrite->MapEntries = Count;
   HeaderWrite->Size = Size + MapSize;
+  return true;
 }
 
-void PacketBuffer::DoneWriting()
+void PacketBuffer::DoneWriting(const uint32 Slot)
 {
-  // Swapping buffers
-  LockBuffer.lock();
-  IsDataReadable = true;
-  WriteBuffer.swap(ReadBuffer);
-  Color = &WriteBuffer[OffsetColor];
-  Depth = &WriteBuffer[OffsetDepth];
-  Object = &WriteBuffer[OffsetObject];
-  Map = &WriteBuffer[OffsetMap];
-  Read = &ReadBuffer[0];
-  HeaderRead = reinterpret_cast<PacketHeader *>(&ReadBuffer[0]);
-  HeaderWrite = reinterpret_cast<PacketHeader *>(&WriteBuffer[0]);
-  LockBuffer.unlock();
-  CVWait.notify_one();
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    States[Slot] = SlotReady;
+  }
+  CVWait.notify_all();
 }
 
-void PacketBuffer::StartReading()
+bool PacketBuffer::StartReading()
 {
   // Waits until writing is done
-  std::unique_lock<std::mutex> WaitLock(LockRead);
-  CVWait.wait(WaitLock, [this] {return IsDataReadable; });
+  std::unique_lock<std::mutex> WaitLock(Lock);
+  CVWait.wait(WaitLock, [this] {return States[ReadSlot] == SlotReady || Released; });
+  if(States[ReadSlot] != SlotReady)
+  {
+    return false;
+  }
+  States[ReadSlot] = SlotReading;
+  UpdateReadPointers(ReadSlot);
+  return true;
+}
 
-  LockBuffer.lock();
+bool PacketBuffer::TryStartReading()
+{
+  std::lock_guard<std::mutex> Guard(Lock);
+  if(States[ReadSlot] != SlotReady)
+  {
+    return false;
+  }
+  States[ReadSlot] = SlotReading;
+  UpdateReadPointers(ReadSlot);
+  return true;
+}
+
+void PacketBuffer::RestartReading()
+{
+  std::lock_guard<std::mutex> Guard(Lock);
+  States[LastSlot] = SlotReading;
+  Rereading = true;
+  UpdateReadPointers(LastSlot);
 }
 
 void PacketBuffer::DoneReading()
 {
-  IsDataReadable = false;
-  LockBuffer.unlock();
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    States[ReadingSlot] = Leases[ReadingSlot] > 0 ? SlotLeased : SlotFree;
+    if(Rereading)
+    {
+      Rereading = false;
+    }
+    else
+    {
+      LastSlot = ReadSlot;
+      ReadSlot = (ReadSlot + 1) % Slots.size();
+    }
+  }
+  CVWait.notify_all();
+}
+
+TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe> PacketBuffer::LeaseRead()
+{
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ++Leases[ReadingSlot];
+  }
+  return TSharedPtr<Lease, ESPMode::ThreadSafe>(new Lease(*this, ReadingSlot));
+}
+
+void PacketBuffer::ReleaseLease(const uint32 Slot)
+{
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if(--Leases[Slot] == 0 && States[Slot] == SlotLeased)
+    {
+      States[Slot] = SlotFree;
+    }
+  }
+  CVWait.notify_all();
+}
+
+PacketBuffer::Lease::Lease(PacketBuffer &Buffer, const uint32 Slot) :
+  Buffer(Buffer), Slot(Slot)
+{
+}
+
+PacketBuffer::Lease::~Lease()
+{
+  Buffer.ReleaseLease(Slot);
 }
 
 void PacketBuffer::Release()
 {
-  IsDataReadable = true;
-  CVWait.notify_one();
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Released = true;
+  }
+  CVWait.notify_all();
 }
@@ -6,97 +6,167 @@
 #include <vector>
 #include <condition_variable>
 
+#include "AlignedAllocator.h"
+#include "PacketFormat.h"
+
 /**
- * This is a double buffer, one for reading and one for writing. When writing is done they will be swapped.
- * It also acts as the connection between VisionActor and Server. The StartReading method is blocking until
- * the DoneWriting method is called. So when the VisionActor is done writing, the StartReading methods returns
- * and the Server will start reading and sending the packet.
+ * This is a ring of packet buffers, started and read in order. With a single slot writing and reading alternate,
+ * with more slots the next packet can be written while the previous ones are still written or waiting to be read.
+ * It also acts as the connection between VisionActor and Server. StartWriting blocks until the next slot is free and
+ * claims it, so several packets can be written at the same time and complete in any order. StartReading blocks until
+ * DoneWriting is called for the next packet in order. So when the VisionActor is done writing, the StartReading
+ * methods returns and the Server will start reading and sending the packet.
  */
 class ROSINTEGRATIONVISION_API PacketBuffer
 {
 public:
   /**
-   * packet format:
+   * packet format, see PacketFormat.h:
    * - PacketHeader
-   * - Color image data (width * height * 3 Bytes (BGR))
-   * - Depth image data (width * height * 2 Bytes (Float16))
-   * - Object image data (width * height * 3 Bytes (BGR))
+   * - StreamDescriptor table
+   * - Stream payloads, e.g. color image data (width * height * 3 Bytes (BGR)), depth image data
+   *   (width * height * 2 Bytes (Float16)) and object image data (width * height * 3 Bytes (BGR)), optionally
+   *   followed by normals and flow computed from the depth and the ranges of emulated lidars, each one aligned to
+   *   PacketFormat::PayloadAlignment
    * - List of map entries
    */
 
-  struct Vector
-  {
-    float X;
-    float Y;
-    float Z;
-  };
+  typedef PacketFormat::Vector Vector;
+  typedef PacketFormat::Quaternion Quaternion;
+  typedef PacketFormat::PacketHeader PacketHeader;
+  typedef PacketFormat::StreamDescriptor StreamDescriptor;
+  typedef PacketFormat::MapEntry MapEntry;
 
-  struct Quaternion
+private:
+  enum SlotState
   {
-    float X;
-    float Y;
-    float Z;
-    float W;
+    SlotFree = 0,
+    SlotWriting,
+    SlotReady,
+    SlotReading,
+    SlotLeased // Read, but still referenced by leases
   };
 
-  struct PacketHeader
-  {
-    uint32_t Size; // Size of the complete packet
-    uint32_t SizeHeader; // Size of the header
-    uint32_t MapEntries; // Number of map entries at the end of the packet
-    uint32_t Width; // Width of the images
-    uint32_t Height; // Height of the images
-    uint64_t TimestampCapture; // Timestamp from capture
-    uint64_t TimestampSent; // Timestamp from sending
-    float FieldOfViewX; // FOV in X direction
-    float FieldOfViewY; // FOV in Y dircetion
-    Vector Translation; // Translation of the camera for current frame
-    Quaternion Rotation; // Rotation of the camera for current frame
-  };
+  // The payloads are left uninitialized, so that their pages are first touched by the processing threads writing them
+  // and get placed on their NUMA node
+  std::vector<AlignedBytes> Slots;
+  std::vector<SlotState> States;
+  std::vector<uint32> Leases;
+  // Slot started next, slot started last, slot read next, the slot read last, which is kept for RestartReading until
+  // it is written again, and the slot that is currently read
+  uint32 WriteSlot, WritingSlot, ReadSlot, LastSlot, ReadingSlot;
+  bool Rereading, Released;
+  std::mutex Lock;
+  std::condition_variable CVWait;
 
-  struct MapEntry
-  {
-    uint32_t Size; // Size of the complete map entry
-    uint8_t R; // Red channel
-    uint8_t G; // Green channel
-    uint8_t B; // Blue channel
-    char FirstChar; // Position of the first character, Size - 7 Bytes in total
-  };
+  // Frees the slot if it was read and this was its last lease
+  void ReleaseLease(const uint32 Slot);
 
+  // Updates the pointers after the slot changed or was resized
+  void UpdateWritePointers();
+  void UpdateReadPointers(const uint32 Slot);
 
-private:
-  std::vector<uint8> ReadBuffer, WriteBuffer;
-  bool IsDataReadable;
-  std::mutex LockBuffer, LockRead;
-  std::condition_variable CVWait;
+  // Computes offset, stride and size of the streams
+  static std::vector<StreamDescriptor> Layout(const std::vector<StreamDescriptor> &Streams);
 
 public:
-  // Sizes of the Header, the raw color and depth image data
-  const uint32 SizeHeader, SizeRGB, SizeFloat;
-  // Offsets for the images and map entries in the packet buffer
-  const uint32 OffsetColor, OffsetDepth, OffsetObject, OffsetMap;
-  // Size of the complete packet
+  // Stream descriptors of the packet with the offsets filled in
+  const std::vector<StreamDescriptor> Streams;
+  // Size of the header including the stream descriptor table
+  const uint32 SizeHeader;
+  // Offset of the map entries in the packet buffer
+  const uint32 OffsetMap;
+  // Size of the complete packet without map entries
   const uint32 Size;
-  // Pointers to the beginning of the images and map for writing and a pointer to the beginning of a completed packet for reading
+  // Keeps the slot of a packet from being written again while it is referenced, e.g. by messages published
+  // asynchronously. The buffer has to outlive its leases.
+  class ROSINTEGRATIONVISION_API Lease
+  {
+  private:
+    PacketBuffer &Buffer;
+    const uint32 Slot;
+
+  public:
+    Lease(PacketBuffer &Buffer, const uint32 Slot);
+    ~Lease();
+  };
+
+  // Pointers to the beginning of the color, depth and object streams and map of the packet started last for writing
+  // and a pointer to the beginning of a completed packet for reading.
+  // The writing pointers only change in StartWriting and the reading pointers in StartReading.
   uint8 *Color, *Depth, *Object, *Map, *Read;
   // Pointer to the packet headers
   PacketHeader *HeaderWrite, *HeaderRead;
 
-  // Initializes the buffer, widht and height are not changeable afterwards
-  PacketBuffer(const uint32 Width, const uint32 Height, const float FieldOfView);
+  // Initializes the buffer for the given streams, only type, encoding, width, height and scale of the streams are used.
+  // Widht, height and streams are not changeable afterwards, a new buffer is needed to change them.
+  // With HugePages large buffers are backed by 2 MiB pages, see AlignedMemory. SlotCount is the number of packets that
+  // can be written or waiting to be read at the same time.
+  PacketBuffer(const uint32 Width, const uint32 Height, const float FieldOfView, const std::vector<StreamDescriptor> &Streams,
+               const bool HugePages = false, const uint32 SlotCount = 1);
+
+  // Returns the stream descriptors for color (BGR8), depth (F16 in cm) and object (BGR8) images
+  static std::vector<StreamDescriptor> DefaultStreams(const uint32 Width, const uint32 Height);
+
+  // Returns the stream descriptors matching the render target formats used for the conversion on the GPU:
+  // color (BGRA8), depth (F32 scaled by DepthScale to meters) and object (BGRA8) images
+  static std::vector<StreamDescriptor> GPUStreams(const uint32 Width, const uint32 Height, const float DepthScale);
+
+  // Returns the stream descriptors of panoramas stitched from faces rendered like for GPUStreams: color (BGR8) and
+  // depth (F32 in cm, the distance along the ray of each pixel)
+  static std::vector<StreamDescriptor> PanoramaStreams(const uint32 Width, const uint32 Height);
+
+  // Returns the stream descriptors of the enabled auxiliary streams computed from the depth: normals (F32C3) and
+  // flow (F32C2 in pixels)
+  static std::vector<StreamDescriptor> AuxiliaryStreams(const uint32 Width, const uint32 Height, const bool Normals, const bool Flow);
+
+  // Returns the index of the first stream of the given type, -1 if the packet has none
+  int32 FindStream(const uint32 Type) const;
+
+  // Returns the pointer to the given stream of the packet started last for writing
+  uint8 *GetWriteStream(const int32 Stream);
+
+  // Returns the pointers to the given stream and the header of a packet that is written, e.g. by a processing thread
+  // while the next packet is already started
+  uint8 *GetWriteStream(const uint32 Slot, const int32 Stream);
+  PacketHeader *GetWriteHeader(const uint32 Slot);
+
+  // Returns the slot of the packet started last for writing and of the packet that is currently read
+  uint32 GetWriteSlot() const;
+  uint32 GetReadSlot() const;
+
+  uint32 GetSlotCount() const;
+
+  // Overrides the field of view in the headers of all slots, e.g. 360 degrees for panoramas. Only allowed before the
+  // first packet is written.
+  void SetFieldOfView(const float FieldOfViewX, const float FieldOfViewY);
+
+  // Waits until the next slot is free, starts writing it and copies the map entries to the end of the packet. The
+  // following packet can be started right away, GetWriteSlot returns the slot of this one until then.
+  // Returns false if the buffer was released.
+  bool StartWriting(const TMap<FString, uint32> &ObjectToColor, const TArray<FColor> &ObjectColors);
+
+  // Completes the packet written in the slot and unblocks the reading thread once all packets before it are complete
+  void DoneWriting(const uint32 Slot);
+
+  // Waits until the next packet is complete and starts reading it. Returns false if the buffer was released.
+  bool StartReading();
 
-  // Starts writing and copies the map entries to the end of the packet.
-  void StartWriting(const TMap<FString, uint32> &ObjectToColor, const TArray<FColor> &ObjectColors);
+  // Starts reading the next packet if it is complete, without waiting
+  bool TryStartReading();
 
-  // Swaps reading and writing buffer and unblocks the reading thread
-  void DoneWriting();
+  // Starts reading the last packet again. It stays valid until its slot is written again, so no other packet may be
+  // written or waiting to be read.
+  void RestartReading();
 
-  // Waits until the reading buffer is valid and locks it.
-  void StartReading();
+  // Returns a lease on the packet that is currently read, its data stays valid after DoneReading until all copies
+  // of the lease are released
+  TSharedPtr<Lease, ESPMode::ThreadSafe> LeaseRead();
 
-  // Unlocks the reading buffer
+  // Frees the slot of the packet that was read, unless it is leased
   void DoneReading();
 
-  // Releases the lock so that StartReading will return, this is needed to stop the server in the end.
+  // Unblocks StartWriting and StartReading, this is needed to stop the server in the end. No packet can be started
+  // afterwards, completed packets can still be read.
   void Release();
 };
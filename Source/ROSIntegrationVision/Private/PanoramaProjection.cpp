@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PanoramaProjection.h"
+
+#include <cmath>
+
+#include "Async/ParallelFor.h"
+
+// Axes of the faces in the frame of the camera, x forward, y right and z up like UE
+static const double FaceForward[PanoramaProjection::FaceCount][3] = {{1, 0, 0}, {0, 1, 0}, {-1, 0, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+static const double FaceRight[PanoramaProjection::FaceCount][3] = {{0, 1, 0}, {-1, 0, 0}, {0, -1, 0}, {1, 0, 0}, {0, 1, 0}, {0, 1, 0}};
+static const double FaceUp[PanoramaProjection::FaceCount][3] = {{0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {-1, 0, 0}, {1, 0, 0}};
+
+static double Dot(const double A[3], const double B[3])
+{
+  return A[0] * B[0] + A[1] * B[1] + A[2] * B[2];
+}
+
+PanoramaProjection::PanoramaProjection(const uint32 Width, const uint32 Height, const uint32 FaceSize, const Projection Type, const float VerticalFieldOfView) :
+  Width(Width), Height(Height), FaceSize(FMath::Clamp<uint32>(FaceSize, 1, 65535)), FaceMask(0), Table(Width * Height)
+{
+  const double Scale = 1 << FractionBits;
+  const double HalfSize = this->FaceSize / 2.0;
+  const uint32 Half = 1 << (FractionBits - 1);
+  const double Last = this->FaceSize - 1;
+
+  // The principal point is the forward direction of the camera in the center of the image, like in the camera info
+  const double AngleX = 2 * PI / Width;
+  const double AngleY = PI / Height;
+  FieldOfViewY = Type == Equirectangular ? 180.0f : FMath::Clamp(VerticalFieldOfView, 1.0f, 170.0f);
+  const double FocalY = Height / 2.0 / std::tan(FieldOfViewY * PI / 360.0);
+
+  for(uint32 V = 0; V < Height; ++V)
+  {
+    for(uint32 U = 0; U < Width; ++U)
+    {
+      // Direction of the ray of the pixel, longitude increases to the right and latitude upwards
+      const double Longitude = (U - Width / 2.0) * AngleX;
+      double Ray[3];
+      if(Type == Equirectangular)
+      {
+        const double Latitude = (Height / 2.0 - V) * AngleY;
+        Ray[0] = std::cos(Latitude) * std::cos(Longitude);
+        Ray[1] = std::cos(Latitude) * std::sin(Longitude);
+        Ray[2] = std::sin(Latitude);
+      }
+      else
+      {
+        Ray[0] = std::cos(Longitude);
+        Ray[1] = std::sin(Longitude);
+        Ray[2] = (Height / 2.0 - V) / FocalY;
+      }
+
+      // The ray hits the face it is most aligned with
+      uint32 Face = 0;
+      double Forward = Dot(FaceForward[0], Ray);
+      for(uint32 i = 1; i < FaceCount; ++i)
+      {
+        const double Alignment = Dot(FaceForward[i], Ray);
+        if(Alignment > Forward)
+        {
+          Face = i;
+          Forward = Alignment;
+        }
+      }
+
+      // Position on the face, its pixel centers are half a pixel inside of its borders
+      const double SourceX = FMath::Clamp((Dot(FaceRight[Face], Ray) / Forward + 1) * HalfSize - 0.5, 0.0, Last);
+      const double SourceY = FMath::Clamp((1 - Dot(FaceUp[Face], Ray) / Forward) * HalfSize - 0.5, 0.0, Last);
+      const int32 FixedX = (int32)std::lround(SourceX * Scale);
+      const int32 FixedY = (int32)std::lround(SourceY * Scale);
+      const uint32 IntX = FixedX >> FractionBits;
+      const uint32 IntY = FixedY >> FractionBits;
+
+      RemapEntry &Entry = Table[V * Width + U];
+      Entry.X = IntX;
+      Entry.Y = IntY;
+      // The last column and row have no neighbour to interpolate with
+      Entry.FracX = IntX + 1 < this->FaceSize ? FixedX & ((1 << FractionBits) - 1) : 0;
+      Entry.FracY = IntY + 1 < this->FaceSize ? FixedY & ((1 << FractionBits) - 1) : 0;
+      Entry.Face = Face;
+      Entry.Reserved = 0;
+      // The depth uses the nearest face pixel, so its range is scaled by the length of the ray of that pixel
+      const double NearestX = (IntX + (Entry.FracX >= Half ? 1 : 0) + 0.5) / HalfSize - 1;
+      const double NearestY = (IntY + (Entry.FracY >= Half ? 1 : 0) + 0.5) / HalfSize - 1;
+      Entry.Range = std::sqrt(1 + NearestX * NearestX + NearestY * NearestY);
+      FaceMask |= 1 << Face;
+    }
+  }
+}
+
+FRotator PanoramaProjection::FaceRotation(const uint32 Face)
+{
+  static const FRotator Rotations[FaceCount] = {FRotator(0, 0, 0), FRotator(0, 90, 0), FRotator(0, 180, 0), FRotator(0, -90, 0), FRotator(90, 0, 0), FRotator(-90, 0, 0)};
+  return Rotations[Face];
+}
+
+bool PanoramaProjection::UsesFace(const uint32 Face) const
+{
+  return (FaceMask & (1 << Face)) != 0;
+}
+
+uint32 PanoramaProjection::GetFaceSize() const
+{
+  return FaceSize;
+}
+
+float PanoramaProjection::GetFieldOfViewY() const
+{
+  return FieldOfViewY;
+}
+
+void PanoramaProjection::Apply(const uint8 *ColorFaces, const float *DepthFaces, const PacketFormat::StreamDescriptor &ColorStream, uint8 *ColorData,
+                               const PacketFormat::StreamDescriptor &DepthStream, uint8 *DepthData) const
+{
+  if(ColorStream.Width != Width || ColorStream.Height != Height || DepthStream.Width != Width || DepthStream.Height != Height
+     || (ColorStream.Encoding != PacketFormat::EncodingBGR8 && ColorStream.Encoding != PacketFormat::EncodingBGRA8)
+     || DepthStream.Encoding != PacketFormat::EncodingF32)
+  {
+    return;
+  }
+
+  // Bands of rows are distributed over the task graph, color and depth share the reads of the table
+  const uint32 Channels = PacketFormat::BytesPerPixel(ColorStream.Encoding);
+  const int32 Tiles = (Height + TileRows - 1) / TileRows;
+  ParallelFor(Tiles, [&](int32 Tile)
+  {
+    const uint32 FirstRow = Tile * TileRows;
+    const uint32 LastRow = FMath::Min(FirstRow + TileRows, Height);
+    Remap(ColorFaces, DepthFaces, ColorData, ColorStream.Stride, Channels, DepthData, DepthStream.Stride, FirstRow, LastRow);
+  });
+}
+
+void PanoramaProjection::Remap(const uint8 *ColorFaces, const float *DepthFaces, uint8 *Color, const uint32 ColorStride, const uint32 ColorChannels,
+                               uint8 *Depth, const uint32 DepthStride, const uint32 FirstRow, const uint32 LastRow) const
+{
+  const uint32 One = 1 << FractionBits;
+  const uint32 Round = 1 << (2 * FractionBits - 1);
+  const uint32 Half = 1 << (FractionBits - 1);
+  const uint32 FaceStride = FaceSize * 4;
+  const size_t FacePixels = (size_t)FaceSize * FaceSize;
+
+  for(uint32 V = FirstRow; V < LastRow; ++V)
+  {
+    const RemapEntry *Entry = &Table[V * Width];
+    uint8 *TargetColor = Color + V * ColorStride;
+    float *TargetDepth = reinterpret_cast<float *>(Depth + V * DepthStride);
+    for(uint32 U = 0; U < Width; ++U, ++Entry, TargetColor += ColorChannels)
+    {
+      // Fixed-point weights of the four neighbours, they add up to One * One
+      const uint32 W00 = (One - Entry->FracX) * (One - Entry->FracY);
+      const uint32 W01 = Entry->FracX * (One - Entry->FracY);
+      const uint32 W10 = (One - Entry->FracX) * Entry->FracY;
+      const uint32 W11 = Entry->FracX * Entry->FracY;
+
+      const uint8 *P00 = ColorFaces + Entry->Face * FacePixels * 4 + Entry->Y * FaceStride + Entry->X * 4;
+      const uint8 *P01 = W01 | W11 ? P00 + 4 : P00;
+      const uint8 *P10 = W10 | W11 ? P00 + FaceStride : P00;
+      const uint8 *P11 = W11 ? P10 + 4 : P10;
+
+      for(uint32 C = 0; C < ColorChannels; ++C)
+      {
+        TargetColor[C] = (uint8)((P00[C] * W00 + P01[C] * W01 + P10[C] * W10 + P11[C] * W11 + Round) >> (2 * FractionBits));
+      }
+
+      const uint32 X = Entry->X + (Entry->FracX >= Half ? 1 : 0);
+      const uint32 Y = Entry->Y + (Entry->FracY >= Half ? 1 : 0);
+      TargetDepth[U] = DepthFaces[Entry->Face * FacePixels + Y * FaceSize + X] * Entry->Range;
+    }
+  }
+}
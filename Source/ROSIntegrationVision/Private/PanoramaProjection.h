@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "PacketFormat.h"
+
+/**
+ * Stitches the six faces of a cube map, rendered with a field of view of 90 degrees each, into an equirectangular or
+ * cylindrical panorama. For every pixel of the panorama the face and the position on it are precomputed once per
+ * configuration and stored as a fixed-point lookup table, together with the factor that turns the planar depth of the
+ * face into the distance along the ray of the pixel. Color is interpolated bilinearly, depth uses the nearest pixel.
+ */
+class ROSINTEGRATIONVISION_API PanoramaProjection
+{
+public:
+  enum Projection
+  {
+    Equirectangular = 0, // Longitude and latitude linear in the columns and rows
+    Cylindrical // Longitude linear in the columns, the rows are a pinhole projection onto the cylinder
+  };
+
+  // Faces in the order forward, right, back, left, up, down
+  static const uint32 FaceCount = 6;
+
+private:
+  // Fractional bits of the remap positions
+  static const uint32 FractionBits = 8;
+  // Rows processed per task
+  static const uint32 TileRows = 32;
+
+  struct RemapEntry
+  {
+    uint16 X; // Column of the top left face pixel
+    uint16 Y; // Row of the top left face pixel
+    uint8 FracX; // Fractional position between the face pixel and its right neighbour
+    uint8 FracY; // Fractional position between the face pixel and the one below
+    uint8 Face; // Face the ray of the pixel hits
+    uint8 Reserved;
+    float Range; // Distance along the ray per unit of planar face depth
+  };
+
+  const uint32 Width, Height, FaceSize;
+  float FieldOfViewY;
+  uint32 FaceMask;
+  std::vector<RemapEntry> Table;
+
+  void Remap(const uint8 *ColorFaces, const float *DepthFaces, uint8 *Color, const uint32 ColorStride, const uint32 ColorChannels,
+             uint8 *Depth, const uint32 DepthStride, const uint32 FirstRow, const uint32 LastRow) const;
+
+public:
+  // Computes the lookup table for a panorama of the given size from faces with FaceSize x FaceSize pixels. The
+  // vertical field of view in degrees is only used by cylindrical panoramas and limited to 170 degrees.
+  PanoramaProjection(const uint32 Width, const uint32 Height, const uint32 FaceSize, const Projection Type, const float VerticalFieldOfView);
+
+  // Rotation of a face relative to the camera
+  static FRotator FaceRotation(const uint32 Face);
+
+  // Returns false if no pixel of the panorama lies on the face, so that it does not need to be rendered
+  bool UsesFace(const uint32 Face) const;
+
+  uint32 GetFaceSize() const;
+
+  // Vertical field of view of the panorama in degrees, 180 for equirectangular panoramas
+  float GetFieldOfViewY() const;
+
+  // Stitches the color (BGRA8) and depth (F32) faces, stored one after another with rows of FaceSize pixels, into
+  // the BGR8 or BGRA8 color and F32 depth streams of a packet. The depth keeps the unit of the faces.
+  void Apply(const uint8 *ColorFaces, const float *DepthFaces, const PacketFormat::StreamDescriptor &ColorStream, uint8 *ColorData,
+             const PacketFormat::StreamDescriptor &DepthStream, uint8 *DepthData) const;
+};
@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PublishQueue.h"
+
+#include <cstring>
+
+#include "StopTime.h"
+
+PublishQueue::PublishQueue() :
+  Running(true), Publishing(false)
+{
+  ThreadPublish = std::thread(&PublishQueue::PublishBatches, this);
+}
+
+PublishQueue::~PublishQueue()
+{
+  Flush();
+  {
+    std::unique_lock<std::mutex> Lock(LockQueue);
+    Running = false;
+  }
+  CVPending.notify_one();
+  ThreadPublish.join();
+}
+
+TSharedPtr<PublishQueue, ESPMode::ThreadSafe> PublishQueue::GetShared()
+{
+  static TWeakPtr<PublishQueue, ESPMode::ThreadSafe> Shared;
+  TSharedPtr<PublishQueue, ESPMode::ThreadSafe> Queue = Shared.Pin();
+  if(!Queue.IsValid())
+  {
+    Queue = TSharedPtr<PublishQueue, ESPMode::ThreadSafe>(new PublishQueue());
+    Shared = Queue;
+  }
+  return Queue;
+}
+
+void PublishQueue::Hold(const TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe> &Lease)
+{
+  if(Current.Leases.empty() || Current.Leases.back() != Lease)
+  {
+    Current.Leases.push_back(Lease);
+  }
+}
+
+const uint8 *PublishQueue::Store(const uint8 *Data, const size_t Size)
+{
+  uint8 *Copy = Allocate(Size);
+  memcpy(Copy, Data, Size);
+  return Copy;
+}
+
+uint8 *PublishQueue::Allocate(const size_t Size)
+{
+  AlignedBytes Buffer;
+  {
+    std::unique_lock<std::mutex> Lock(LockQueue);
+    if(!Spare.empty())
+    {
+      Buffer.swap(Spare.back());
+      Spare.pop_back();
+    }
+  }
+
+  Buffer.resize(Size);
+  Current.Payloads.push_back(std::move(Buffer));
+  return Current.Payloads.back().data();
+}
+
+void PublishQueue::Add(UTopic *Topic, TSharedPtr<FROSBaseMsg> Message)
+{
+  Current.Messages.emplace_back(Topic, Message);
+}
+
+void PublishQueue::Flush()
+{
+  if(Current.Messages.empty())
+  {
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> Lock(LockQueue);
+    Pending.push_back(std::move(Current));
+  }
+  Current = Batch();
+  CVPending.notify_one();
+}
+
+void PublishQueue::Wait()
+{
+  std::unique_lock<std::mutex> Lock(LockQueue);
+  CVPublished.wait(Lock, [this] {return Pending.empty() && !Publishing; });
+}
+
+void PublishQueue::PublishBatches()
+{
+  std::deque<Batch> Batches;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> Lock(LockQueue);
+      CVPending.wait(Lock, [this] {return !Pending.empty() || !Running; });
+      if(Pending.empty())
+      {
+        break;
+      }
+      // All batches flushed so far are published together
+      Batches.swap(Pending);
+      Publishing = true;
+    }
+
+    {
+      MEASURE_TIME("Publish batch");
+      for(Batch &Next : Batches)
+      {
+        for(std::pair<UTopic *, TSharedPtr<FROSBaseMsg>> &Message : Next.Messages)
+        {
+          Message.first->Publish(Message.second);
+        }
+        Next.Messages.clear();
+        // Returns the slots of the packets to their buffers
+        Next.Leases.clear();
+      }
+    }
+
+    {
+      std::unique_lock<std::mutex> Lock(LockQueue);
+      for(Batch &Next : Batches)
+      {
+        for(AlignedBytes &Buffer : Next.Payloads)
+        {
+          Spare.push_back(std::move(Buffer));
+        }
+      }
+      Batches.clear();
+      Publishing = false;
+    }
+    CVPublished.notify_all();
+  }
+}
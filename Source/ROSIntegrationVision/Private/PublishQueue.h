@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "RI/Topic.h"
+
+#include "AlignedAllocator.h"
+#include "PacketBuffer.h"
+
+/**
+ * Publishes the messages of the vision components from a background thread, so that the game thread does not pay
+ * for serializing and sending the images. The messages of a frame are collected in a batch and handed over with
+ * Flush. Batches flushed while the thread is still busy, e.g. by the other cameras of a rig, are published
+ * together. Payloads inside captured packets are published straight from their slot, which is leased by the batch.
+ * Other payloads are written into, or copied into, buffers of the batch, which are reused once the batch is
+ * published. Add, Hold, Allocate, Store and Flush are called from the game thread.
+ */
+class ROSINTEGRATIONVISION_API PublishQueue
+{
+private:
+  struct Batch
+  {
+    std::vector<std::pair<UTopic *, TSharedPtr<FROSBaseMsg>>> Messages;
+    std::vector<AlignedBytes> Payloads;
+    std::vector<TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe>> Leases;
+  };
+
+  Batch Current;
+  std::deque<Batch> Pending;
+  // Payload buffers of published batches, kept to avoid reallocations
+  std::vector<AlignedBytes> Spare;
+  std::mutex LockQueue;
+  std::condition_variable CVPending, CVPublished;
+  std::thread ThreadPublish;
+  bool Running, Publishing;
+
+  // Background thread publishing the batches
+  void PublishBatches();
+
+public:
+  PublishQueue();
+  // Publishes the remaining batches
+  ~PublishQueue();
+
+  // Returns the queue shared by all vision components, it is created on demand and destroyed with its last user
+  static TSharedPtr<PublishQueue, ESPMode::ThreadSafe> GetShared();
+
+  // Keeps the leased packet valid until the current batch is published
+  void Hold(const TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe> &Lease);
+
+  // Returns a buffer of the current batch for a payload, it stays valid until the batch is published
+  uint8 *Allocate(const size_t Size);
+
+  // Copies a payload into a buffer of the current batch, for payloads that are not owned by a packet slot
+  const uint8 *Store(const uint8 *Data, const size_t Size);
+
+  // Adds a message to the current batch. The queue has to hold the only references to it after Flush, because
+  // the message is released by the background thread.
+  void Add(UTopic *Topic, TSharedPtr<FROSBaseMsg> Message);
+
+  // Hands the current batch to the background thread
+  void Flush();
+
+  // Waits until all flushed batches are published, e.g. before the topics are destroyed
+  void Wait();
+};
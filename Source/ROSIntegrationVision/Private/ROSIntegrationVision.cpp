@@ -2,12 +2,17 @@
 
 #include "ROSIntegrationVision.h"
 
+#include "ConversionKernels.h"
+
 #define LOCTEXT_NAMESPACE "FROSIntegrationVisionModule"
 
 void FROSIntegrationVisionModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
 	UE_LOG(LogTemp, Warning, TEXT("This is Startup Vision"));
+
+	// Select the fastest image conversion kernels supported by this CPU
+	ConversionKernels::Select();
 }
 
 void FROSIntegrationVisionModule::ShutdownModule()
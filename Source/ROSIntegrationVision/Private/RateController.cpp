@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "RateController.h"
+
+RateController::RateController(const Settings &Config, const float Framerate) :
+  Config(Config), Framerate(FMath::Clamp(Framerate, Config.MinFramerate, Config.MaxFramerate)), Step(0), Elapsed(0),
+  LatencySum(0), StallSum(0), LatencyFrames(0), Headroom(0), LastLatency(0), LastStall(0)
+{
+}
+
+void RateController::AddLatency(const double Latency)
+{
+  LatencySum += Latency;
+  ++LatencyFrames;
+}
+
+void RateController::AddStall(const double Stall)
+{
+  StallSum += Stall;
+}
+
+bool RateController::Update(const float DeltaTime)
+{
+  Elapsed += DeltaTime;
+  // Windows are extended until a frame was published, e.g. at low frame rates
+  if(Elapsed < WindowTime || LatencyFrames == 0)
+  {
+    return false;
+  }
+
+  LastLatency = LatencySum / LatencyFrames;
+  LastStall = StallSum / (Elapsed * 1000.0);
+  Elapsed = 0;
+  LatencySum = 0;
+  StallSum = 0;
+  LatencyFrames = 0;
+
+  if(LastLatency > Config.TargetLatency || LastStall > Config.MaxStall)
+  {
+    Headroom = 0;
+    if(Framerate > Config.MinFramerate)
+    {
+      Framerate = FMath::Max(Framerate * Decrease, Config.MinFramerate);
+      return true;
+    }
+    if(Step < Config.Steps)
+    {
+      ++Step;
+      return true;
+    }
+    return false;
+  }
+
+  // Only half of the targets counts as headroom, so that the controller does not oscillate around them
+  if(LastLatency > Config.TargetLatency * 0.5f || LastStall > Config.MaxStall * 0.5f)
+  {
+    Headroom = 0;
+    return false;
+  }
+  if(++Headroom < HeadroomWindows)
+  {
+    return false;
+  }
+
+  Headroom = 0;
+  if(Step > 0)
+  {
+    --Step;
+    return true;
+  }
+  if(Framerate < Config.MaxFramerate)
+  {
+    Framerate = FMath::Min(Framerate * Increase, Config.MaxFramerate);
+    return true;
+  }
+  return false;
+}
+
+float RateController::GetFramerate() const
+{
+  return Framerate;
+}
+
+uint32 RateController::GetStep() const
+{
+  return Step;
+}
+
+bool RateController::IsUnthrottled() const
+{
+  return Framerate >= Config.MaxFramerate && Step == 0;
+}
+
+float RateController::GetLatency() const
+{
+  return LastLatency;
+}
+
+float RateController::GetStall() const
+{
+  return LastStall;
+}
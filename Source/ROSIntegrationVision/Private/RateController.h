@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Adapts the capture rate and resolution of a vision component to what the pipeline behind it can take. The
+ * latency from capture to publish and the time the game thread waits for the pipeline are averaged over short
+ * windows. Under pressure the frame rate is lowered down to its minimum first, then the resolution is stepped
+ * down the ladder. With headroom for several windows in a row the resolution is restored first, then the rate.
+ */
+class ROSINTEGRATIONVISION_API RateController
+{
+public:
+  struct Settings
+  {
+    float MinFramerate, MaxFramerate;
+    float TargetLatency; // Average latency from capture to publish in ms above which the pipeline is under pressure
+    float MaxStall; // Fraction of the time the game thread may wait for the pipeline
+    uint32 Steps; // Number of resolution steps below the configured resolution
+  };
+
+private:
+  // Length of a measurement window in seconds
+  static constexpr float WindowTime = 0.5f;
+  // Number of windows in a row with headroom before the rate or resolution is raised
+  static const uint32 HeadroomWindows = 4;
+  // Factors applied to the frame rate when lowering and raising it
+  static constexpr float Decrease = 0.75f;
+  static constexpr float Increase = 1.2f;
+
+  const Settings Config;
+  float Framerate;
+  uint32 Step;
+  float Elapsed;
+  double LatencySum, StallSum;
+  uint32 LatencyFrames, Headroom;
+  float LastLatency, LastStall;
+
+public:
+  RateController(const Settings &Config, const float Framerate);
+
+  // Adds the latency of a published frame in ms
+  void AddLatency(const double Latency);
+
+  // Adds the time in ms the game thread waited for the pipeline
+  void AddStall(const double Stall);
+
+  // Advances the window by the time passed since the last call. Returns true if the frame rate or the resolution
+  // step changed at the end of the window.
+  bool Update(const float DeltaTime);
+
+  float GetFramerate() const;
+
+  // Step on the resolution ladder, 0 is the configured resolution
+  uint32 GetStep() const;
+
+  // True while running at the maximum rate and the configured resolution
+  bool IsUnthrottled() const;
+
+  // Average latency in ms and stall fraction of the last complete window
+  float GetLatency() const;
+  float GetStall() const;
+};
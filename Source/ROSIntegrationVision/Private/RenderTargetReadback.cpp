@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "RenderTargetReadback.h"
+
+#include "Engine/TextureRenderTarget2D.h"
+#include "RenderingThread.h"
+#include "RHICommandList.h"
+#include "TextureResource.h"
+
+RenderTargetReadback::RenderTargetReadback() :
+  Staging(new StagingData())
+{
+}
+
+void RenderTargetReadback::Enqueue(UTextureRenderTarget2D *RenderTarget, uint8 *Data, const uint32 Stride)
+{
+  FTextureRenderTargetResource *RenderTargetResource = RenderTarget->GameThread_GetRenderTargetResource();
+  TSharedPtr<StagingData, ESPMode::ThreadSafe> StagingRef = Staging;
+
+  ENQUEUE_RENDER_COMMAND(VisionReadbackCommand)(
+    [RenderTargetResource, StagingRef, Data, Stride](FRHICommandListImmediate &RHICmdList)
+  {
+    const FTexture2DRHIRef &Texture = RenderTargetResource->GetRenderTargetTexture();
+    const uint32 SizeX = Texture->GetSizeX();
+    const uint32 SizeY = Texture->GetSizeY();
+    const EPixelFormat Format = Texture->GetFormat();
+
+    // Recreate the staging texture only if the render target changed
+    FTexture2DRHIRef &StagingTexture = StagingRef->Texture;
+    if(!StagingTexture.IsValid() || StagingTexture->GetSizeX() != SizeX || StagingTexture->GetSizeY() != SizeY || StagingTexture->GetFormat() != Format)
+    {
+      FRHIResourceCreateInfo CreateInfo;
+      StagingTexture = RHICreateTexture2D(SizeX, SizeY, Format, 1, 1, TexCreate_CPUReadback, CreateInfo);
+    }
+
+    RHICmdList.CopyToResolveTarget(Texture, StagingTexture, FResolveParams());
+
+    void *Mapped = nullptr;
+    int32 MappedWidth = 0, MappedHeight = 0;
+    RHICmdList.MapStagingSurface(StagingTexture, Mapped, MappedWidth, MappedHeight);
+    if(Mapped)
+    {
+      // The mapped width is the row pitch in pixels, which might be larger than the texture
+      const uint32 BytesPerPixel = GPixelFormats[Format].BlockBytes;
+      const uint32 RowSize = FMath::Min(SizeX * BytesPerPixel, Stride);
+      for(uint32 Row = 0; Row < SizeY; ++Row)
+      {
+        FMemory::Memcpy(Data + Row * Stride, reinterpret_cast<const uint8 *>(Mapped) + Row * MappedWidth * BytesPerPixel, RowSize);
+      }
+    }
+    RHICmdList.UnmapStagingSurface(StagingTexture);
+  });
+}
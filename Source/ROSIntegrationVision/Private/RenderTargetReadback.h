@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+
+class UTextureRenderTarget2D;
+
+/**
+ * Copies the raw pixels of a render target into CPU memory without any format conversion. The render target is
+ * copied into a staging texture that is kept between frames and mapped on the render thread. Several readbacks can be
+ * enqueued before the rendering commands are flushed once.
+ */
+class ROSINTEGRATIONVISION_API RenderTargetReadback
+{
+private:
+  // Staging texture, only accessed on the render thread
+  struct StagingData
+  {
+    FTexture2DRHIRef Texture;
+  };
+  TSharedPtr<StagingData, ESPMode::ThreadSafe> Staging;
+
+public:
+  RenderTargetReadback();
+
+  // Enqueues copying the render target into Data with rows Stride Bytes apart.
+  // Data has to stay valid until the rendering commands are flushed.
+  void Enqueue(UTextureRenderTarget2D *RenderTarget, uint8 *Data, const uint32 Stride);
+};
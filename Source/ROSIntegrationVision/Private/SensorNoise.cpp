@@ -0,0 +1,238 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SensorNoise.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "ConversionKernels.h"
+
+// Mixes the seed into well distributed, independent values for the generator states
+static uint64 SplitMix64(uint64 &State)
+{
+  uint64 Value = (State += 0x9E3779B97F4A7C15ull);
+  Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ull;
+  Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBull;
+  return Value ^ (Value >> 31);
+}
+
+SensorNoise::Random::Random(const uint64 Seed)
+{
+  uint64 Mix = Seed;
+  for(uint32 Lane = 0; Lane < 8; ++Lane)
+  {
+    // xorshift must not start with 0
+    State[Lane] = (uint32)SplitMix64(Mix) | 1;
+  }
+}
+
+void SensorNoise::Random::Uniform(float *Out, const uint32 Count)
+{
+  float Block[8];
+  for(uint32 i = 0; i < Count; i += 8)
+  {
+    for(uint32 Lane = 0; Lane < 8; ++Lane)
+    {
+      uint32 X = State[Lane];
+      X ^= X << 13;
+      X ^= X >> 17;
+      X ^= X << 5;
+      State[Lane] = X;
+      Block[Lane] = (X >> 8) * (1.0f / 16777216.0f);
+    }
+    memcpy(Out + i, Block, FMath::Min<uint32>(8, Count - i) * sizeof(float));
+  }
+}
+
+void SensorNoise::Random::Normal(float *Out, const uint32 Count)
+{
+  // The sum of four uniform numbers has a variance of 1/3
+  const float Scale = std::sqrt(3.0f);
+  float Block[8], Sum[8];
+  for(uint32 i = 0; i < Count; i += 8)
+  {
+    for(uint32 Lane = 0; Lane < 8; ++Lane)
+    {
+      Sum[Lane] = -2.0f;
+    }
+    for(uint32 Round = 0; Round < 4; ++Round)
+    {
+      Uniform(Block, 8);
+      for(uint32 Lane = 0; Lane < 8; ++Lane)
+      {
+        Sum[Lane] += Block[Lane];
+      }
+    }
+    for(uint32 Lane = 0; Lane < 8; ++Lane)
+    {
+      Sum[Lane] *= Scale;
+    }
+    memcpy(Out + i, Sum, FMath::Min<uint32>(8, Count - i) * sizeof(float));
+  }
+}
+
+SensorNoise::SensorNoise(const Settings &Config) :
+  Config(Config)
+{
+  // Shot noise grows with the intensity, read noise is constant, both add up to one normal distribution
+  const float ReadVariance = Config.ColorReadNoise * Config.ColorReadNoise;
+  for(uint32 Value = 0; Value < 256; ++Value)
+  {
+    ColorSigma[Value] = std::sqrt(Config.ColorShotNoise * (float)Value + ReadVariance);
+  }
+}
+
+bool SensorNoise::IsEnabled(const Settings &Config)
+{
+  return Config.DepthNoise > 0 || Config.DepthQuantization > 0 || Config.DepthEdgeDropout > 0 || Config.ColorShotNoise > 0 || Config.ColorReadNoise > 0;
+}
+
+void SensorNoise::Apply(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, const uint32 Sequence)
+{
+  Random Generator(((uint64)Config.Seed << 32) ^ ((uint64)Sequence << 2) ^ Stream.Type);
+
+  switch(Stream.Encoding)
+  {
+  case PacketFormat::EncodingBGR8:
+  case PacketFormat::EncodingBGRA8:
+    if(Stream.Type == PacketFormat::StreamColor)
+    {
+      ApplyColor(Stream, Data, Generator);
+    }
+    break;
+  case PacketFormat::EncodingF16:
+  case PacketFormat::EncodingF32:
+    if(Stream.Type == PacketFormat::StreamDepth)
+    {
+      ApplyDepth(Stream, Data, Generator);
+    }
+    break;
+  }
+}
+
+void SensorNoise::ApplyColor(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, Random &Generator)
+{
+  if(Config.ColorShotNoise <= 0 && Config.ColorReadNoise <= 0)
+  {
+    return;
+  }
+
+  const uint32 Channels = PacketFormat::BytesPerPixel(Stream.Encoding);
+  const uint32 Count = Stream.Width * Channels;
+  ColorNoise.resize(Count);
+  const float *Noise = ColorNoise.data();
+
+  for(uint32 Row = 0; Row < Stream.Height; ++Row)
+  {
+    uint8 *Pixels = Data + Row * Stream.Stride;
+    Generator.Normal(ColorNoise.data(), Count);
+    for(uint32 i = 0; i < Count; i += Channels)
+    {
+      // Alpha is not noisy
+      for(uint32 Channel = 0; Channel < 3; ++Channel)
+      {
+        const uint8 Value = Pixels[i + Channel];
+        const float Noisy = Value + Noise[i + Channel] * ColorSigma[Value];
+        Pixels[i + Channel] = (uint8)FMath::Clamp(std::nearbyint(Noisy), 0.0f, 255.0f);
+      }
+    }
+  }
+}
+
+void SensorNoise::ApplyDepth(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, Random &Generator)
+{
+  if(Config.DepthNoise <= 0 && Config.DepthQuantization <= 0 && Config.DepthEdgeDropout <= 0)
+  {
+    return;
+  }
+
+  const uint32 Width = Stream.Width;
+  const bool Half = Stream.Encoding == PacketFormat::EncodingF16;
+  const float Invalid = std::numeric_limits<float>::quiet_NaN();
+
+  // Rows of the original depth in meters, the previous and next rows are needed for the edge detection
+  DepthRows.resize(Width * 3);
+  DepthOut.resize(Width);
+  DepthNoise.resize(Width);
+  DepthDropout.resize(Width);
+  float *Prev = &DepthRows[0], *Cur = &DepthRows[Width], *Next = &DepthRows[Width * 2];
+  float *Out = DepthOut.data(), *Noise = DepthNoise.data(), *Dropout = DepthDropout.data();
+
+  auto ReadRow = [&](const uint32 Row, float *Meters)
+  {
+    const uint8 *In = Data + Row * Stream.Stride;
+    if(Half)
+    {
+      ConversionKernels::HalfToFloat(reinterpret_cast<const uint16 *>(In), Meters, Width, Stream.Scale);
+      return;
+    }
+    const float *Values = reinterpret_cast<const float *>(In);
+    for(uint32 i = 0; i < Width; ++i)
+    {
+      Meters[i] = Values[i] * Stream.Scale;
+    }
+  };
+
+  if(Stream.Height > 0)
+  {
+    ReadRow(0, Cur);
+  }
+  for(uint32 Row = 0; Row < Stream.Height; ++Row)
+  {
+    // Rows outside of the image repeat the border, so that they never count as an edge
+    if(Row + 1 < Stream.Height)
+    {
+      ReadRow(Row + 1, Next);
+    }
+    else
+    {
+      memcpy(Next, Cur, Width * sizeof(float));
+    }
+    if(Row == 0)
+    {
+      memcpy(Prev, Cur, Width * sizeof(float));
+    }
+
+    Generator.Normal(Noise, Width);
+    Generator.Uniform(Dropout, Width);
+
+    for(uint32 i = 0; i < Width; ++i)
+    {
+      const float Depth = Cur[i];
+      // Depth beyond the range of the half float target is +Inf and stays a missing return, Inf plus negative noise
+      // would turn it into an invalid NaN
+      if(!std::isfinite(Depth))
+      {
+        Out[i] = Depth;
+        continue;
+      }
+      float Noisy = Depth + Noise[i] * Config.DepthNoise * Depth * Depth;
+      if(Config.DepthQuantization > 0)
+      {
+        Noisy = std::nearbyint(Noisy / Config.DepthQuantization) * Config.DepthQuantization;
+      }
+
+      const float Left = Cur[i > 0 ? i - 1 : i];
+      const float Right = Cur[i + 1 < Width ? i + 1 : i];
+      const float Edge = FMath::Max(FMath::Max(std::abs(Depth - Left), std::abs(Depth - Right)), FMath::Max(std::abs(Depth - Prev[i]), std::abs(Depth - Next[i])));
+      Out[i] = Edge > Config.DepthEdgeThreshold && Dropout[i] < Config.DepthEdgeDropout ? Invalid : Noisy / Stream.Scale;
+    }
+
+    uint8 *Target = Data + Row * Stream.Stride;
+    if(Half)
+    {
+      ConversionKernels::FloatToHalf(Out, reinterpret_cast<uint16 *>(Target), Width);
+    }
+    else
+    {
+      memcpy(Target, Out, Width * sizeof(float));
+    }
+
+    // Rotate the rows
+    float *Temp = Prev;
+    Prev = Cur;
+    Cur = Next;
+    Next = Temp;
+  }
+}
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <vector>
+
+#include "PacketFormat.h"
+
+/**
+ * Simulates sensor noise and artifacts on the converted streams of a packet, so that the images are not perfect
+ * ground truth. The random numbers are seeded from the seed, the sequence number of the frame and the stream type,
+ * so the result is deterministic and does not depend on the thread a stream is processed on.
+ */
+class ROSINTEGRATIONVISION_API SensorNoise
+{
+public:
+  struct Settings
+  {
+    uint32 Seed;
+    float DepthNoise; // Standard deviation of the depth in meters at 1 meter, grows quadratically with the depth
+    float DepthQuantization; // Step size of the depth in meters, 0 disables it
+    float DepthEdgeThreshold; // Difference in meters between neighbouring pixels that is considered a depth edge
+    float DepthEdgeDropout; // Probability of invalidating a pixel on a depth edge
+    float ColorShotNoise; // Variance of the photon shot noise per intensity level
+    float ColorReadNoise; // Standard deviation of the read noise in intensity levels
+  };
+
+private:
+  // Eight interleaved xorshift generators, so that the loops filling blocks of random numbers vectorize
+  class Random
+  {
+  private:
+    uint32 State[8];
+
+  public:
+    Random(const uint64 Seed);
+
+    // Fills Out with uniform numbers in [0, 1)
+    void Uniform(float *Out, const uint32 Count);
+
+    // Fills Out with approximately normal distributed numbers with a standard deviation of 1, the sum of four
+    // uniform numbers is used instead of Box-Muller to avoid transcendental functions
+    void Normal(float *Out, const uint32 Count);
+  };
+
+  const Settings Config;
+  // Standard deviation of the color noise for each intensity level
+  float ColorSigma[256];
+
+  // Buffers reused for every frame. A stream type is only processed by one thread at a time, so color and depth have
+  // their own buffers.
+  std::vector<float> ColorNoise;
+  std::vector<float> DepthRows, DepthOut, DepthNoise, DepthDropout;
+
+  void ApplyColor(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, Random &Generator);
+  void ApplyDepth(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, Random &Generator);
+
+public:
+  SensorNoise(const Settings &Config);
+
+  // Returns true if any of the effects is enabled
+  static bool IsEnabled(const Settings &Config);
+
+  // Applies the noise to a color (BGR8, BGRA8) or depth (F16, F32) stream in place, other streams are unchanged.
+  // Color and depth may be applied concurrently, but not several streams of the same type.
+  void Apply(const PacketFormat::StreamDescriptor &Stream, uint8 *Data, const uint32 Sequence);
+};
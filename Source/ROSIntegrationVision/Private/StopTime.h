@@ -9,10 +9,10 @@
 class ROSINTEGRATIONVISION_API StopTime
 {
 protected:
-  const std::chrono::high_resolution_clock::time_point StartTime;
+  const std::chrono::steady_clock::time_point StartTime;
 
 public:
-  StopTime() : StartTime(std::chrono::high_resolution_clock::now())
+  StopTime() : StartTime(std::chrono::steady_clock::now())
   {
   }
 
@@ -22,7 +22,7 @@ public:
 
   inline double GetTimePassed() const
   {
-    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - StartTime).count() * 1000.0;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count() * 1000.0;
   }
 };
 
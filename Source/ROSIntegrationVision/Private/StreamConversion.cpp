@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StreamConversion.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "ConversionKernels.h"
+
+void StreamConversion::DepthRowToMeters(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const uint32 Row, float *Out)
+{
+  const uint8 *In = Data + Row * Stream.Stride;
+  if(Stream.Encoding == PacketFormat::EncodingF16)
+  {
+    ConversionKernels::HalfToFloat(reinterpret_cast<const uint16 *>(In), Out, Stream.Width, Stream.Scale);
+  }
+  else
+  {
+    const float *Values = reinterpret_cast<const float *>(In);
+    for(uint32 Col = 0; Col < Stream.Width; ++Col)
+    {
+      Out[Col] = Values[Col] * Stream.Scale;
+    }
+  }
+}
+
+StreamConversion::Difference StreamConversion::Compare(const PacketFormat::StreamDescriptor &ColorStream, const uint8 *Color,
+                                                       const PacketFormat::StreamDescriptor &DepthStream, const uint8 *Depth,
+                                                       const FFloat16Color *ReferenceColor, const FFloat16Color *ReferenceDepth, const float ReferenceScale,
+                                                       const uint32 ColorTolerance, const float DepthTolerance)
+{
+  Difference Result = {0, 0, 0, 0, 0};
+  const uint32 Width = FMath::Min(ColorStream.Width, DepthStream.Width);
+  const uint32 Height = FMath::Min(ColorStream.Height, DepthStream.Height);
+  const uint32 ColorBytes = ColorStream.Encoding == PacketFormat::EncodingBGRA8 ? 4 : 3;
+  // Like the half float render target of the CPU path, which saturates to infinity
+  const float MaxReference = 65504.0f * ReferenceScale;
+
+  std::vector<uint8> ExpectedColor(Width * 3);
+  std::vector<uint16> ReferenceHalfs(Width);
+  std::vector<float> ExpectedDepth(Width), ActualDepth(Width);
+  for(uint32 Row = 0; Row < Height; ++Row)
+  {
+    // The reference rows are converted with the kernels of the processing threads of the CPU path
+    const FFloat16Color *ReferenceColorRow = ReferenceColor + Row * ColorStream.Width;
+    const FFloat16Color *ReferenceDepthRow = ReferenceDepth + Row * DepthStream.Width;
+    ConversionKernels::HalfToBGR8(ReferenceColorRow, ExpectedColor.data(), Width);
+    for(uint32 Col = 0; Col < Width; ++Col)
+    {
+      ReferenceHalfs[Col] = ReferenceDepthRow[Col].R.Encoded;
+    }
+    ConversionKernels::HalfToFloat(ReferenceHalfs.data(), ExpectedDepth.data(), Width, ReferenceScale);
+    DepthRowToMeters(DepthStream, Depth, Row, ActualDepth.data());
+
+    const uint8 *ColorRow = Color + Row * ColorStream.Stride;
+    for(uint32 Col = 0; Col < Width; ++Col)
+    {
+      ++Result.Pixels;
+      uint32 ColorError = 0;
+      for(uint32 Channel = 0; Channel < 3; ++Channel)
+      {
+        const int32 Delta = (int32)ColorRow[Col * ColorBytes + Channel] - (int32)ExpectedColor[Col * 3 + Channel];
+        ColorError = FMath::Max(ColorError, (uint32)std::abs(Delta));
+      }
+      Result.MaxColorError = FMath::Max(Result.MaxColorError, ColorError);
+      Result.ColorMismatches += ColorError > ColorTolerance ? 1 : 0;
+
+      const float Expected = ExpectedDepth[Col];
+      if(!std::isfinite(Expected) || Expected >= MaxReference)
+      {
+        continue;
+      }
+      // A NaN where the reference has a depth counts as the largest error
+      const float Actual = ActualDepth[Col];
+      const float Error = Actual == Actual ? std::abs(Actual - Expected) / FMath::Max(std::abs(Expected), 1e-6f) : std::numeric_limits<float>::infinity();
+      Result.MaxDepthError = FMath::Max(Result.MaxDepthError, Error);
+      Result.DepthMismatches += Error > DepthTolerance ? 1 : 0;
+    }
+  }
+  return Result;
+}
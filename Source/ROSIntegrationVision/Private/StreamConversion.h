@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PacketFormat.h"
+
+/**
+ * Conversions of packet streams into the units of the published messages, and the comparison of the streams of the
+ * GPU conversion with the CPU path. The CPU path reads half float render targets back and converts them with the
+ * conversion kernels, it is the reference the render target formats and depth materials of the GPU conversion are
+ * checked against.
+ */
+class ROSINTEGRATIONVISION_API StreamConversion
+{
+public:
+  struct Difference
+  {
+    uint32 Pixels; // Pixels compared
+    uint32 ColorMismatches; // Pixels with a color channel differing by more than the tolerance
+    uint32 MaxColorError; // Largest difference of a color channel
+    uint32 DepthMismatches; // Pixels with a depth differing by more than the tolerance
+    float MaxDepthError; // Largest relative difference of a depth
+  };
+
+  // Converts a row of an F16 or F32 depth stream into meters by the scale of the stream
+  static void DepthRowToMeters(const PacketFormat::StreamDescriptor &Stream, const uint8 *Data, const uint32 Row, float *Out);
+
+  // Compares a BGR8 or BGRA8 color and an F16 or F32 depth stream with the images the CPU path reads back: RGBA half
+  // float colors in [0, 1] and the depth in R, which ReferenceScale converts to meters. Color channels may differ by
+  // ColorTolerance and depths relatively by DepthTolerance. Depths the reference can not represent, beyond the range
+  // of half floats, are not compared.
+  static Difference Compare(const PacketFormat::StreamDescriptor &ColorStream, const uint8 *Color,
+                            const PacketFormat::StreamDescriptor &DepthStream, const uint8 *Depth,
+                            const FFloat16Color *ReferenceColor, const FFloat16Color *ReferenceDepth, const float ReferenceScale,
+                            const uint32 ColorTolerance, const float DepthTolerance);
+};
@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ThreadPlacement.h"
+
+#include <cstring>
+#include <vector>
+
+#if PLATFORM_WINDOWS
+  #include "Windows/AllowWindowsPlatformTypes.h"
+  #include <windows.h>
+  #include "Windows/HideWindowsPlatformTypes.h"
+#else
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+int32 ThreadPlacement::GetCoreCount()
+{
+#if PLATFORM_WINDOWS
+  return (int32)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#else
+  return (int32)sysconf(_SC_NPROCESSORS_CONF);
+#endif
+}
+
+TArray<int32> ThreadPlacement::ValidCores(const TArray<int32> &Cores, const int32 CoreCount)
+{
+  TArray<int32> Valid;
+  std::vector<bool> Used(FMath::Max(CoreCount, 0), false);
+  for(const int32 Core : Cores)
+  {
+    if(Core < 0 || Core >= CoreCount)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Ignoring core %d, the machine has the cores 0 to %d."), Core, CoreCount - 1);
+    }
+    else if(!Used[Core])
+    {
+      Used[Core] = true;
+      Valid.Add(Core);
+    }
+  }
+  return Valid;
+}
+
+void ThreadPlacement::Apply(const TCHAR *Name, const TArray<int32> &Cores, const int32 Priority)
+{
+  const int32 Clamped = FMath::Clamp(Priority, -2, 2);
+  const int32 CoreCount = GetCoreCount();
+  const TArray<int32> Valid = ValidCores(Cores, CoreCount);
+  if(Cores.Num() > 0 && Valid.Num() == 0)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("None of the cores of thread %s exists, it is not pinned."), Name);
+  }
+  bool Ok = true;
+
+#if PLATFORM_WINDOWS
+  FPlatformProcess::SetThreadName(Name);
+  if(Valid.Num() > 0)
+  {
+    // Finding the group of the first core, the cores of each group follow the ones of the groups before it
+    WORD Group = 0;
+    int32 First = 0;
+    while(Valid[0] >= First + (int32)GetActiveProcessorCount(Group))
+    {
+      First += GetActiveProcessorCount(Group);
+      ++Group;
+    }
+    const int32 Last = First + GetActiveProcessorCount(Group);
+
+    GROUP_AFFINITY Affinity = {};
+    Affinity.Group = Group;
+    for(const int32 Core : Valid)
+    {
+      if(Core >= First && Core < Last)
+      {
+        Affinity.Mask |= (KAFFINITY)1 << (Core - First);
+      }
+      else
+      {
+        UE_LOG(LogTemp, Warning, TEXT("Ignoring core %d of thread %s, it is not in processor group %d of core %d."), Core, Name, Group, Valid[0]);
+      }
+    }
+    Ok &= SetThreadGroupAffinity(GetCurrentThread(), &Affinity, nullptr) != 0;
+  }
+  // THREAD_PRIORITY_LOWEST to THREAD_PRIORITY_HIGHEST are -2 to 2
+  if(Clamped)
+  {
+    Ok &= SetThreadPriority(GetCurrentThread(), Clamped) != 0;
+  }
+#else
+  // Thread names are limited to 15 characters
+  char ShortName[16] = {};
+  strncpy(ShortName, TCHAR_TO_ANSI(Name), sizeof(ShortName) - 1);
+  pthread_setname_np(pthread_self(), ShortName);
+  if(Valid.Num() > 0)
+  {
+    // Allocated for all cores, cpu_set_t only holds CPU_SETSIZE of them
+    cpu_set_t *Set = CPU_ALLOC(CoreCount);
+    const size_t SetSize = CPU_ALLOC_SIZE(CoreCount);
+    CPU_ZERO_S(SetSize, Set);
+    for(const int32 Core : Valid)
+    {
+      CPU_SET_S(Core, SetSize, Set);
+    }
+    Ok &= pthread_setaffinity_np(pthread_self(), SetSize, Set) == 0;
+    CPU_FREE(Set);
+  }
+  // The nice value applies to single threads on Linux, 5 steps per priority level
+  if(Clamped)
+  {
+    Ok &= setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -5 * Clamped) == 0;
+  }
+#endif
+
+  if(!Ok)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("Could not pin thread %s to %d cores and apply priority %d."), Name, Valid.Num(), Clamped);
+  }
+}
@@ -0,0 +1,27 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Placement of the processing threads. The threads apply it to themselves when they start, so that the buffers
+ * they write are first touched from the cores, and therefore the NUMA node, they are pinned to. Cores are the
+ * logical processors numbered from 0, on Windows across all processor groups.
+ */
+class ROSINTEGRATIONVISION_API ThreadPlacement
+{
+public:
+  // Returns the number of logical processors of the machine
+  static int32 GetCoreCount();
+
+  // Returns the cores of the list that exist on a machine with CoreCount cores, in order and without duplicates.
+  // The others are dropped with a warning.
+  static TArray<int32> ValidCores(const TArray<int32> &Cores, const int32 CoreCount);
+
+  // Names the calling thread, pins it to the valid cores of the list unless it is empty and changes its priority
+  // relative to normal, from -2 (lowest) to 2 (highest). A thread only runs in one processor group on Windows, so
+  // only the cores in the group of the first one are used there. Raising the priority may need privileges, failures
+  // are logged.
+  static void Apply(const TCHAR *Name, const TArray<int32> &Cores, const int32 Priority);
+};
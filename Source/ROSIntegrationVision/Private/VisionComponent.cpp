@@ -1,23 +1,49 @@
 // Author Tim Fronsee <tfronsee21@gmail.com>
 #include "VisionComponent.h"
 
+#include <chrono>
 #include <cmath>
 #include <condition_variable>
-#include <fstream>
+#include <deque>
+#include <limits>
 #include <mutex>
 #include <thread>
-#include "immintrin.h"
 
 #include "ROSTime.h"
 #include "sensor_msgs/CameraInfo.h"
 #include "sensor_msgs/Image.h"
+#include "sensor_msgs/LaserScan.h"
+#include "sensor_msgs/PointCloud2.h"
+#include "std_msgs/Float32MultiArray.h"
 #include "tf2_msgs/TFMessage.h"
 
 #include "EngineUtils.h"
 #include "IImageWrapper.h"
 #include "IImageWrapperModule.h"
+#include "Kismet/GameplayStatics.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Misc/Paths.h"
+#include "RenderingThread.h"
+#include "SceneManagement.h"
 #include "UObject/ConstructorHelpers.h"
 
+#include "CaptureFile.h"
+#include "ConversionKernels.h"
+#include "DepthDeltaEncoder.h"
+#include "GeometryStreams.h"
+#include "LensDistortion.h"
+#include "LidarEmulation.h"
+#include "ObjectStatistics.h"
+#include "PacketBuffer.h"
+#include "PanoramaProjection.h"
+#include "PublishQueue.h"
+#include "RateController.h"
+#include "RenderTargetReadback.h"
+#include "SensorNoise.h"
+#include "StopTime.h"
+#include "StreamConversion.h"
+#include "ThreadPlacement.h"
+
 #if PLATFORM_WINDOWS
   #define _USE_MATH_DEFINES
 #endif
@@ -27,12 +53,97 @@ class ROSINTEGRATIONVISION_API UVisionComponent::PrivateData
 {
 public:
 	TSharedPtr<PacketBuffer> Buffer;
+	TSharedPtr<CaptureFileWriter> Recorder;
+	TSharedPtr<CaptureFileReader> Player;
+	TSharedPtr<DepthDeltaEncoder> DepthEncoder;
+	TSharedPtr<SensorNoise> Noise;
+	TSharedPtr<LensDistortion> Distortion;
+	// Object statistics computed by the object conversion pass, one per slot of the packet buffer so that they stay
+	// with their packet until it is published
+	std::vector<TSharedPtr<ObjectStatistics>> Statistics;
+	TSharedPtr<GeometryStreams> Geometry;
+	TSharedPtr<PublishQueue, ESPMode::ThreadSafe> Publisher;
+	TSharedPtr<RateController> RateControl;
+	TSharedPtr<PanoramaProjection> Panorama;
+	// Faces of the panorama, BGRA8 color and F32 depth in cm, read back from all face cameras with a single flush
+	AlignedBytes PanoramaColorFaces, PanoramaDepthFaces;
+	std::vector<TSharedPtr<RenderTargetReadback>> ReadbackFaces;
+	// Emulated lidars in the order of their range streams in the packet, and their points converted for publishing
+	std::vector<TSharedPtr<LidarEmulation>> Lidars;
+	std::vector<AlignedBytes> LidarPoints;
+	// Resolution set by the user, the adaptive controller steps down from it
+	uint32 BaseWidth, BaseHeight;
+	// Slot whose statistics belong to the packet that is published next, -1 if they are computed while publishing,
+	// e.g. for replayed packets
+	int32 StatisticsSlot;
+	// Copies of the pinhole images for the distortion, one per stream type so that the processing threads do not share them
+	AlignedBytes DistortionScratch[PacketFormat::StreamFlow + 1];
+	// Depth converted for publishing, reused between frames when the messages are published right away
+	AlignedBytes DepthBuffer;
+	// Lease on the packet that is published, batched payloads inside of it are not copied
+	TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe> ReadLease;
+	const uint8 *LeasedPacket;
+	uint32 LeasedSize;
+	TSharedPtr<RenderTargetReadback> ReadbackColor, ReadbackDepth, ReadbackObject;
+	// Next frame to replay and the playback time in nanoseconds passed since the previous one was published
+	uint32 PlaybackFrame;
+	uint64 PlaybackTime;
+	// Resolution and field of view the buffers and render targets are allocated for
+	uint32 ConfiguredWidth, ConfiguredHeight;
+	float ConfiguredFieldOfView;
+	bool ConfiguredGPUConversion;
+	// True until the next capture with the GPU conversion was compared with the CPU path, and the reference images
+	bool VerifyPending;
+	TArray<FFloat16Color> ReferenceColorImage, ReferenceDepthImage;
+	// Camera intrinsics cached for the configuration of the last published packet
+	uint32 IntrinsicsWidth, IntrinsicsHeight;
+	float IntrinsicsFieldOfView;
+	double FocalLength;
 	// TCPServer Server;
 	std::mutex WaitColor, WaitDepth, WaitObject, WaitDone;
-	std::condition_variable CVColor, CVDepth, CVObject, CVDone;
+	std::condition_variable CVColor, CVDepth, CVObject;
 	std::thread ThreadColor, ThreadDepth, ThreadObject;
-	bool DoColor, DoDepth, DoObject;
-	bool DoneColor, DoneObject;
+	// Images read back from the GPU, one set per slot of the packet buffer, so that the next frame can be read back
+	// while the processing threads still convert the previous ones
+	struct StagingImages
+	{
+		TArray<FFloat16Color> Color, Depth, Object;
+	};
+	std::vector<StagingImages> Staging;
+	// Slots to be converted by each processing thread in the order they were captured, and the number of conversions
+	// still running for each slot. The last conversion of a slot completes its packet.
+	std::deque<uint32> JobsColor, JobsDepth, JobsObject;
+	std::vector<uint32> ConversionsLeft;
+	// True if the current capture started a packet, false if it repeats the last one or the buffer was released
+	bool Writing;
+	uint32 Sequence;
+	// State of the scene at the last rendered capture, to detect static frames. The movable actors are collected once
+	// and then kept up to date by the spawn and level streaming delegates instead of iterating the world every frame.
+	struct ActorState
+	{
+		TWeakObjectPtr<AActor> Actor;
+		FTransform Pose, CurrentPose;
+		FBox Bounds, CurrentBounds;
+		bool Captured;
+	};
+	TArray<ActorState> StaticActors;
+	FDelegateHandle ActorSpawnedHandle, LevelAddedHandle;
+	FTransform StaticPose;
+	uint32 StaticFrames;
+	bool StaticValid;
+	// True if the current capture republishes the last packet with the given sequence number and stamp
+	bool Repeat;
+	uint32 RepeatSequence;
+	uint64 RepeatTimestamp;
+	// Number of packets captured but not published yet, at most ConfiguredPipelineDepth
+	uint32 InFlight;
+	uint32 ConfiguredPipelineDepth;
+	// Latency from capture to publish in nanoseconds, summed up over LatencyFrames, and the last average in milliseconds
+	uint64 LatencySum;
+	uint32 LatencyFrames;
+	float Latency;
+	// Monotonic time of the captures still in the pipeline, in the order they are published
+	std::deque<uint64> CaptureTimes;
 };
 
 UVisionComponent::UVisionComponent() :
@@ -40,12 +151,71 @@ Width(960),
 Height(540),
 Framerate(1),
 UseEngineFramerate(false),
+AdaptiveFramerate(false),
+MinFramerate(1),
+MaxFramerate(30),
+TargetLatency(100),
+MaxStall(0.1f),
+UseSimulationTime(false),
 ServerPort(10000),
+RecordCompressed(false),
+PlaybackRate(1),
+PlaybackLoop(false),
+UseGPUConversion(false),
+VerifyGPUConversion(false),
+UseHugePages(false),
+BatchPublish(false),
+PipelineDepth(1),
+ThreadPriority(0),
+SkipStaticFrames(false),
+StaticTranslationTolerance(0.001f),
+StaticRotationTolerance(0.05f),
+StaticRefreshInterval(30),
+PublishObjects(false),
+PublishNormals(false),
+PublishFlow(false),
+DepthDelta(false),
+DepthKeyframeInterval(30),
+DepthEncoding(EVisionDepthEncoding::Float32),
+DepthNearClip(0),
+DepthFarClip(0),
+DistortionK1(0),
+DistortionK2(0),
+DistortionP1(0),
+DistortionP2(0),
+DistortionK3(0),
+NoiseSeed(0),
+DepthNoise(0),
+DepthQuantization(0),
+DepthEdgeThreshold(0.1f),
+DepthEdgeDropout(0),
+ColorShotNoise(0),
+ColorReadNoise(0),
+Panorama(EVisionPanorama::None),
+PanoramaFaceSize(0),
 FrameTime(1.0f / Framerate),
 TimePassed(0),
-ColorsUsed(0)
+ColorsUsed(0),
+Rigged(false),
+Lockstep(false),
+StereoBaseline(0)
 {
     Priv = new PrivateData();
+    Priv->IntrinsicsWidth = 0;
+    Priv->IntrinsicsHeight = 0;
+    Priv->IntrinsicsFieldOfView = 0;
+    Priv->InFlight = 0;
+    Priv->LatencySum = 0;
+    Priv->LatencyFrames = 0;
+    Priv->Latency = 0;
+    Priv->LeasedPacket = nullptr;
+    Priv->LeasedSize = 0;
+    Priv->BaseWidth = 0;
+    Priv->BaseHeight = 0;
+    DepthMaterial = nullptr;
+    MaterialDepthInstance = nullptr;
+    ReferenceColor = nullptr;
+    ReferenceDepth = nullptr;
     FieldOfView = 90.0;
     PrimaryComponentTick.bCanEverTick = true;
     PrimaryComponentTick.bStartWithTickEnabled = true;
@@ -83,6 +253,9 @@ ColorsUsed(0)
     DepthPublisher = NewObject<UTopic>(UTopic::StaticClass());
     ImagePublisher = NewObject<UTopic>(UTopic::StaticClass());
     TFPublisher = NewObject<UTopic>(UTopic::StaticClass());
+    ObjectPublisher = NewObject<UTopic>(UTopic::StaticClass());
+    NormalsPublisher = NewObject<UTopic>(UTopic::StaticClass());
+    FlowPublisher = NewObject<UTopic>(UTopic::StaticClass());
 }
 
 UVisionComponent::~UVisionComponent()
@@ -107,42 +280,330 @@ bool UVisionComponent::IsPaused() const
     return Paused;
 }
 
+void UVisionComponent::SetResolution(const uint32 _Width, const uint32 _Height, const float _FieldOfView)
+{
+    // Applied by TickComponent before the next capture
+    Width = _Width;
+    Height = _Height;
+    FieldOfView = _FieldOfView;
+    // The adaptive controller keeps its step on the ladder below the new resolution
+    Priv->BaseWidth = _Width;
+    Priv->BaseHeight = _Height;
+    if (Priv->RateControl.IsValid() && Priv->RateControl->GetStep() > 0)
+    {
+        Width = ResolutionLadder[Priv->RateControl->GetStep() - 1].X;
+        Height = ResolutionLadder[Priv->RateControl->GetStep() - 1].Y;
+    }
+}
+
+void UVisionComponent::SetRig(const bool _Rigged, const float _StereoBaseline)
+{
+    Rigged = _Rigged;
+    StereoBaseline = _StereoBaseline;
+}
+
+void UVisionComponent::SetLockstep()
+{
+    Lockstep = true;
+    Color->bCaptureEveryFrame = false;
+    Depth->bCaptureEveryFrame = false;
+    Object->bCaptureEveryFrame = false;
+}
+
+void UVisionComponent::Configure()
+{
+	// Batched messages lease the slot of their packet until they are published, one more slot keeps the capture from waiting for them
+	const uint32 SlotCount = FMath::Max(PipelineDepth, 1) + (BatchPublish ? 1 : 0);
+	// Auxiliary streams follow the image streams in the packet, they are only part of it if they are enabled. Like
+	// the lens distortion they need a pinhole camera, so panoramas have none.
+	const bool Pinhole = Panorama == EVisionPanorama::None;
+	const std::vector<PacketBuffer::StreamDescriptor> Auxiliary = Pinhole ? PacketBuffer::AuxiliaryStreams(Width, Height, PublishNormals, PublishFlow)
+		: std::vector<PacketBuffer::StreamDescriptor>();
+	std::vector<PacketBuffer::StreamDescriptor> Streams;
+
+	Priv->Panorama.Reset();
+	Priv->VerifyPending = false;
+	if (!Pinhole)
+	{
+		// The faces are rendered in the formats of the GPU conversion and stitched on the CPU, the cameras of the
+		// component itself are not used
+		Priv->Staging.clear();
+
+		const uint32 FaceSize = PanoramaFaceSize > 0 ? PanoramaFaceSize : FMath::Max<uint32>(Width / 4, 1);
+		for (int32 Face = 0; Face < PanoramaColor.Num(); ++Face)
+		{
+			PanoramaColor[Face]->TextureTarget->InitCustomFormat(FaceSize, FaceSize, PF_B8G8R8A8, true);
+			PanoramaDepth[Face]->TextureTarget->RenderTargetFormat = ETextureRenderTargetFormat::RTF_R32f;
+			PanoramaDepth[Face]->TextureTarget->InitAutoFormat(FaceSize, FaceSize);
+		}
+		Priv->PanoramaColorFaces.resize(PanoramaProjection::FaceCount * FaceSize * FaceSize * 4);
+		Priv->PanoramaDepthFaces.resize(PanoramaProjection::FaceCount * FaceSize * FaceSize * sizeof(float));
+		Priv->Panorama = TSharedPtr<PanoramaProjection>(new PanoramaProjection(Width, Height, FaceSize,
+			Panorama == EVisionPanorama::Equirectangular ? PanoramaProjection::Equirectangular : PanoramaProjection::Cylindrical, FieldOfView));
+
+		Streams = PacketBuffer::PanoramaStreams(Width, Height);
+	}
+	else if (UseGPUConversion)
+	{
+		// The render targets already have the formats of the packet streams, so they are copied without conversion
+		Priv->Staging.clear();
+
+		Color->TextureTarget->InitCustomFormat(Width, Height, PF_B8G8R8A8, true);
+		Object->TextureTarget->InitCustomFormat(Width, Height, PF_B8G8R8A8, true);
+		Depth->TextureTarget->RenderTargetFormat = ETextureRenderTargetFormat::RTF_R32f;
+		Depth->TextureTarget->InitAutoFormat(Width, Height);
+		// The depth material outputs meters in the final color, otherwise the raw scene depth in centimeters is used
+		Depth->CaptureSource = MaterialDepthInstance ? ESceneCaptureSource::SCS_FinalColorHDR : ESceneCaptureSource::SCS_SceneDepth;
+
+		Streams = PacketBuffer::GPUStreams(Width, Height, MaterialDepthInstance ? 1.0f : 0.01f);
+
+		// The next frame is also captured into half float render targets like on the CPU path and compared
+		if (VerifyGPUConversion)
+		{
+			if (!ReferenceColor)
+			{
+				ReferenceColor = NewObject<UTextureRenderTarget2D>(this);
+				ReferenceDepth = NewObject<UTextureRenderTarget2D>(this);
+			}
+			ReferenceColor->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA16f;
+			ReferenceColor->InitAutoFormat(Width, Height);
+			ReferenceDepth->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA16f;
+			ReferenceDepth->InitAutoFormat(Width, Height);
+			Priv->VerifyPending = true;
+		}
+	}
+	else
+	{
+		// Initializing buffers for reading images from the GPU, they are only reallocated if the size changed
+		Priv->Staging.resize(SlotCount);
+		for (PrivateData::StagingImages &Images : Priv->Staging)
+		{
+			Images.Color.SetNumUninitialized(Width * Height);
+			Images.Depth.SetNumUninitialized(Width * Height);
+			Images.Object.SetNumUninitialized(Width * Height);
+		}
+
+		// Reinit renderer
+		Color->TextureTarget->InitAutoFormat(Width, Height);
+		Depth->TextureTarget->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA16f;
+		Depth->TextureTarget->InitAutoFormat(Width, Height);
+		Object->TextureTarget->InitAutoFormat(Width, Height);
+		Depth->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+
+		Streams = PacketBuffer::DefaultStreams(Width, Height);
+	}
+	// Creating the ring of packet buffers, the ranges of the lidars follow the other streams
+	Streams.insert(Streams.end(), Auxiliary.begin(), Auxiliary.end());
+	for (const TSharedPtr<LidarEmulation> &Lidar : Priv->Lidars)
+	{
+		const LidarEmulation::Settings &Settings = Lidar->GetSettings();
+		Streams.push_back({PacketFormat::StreamRanges, PacketFormat::EncodingF32, Settings.Columns, Settings.Rings, 0, 0, 0, 1.0f});
+	}
+	// The GPU conversion and panoramas render float depth, which is published as 32FC1. Only warned about once and
+	// not again when the buffer is reallocated for a new resolution.
+	const bool FloatDepthBefore = Priv->Buffer.IsValid()
+		&& Priv->Buffer->Streams[Priv->Buffer->FindStream(PacketFormat::StreamDepth)].Encoding == PacketFormat::EncodingF32;
+	Priv->Buffer = TSharedPtr<PacketBuffer>(new PacketBuffer(Width, Height, FieldOfView, Streams, UseHugePages, SlotCount));
+	Priv->ConversionsLeft.assign(SlotCount, 0);
+	if (DepthEncoding == EVisionDepthEncoding::HalfPassthrough && !FloatDepthBefore
+		&& Priv->Buffer->Streams[Priv->Buffer->FindStream(PacketFormat::StreamDepth)].Encoding == PacketFormat::EncodingF32)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("16FC1 depth needs the half float depth of the CPU conversion, %s publishes 32FC1 with the GPU conversion or a panorama."), *GetName());
+	}
+
+	// The object image only contains colored objects, they are colored when play begins
+	Priv->Statistics.clear();
+	Priv->StatisticsSlot = -1;
+	if (PublishObjects && Pinhole)
+	{
+		for (uint32 Slot = 0; Slot < SlotCount; ++Slot)
+		{
+			Priv->Statistics.push_back(TSharedPtr<ObjectStatistics>(new ObjectStatistics()));
+		}
+	}
+	if (Priv->Panorama.IsValid())
+	{
+		Priv->Buffer->SetFieldOfView(360.0f, Priv->Panorama->GetFieldOfViewY());
+	}
+
+	Color->FOVAngle = FieldOfView;
+	Depth->FOVAngle = FieldOfView;
+	Object->FOVAngle = FieldOfView;
+
+	AspectRatio = Width / (float)Height;
+
+	// The remap table of the lens distortion and the rays of the auxiliary streams only depend on the configuration,
+	// the intrinsics match the camera info
+	const float FieldOfViewX = Height > Width ? FieldOfView * Width / Height : FieldOfView;
+	const double Focal = Width / 2.0 / std::tan(FieldOfViewX * PI / 360.0);
+	Priv->Geometry.Reset();
+	if (!Auxiliary.empty())
+	{
+		Priv->Geometry = TSharedPtr<GeometryStreams>(new GeometryStreams(Width, Height, Focal, Width / 2.0, Height / 2.0));
+	}
+
+	const LensDistortion::Coefficients Coefficients = {DistortionK1, DistortionK2, DistortionP1, DistortionP2, DistortionK3};
+	Priv->Distortion.Reset();
+	if (Pinhole && LensDistortion::IsEnabled(Coefficients))
+	{
+		Priv->Distortion = TSharedPtr<LensDistortion>(new LensDistortion(Width, Height, Focal, Width / 2.0, Height / 2.0, Coefficients));
+	}
+
+	Priv->ConfiguredWidth = Width;
+	Priv->ConfiguredHeight = Height;
+	Priv->ConfiguredFieldOfView = FieldOfView;
+	Priv->ConfiguredGPUConversion = UseGPUConversion;
+	Priv->ConfiguredPipelineDepth = FMath::Max(PipelineDepth, 1);
+	// The new buffer does not contain a packet that could be republished
+	Priv->StaticValid = false;
+}
+
 void UVisionComponent::InitializeComponent()
 {
     Super::InitializeComponent();
 }
 
+void UVisionComponent::OnRegister()
+{
+	Super::OnRegister();
+	// The actor only registers the captures together with its own components. A vision component created at runtime,
+	// e.g. by a rig, is registered after that and has to register its captures itself, otherwise they never render.
+	for (USceneCaptureComponent2D *Capture : { Color, Depth, Object })
+	{
+		if (Capture && !Capture->IsRegistered() && GetOwner())
+		{
+			Capture->RegisterComponent();
+		}
+	}
+}
+
 void UVisionComponent::BeginPlay()
 {
   Super::BeginPlay();
-    // Initializing buffers for reading images from the GPU
-	ImageColor.AddUninitialized(Width * Height);
-	ImageDepth.AddUninitialized(Width * Height);
-	ImageObject.AddUninitialized(Width * Height);
+	// Computing the depth in meters on the GPU, applied to the depth capture by Configure
+	if (DepthMaterial)
+	{
+		MaterialDepthInstance = UMaterialInstanceDynamic::Create(DepthMaterial, this);
+		Depth->PostProcessSettings.AddBlendable(MaterialDepthInstance, 1.0f);
+	}
 
-	// Reinit renderer
-	Color->TextureTarget->InitAutoFormat(Width, Height);
-	Depth->TextureTarget->InitAutoFormat(Width, Height);
-	Object->TextureTarget->InitAutoFormat(Width, Height);
+	Priv->ReadbackColor = TSharedPtr<RenderTargetReadback>(new RenderTargetReadback());
+	Priv->ReadbackDepth = TSharedPtr<RenderTargetReadback>(new RenderTargetReadback());
+	Priv->ReadbackObject = TSharedPtr<RenderTargetReadback>(new RenderTargetReadback());
 
-	AspectRatio = Width / (float)Height;
+	if (Panorama != EVisionPanorama::None)
+	{
+		CreatePanoramaFaces();
+		if (PublishObjects || PublishNormals || PublishFlow || UseGPUConversion || DepthMaterial)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Panoramas only contain color and the scene depth, objects, normals, flow and the GPU conversion are not supported."));
+		}
+	}
+
+	// The lidars are sampled from the depth, their ranges are part of the packet
+	for (const FVisionLidar &Lidar : Lidars)
+	{
+		LidarEmulation::Settings Settings;
+		Settings.Rings = FMath::Max(Lidar.Rings, 1);
+		Settings.Columns = FMath::Max(Lidar.Columns, 1);
+		Settings.MinAzimuth = Lidar.MinAzimuth;
+		Settings.MaxAzimuth = Lidar.MaxAzimuth;
+		Settings.MinElevation = Lidar.MinElevation;
+		Settings.MaxElevation = Lidar.MaxElevation;
+		Settings.MinRange = Lidar.MinRange;
+		Settings.MaxRange = Lidar.MaxRange;
+		Settings.ScanTime = Lidar.ScanTime;
+		Priv->Lidars.push_back(TSharedPtr<LidarEmulation>(new LidarEmulation(Settings)));
+		Priv->LidarPoints.push_back(AlignedBytes());
+	}
+
+	// Allocating buffers and render targets
+	Configure();
 
 	// Setting flags for each camera
 	ShowFlagsLit(Color->ShowFlags);
 	ShowFlagsVertexColor(Object->ShowFlags);
 
-	// Creating double buffer and setting the pointer of the server object
-	Priv->Buffer = TSharedPtr<PacketBuffer>(new PacketBuffer(Width, Height, FieldOfView));
-
 	Running = true;
 	Paused = false;
 
-	Priv->DoColor = false;
-	Priv->DoObject = false;
-	Priv->DoDepth = false;
+	Priv->Sequence = 0;
+	Priv->Repeat = false;
+	Priv->Writing = false;
+
+	// Static frames are not rendered at all, so the captures are only rendered on demand. Panoramas only render their faces.
+	if (SkipStaticFrames || Panorama != EVisionPanorama::None)
+	{
+		Color->bCaptureEveryFrame = false;
+		Depth->bCaptureEveryFrame = false;
+		Object->bCaptureEveryFrame = false;
+	}
 
-	Priv->DoneColor = false;
-	Priv->DoneObject = false;
+	if (DepthDelta)
+	{
+		Priv->DepthEncoder = TSharedPtr<DepthDeltaEncoder>(new DepthDeltaEncoder(DepthKeyframeInterval));
+	}
+
+	// The object image only contains colored objects, so they are colored before the statistics are computed
+	if (PublishObjects && Panorama == EVisionPanorama::None)
+	{
+		ColorAllObjects();
+	}
+
+	// Sensor noise is applied by the processing threads after the conversion
+	SensorNoise::Settings NoiseSettings;
+	NoiseSettings.Seed = NoiseSeed;
+	NoiseSettings.DepthNoise = DepthNoise;
+	NoiseSettings.DepthQuantization = DepthQuantization;
+	NoiseSettings.DepthEdgeThreshold = DepthEdgeThreshold;
+	NoiseSettings.DepthEdgeDropout = DepthEdgeDropout;
+	NoiseSettings.ColorShotNoise = ColorShotNoise;
+	NoiseSettings.ColorReadNoise = ColorReadNoise;
+	if (SensorNoise::IsEnabled(NoiseSettings))
+	{
+		Priv->Noise = TSharedPtr<SensorNoise>(new SensorNoise(NoiseSettings));
+	}
+
+	// Messages are published by a background thread shared with the other cameras
+	if (BatchPublish)
+	{
+		Priv->Publisher = PublishQueue::GetShared();
+	}
+
+	// Open the capture file for recording
+	if (!RecordFile.IsEmpty())
+	{
+		const FString Filename = FPaths::IsRelative(RecordFile) ? FPaths::Combine(FPaths::ProjectSavedDir(), RecordFile) : RecordFile;
+		Priv->Recorder = TSharedPtr<CaptureFileWriter>(new CaptureFileWriter(Filename, 64 * 1024 * 1024,
+			RecordCompressed ? CaptureFile::CompressionLZ4 : CaptureFile::CompressionNone));
+	}
+
+	// Open the capture file for playback, nothing is rendered while replaying
+	if (!PlaybackFile.IsEmpty())
+	{
+		const FString Filename = FPaths::IsRelative(PlaybackFile) ? FPaths::Combine(FPaths::ProjectSavedDir(), PlaybackFile) : PlaybackFile;
+		Priv->Player = TSharedPtr<CaptureFileReader>(new CaptureFileReader(Filename));
+		if (PlaybackRate < 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Negative playback rate %f, replaying as fast as possible."), PlaybackRate);
+			PlaybackRate = 0;
+		}
+		if (Priv->Player->IsOpen())
+		{
+			Color->bCaptureEveryFrame = false;
+			Depth->bCaptureEveryFrame = false;
+			Object->bCaptureEveryFrame = false;
+			Color->bCaptureOnMovement = false;
+			Depth->bCaptureOnMovement = false;
+			Object->bCaptureOnMovement = false;
+		}
+		else
+		{
+			Priv->Player.Reset();
+		}
+		Priv->PlaybackFrame = 0;
+		Priv->PlaybackTime = 0;
+	}
 
 	// Starting threads to process image data
 	Priv->ThreadColor = std::thread(&UVisionComponent::ProcessColor, this);
@@ -158,23 +619,71 @@ void UVisionComponent::BeginPlay()
                       TEXT("tf2_msgs/TFMessage"));
 
 		CameraInfoPublisher->Init(rosinst->ROSIntegrationCore,
-                              TEXT("/unreal_ros/camera_info"),
+                              TopicNamespace + TEXT("/camera_info"),
                               TEXT("sensor_msgs/CameraInfo"));
 		CameraInfoPublisher->Advertise();
 
 		ImagePublisher->Init(rosinst->ROSIntegrationCore,
-                         TEXT("/unreal_ros/image_color"),
+                         TopicNamespace + TEXT("/image_color"),
                          TEXT("sensor_msgs/Image"));
 		ImagePublisher->Advertise();
 
 		DepthPublisher->Init(rosinst->ROSIntegrationCore,
-                         TEXT("/unreal_ros/image_depth"),
+                         TopicNamespace + (DepthDelta ? TEXT("/image_depth_delta") : TEXT("/image_depth")),
                          TEXT("sensor_msgs/Image"));
 		DepthPublisher->Advertise();
+
+		if (PublishObjects)
+		{
+			ObjectPublisher->Init(rosinst->ROSIntegrationCore,
+			                      TopicNamespace + TEXT("/objects"),
+			                      TEXT("std_msgs/Float32MultiArray"));
+			ObjectPublisher->Advertise();
+		}
+
+		if (PublishNormals)
+		{
+			NormalsPublisher->Init(rosinst->ROSIntegrationCore,
+			                       TopicNamespace + TEXT("/image_normals"),
+			                       TEXT("sensor_msgs/Image"));
+			NormalsPublisher->Advertise();
+		}
+
+		if (PublishFlow)
+		{
+			FlowPublisher->Init(rosinst->ROSIntegrationCore,
+			                    TopicNamespace + TEXT("/image_flow"),
+			                    TEXT("sensor_msgs/Image"));
+			FlowPublisher->Advertise();
+		}
+
+		for (const FVisionLidar &Lidar : Lidars)
+		{
+			UTopic *LidarPublisher = NewObject<UTopic>(UTopic::StaticClass());
+			LidarPublisher->Init(rosinst->ROSIntegrationCore,
+			                     TopicNamespace + TEXT("/") + Lidar.Topic,
+			                     Lidar.PointCloud ? TEXT("sensor_msgs/PointCloud2") : TEXT("sensor_msgs/LaserScan"));
+			LidarPublisher->Advertise();
+			LidarPublishers.Add(LidarPublisher);
+		}
 	}
 	else {
 		UE_LOG(LogTemp, Warning, TEXT("UnrealROSInstance not existing."));
 	}
+	// The adaptive controller starts at the configured rate, or at its maximum when capturing every tick
+	Priv->BaseWidth = Width;
+	Priv->BaseHeight = Height;
+	if (AdaptiveFramerate)
+	{
+		RateController::Settings Settings;
+		Settings.MinFramerate = FMath::Max(MinFramerate, 0.1f);
+		Settings.MaxFramerate = FMath::Max(MaxFramerate, Settings.MinFramerate);
+		Settings.TargetLatency = TargetLatency;
+		Settings.MaxStall = MaxStall;
+		Settings.Steps = ResolutionLadder.Num();
+		Priv->RateControl = TSharedPtr<RateController>(new RateController(Settings, UseEngineFramerate ? Settings.MaxFramerate : Framerate));
+		Framerate = Priv->RateControl->GetFramerate();
+	}
 	SetFramerate(Framerate); // Update framerate
 }
 
@@ -188,118 +697,619 @@ void UVisionComponent::TickComponent(float DeltaTime,
 	{
 		return;
 	}
-
-	// Check for framerate
-	TimePassed += DeltaTime;
-	if (!UseEngineFramerate && TimePassed < FrameTime)
+
+	// Replay recorded packets instead of capturing
+	if (Priv->Player.IsValid())
+	{
+		TickPlayback(DeltaTime);
+		FlushMessages();
+		return;
+	}
+
+	// Captures of rigged cameras are triggered by the rig
+	if (Rigged)
+	{
+		return;
+	}
+
+	if (Priv->RateControl.IsValid() && Priv->RateControl->Update(DeltaTime))
+	{
+		ApplyRateControl();
+	}
+
+	// Check for framerate, the adaptive controller also throttles captures on every tick
+	TimePassed += DeltaTime;
+	const bool EveryTick = UseEngineFramerate && (!Priv->RateControl.IsValid() || Priv->RateControl->IsUnthrottled());
+	if (!EveryTick && TimePassed < FrameTime)
+	{
+		return;
+	}
+	TimePassed -= FrameTime;
+	MEASURE_TIME("Tick");
+
+	BeginCapture(Priv->Sequence++, GetTimestamp());
+	if (Priv->ConfiguredGPUConversion || Priv->Panorama.IsValid())
+	{
+		FlushRenderingCommands();
+	}
+	FinishCapture();
+}
+
+void UVisionComponent::BeginCapture(const uint32 Sequence, const uint64 TimestampCapture)
+{
+	// Apply changes of resolution or field of view. The packets still in the pipeline are published first, holding
+	// the locks of all processing threads ensures that none of them still touches the old buffers.
+	if (Width != Priv->ConfiguredWidth || Height != Priv->ConfiguredHeight || FieldOfView != Priv->ConfiguredFieldOfView
+		|| UseGPUConversion != Priv->ConfiguredGPUConversion || (uint32)FMath::Max(PipelineDepth, 1) != Priv->ConfiguredPipelineDepth)
+	{
+		PublishCompleted(0);
+		// Batched messages still lease slots of the old buffer
+		FlushMessages();
+		if (Priv->Publisher.IsValid())
+		{
+			Priv->Publisher->Wait();
+		}
+		std::lock_guard<std::mutex> LockColor(Priv->WaitColor), LockDepth(Priv->WaitDepth), LockObject(Priv->WaitObject), LockDone(Priv->WaitDone);
+		UE_LOG(LogTemp, Display, TEXT("Reconfiguring vision component to %dx%d with a field of view of %f."), Width, Height, FieldOfView);
+		Configure();
+	}
+
+    auto owner = GetOwner();
+	owner->UpdateComponentTransforms();
+
+	// Republish the last packet while nothing in the view moves. The noise has to change every frame, so noisy
+	// frames are always rendered. Packets still in the pipeline would be published after the repeated one,
+	// so it is only repeated if the pipeline is empty.
+	Priv->Writing = false;
+	Priv->Repeat = SkipStaticFrames && !Priv->Noise.IsValid() && Priv->InFlight == 0 && IsSceneStatic();
+	if (Priv->Repeat)
+	{
+		Priv->CaptureTimes.push_back(MonotonicTime());
+		Priv->RepeatSequence = Sequence;
+		Priv->RepeatTimestamp = TimestampCapture;
+		return;
+	}
+
+	// Start writing to buffer, waits until a slot of the pipeline is free. The previous packets may still be converted
+	// by the processing threads while this one is captured.
+	{
+		StopTime Wait;
+		const bool Started = Priv->Buffer->StartWriting(ObjectToColor, ObjectColors);
+		if (Priv->RateControl.IsValid())
+		{
+			Priv->RateControl->AddStall(Wait.GetTimePassed());
+		}
+		if (!Started)
+		{
+			// The buffer was released when play ended
+			return;
+		}
+	}
+	Priv->CaptureTimes.push_back(MonotonicTime());
+	Priv->Writing = true;
+	++Priv->InFlight;
+	const uint32 Slot = Priv->Buffer->GetWriteSlot();
+
+	// The capture stamp is taken once here and carried through the packet to every message of this frame
+	Priv->Buffer->HeaderWrite->Sequence = Sequence;
+	Priv->Buffer->HeaderWrite->TimestampCapture = TimestampCapture;
+
+	FVector Translation = GetComponentLocation();
+	FQuat Rotation = GetComponentQuat();
+	// Convert to meters and ROS coordinate system
+	Priv->Buffer->HeaderWrite->Translation.X = Translation.X / 100.0f;
+	Priv->Buffer->HeaderWrite->Translation.Y = -Translation.Y / 100.0f;
+	Priv->Buffer->HeaderWrite->Translation.Z = Translation.Z / 100.0f;
+	Priv->Buffer->HeaderWrite->Rotation.X = -Rotation.X;
+	Priv->Buffer->HeaderWrite->Rotation.Y = Rotation.Y;
+	Priv->Buffer->HeaderWrite->Rotation.Z = -Rotation.Z;
+	Priv->Buffer->HeaderWrite->Rotation.W = Rotation.W;
+
+	if (Priv->Panorama.IsValid())
+	{
+		CapturePanorama();
+		return;
+	}
+
+	// Captures rendered every frame would show the world of the previous frame
+	if (SkipStaticFrames || Lockstep)
+	{
+		Color->CaptureScene();
+		Object->CaptureScene();
+		Depth->CaptureScene();
+	}
+
+	if (Priv->ConfiguredGPUConversion)
+	{
+		if (Priv->VerifyPending)
+		{
+			CaptureReference();
+		}
+		// The images are already converted on the GPU, the copies into the packet are only enqueued here,
+		// so that the readbacks of several cameras complete with a single flush before FinishCapture
+		ReadImageRaw(Color->TextureTarget, *Priv->ReadbackColor, Priv->Buffer->FindStream(PacketFormat::StreamColor));
+		ReadImageRaw(Object->TextureTarget, *Priv->ReadbackObject, Priv->Buffer->FindStream(PacketFormat::StreamObject));
+		ReadImageRaw(Depth->TextureTarget, *Priv->ReadbackDepth, Priv->Buffer->FindStream(PacketFormat::StreamDepth));
+		if (Priv->VerifyPending)
+		{
+			// Flushes the rendering commands, so the raw readbacks are complete as well
+			ReadImage(ReferenceColor, Priv->ReferenceColorImage);
+			ReadImage(ReferenceDepth, Priv->ReferenceDepthImage);
+		}
+	}
+	else
+	{
+		// The staging images of the slot are not used by the processing threads until its jobs are queued
+		PrivateData::StagingImages &Images = Priv->Staging[Slot];
+		{
+			std::lock_guard<std::mutex> Lock(Priv->WaitDone);
+			Priv->ConversionsLeft[Slot] = 3;
+		}
+
+		// Read color image and notify processing thread
+		ReadImage(Color->TextureTarget, Images.Color);
+		{
+			std::lock_guard<std::mutex> Lock(Priv->WaitColor);
+			Priv->JobsColor.push_back(Slot);
+		}
+		Priv->CVColor.notify_one();
+
+		// Read object image and notify processing thread
+		ReadImage(Object->TextureTarget, Images.Object);
+		{
+			std::lock_guard<std::mutex> Lock(Priv->WaitObject);
+			Priv->JobsObject.push_back(Slot);
+		}
+		Priv->CVObject.notify_one();
+
+		/* Read depth image and notify processing thread. Depth processing is called last,
+		 * because the color image processing thread take more time so they can already begin.
+		 * The last of the three processing threads done with the slot completes its packet.
+		 */
+		ReadImage(Depth->TextureTarget, Images.Depth);
+		{
+			std::lock_guard<std::mutex> Lock(Priv->WaitDepth);
+			Priv->JobsDepth.push_back(Slot);
+		}
+		Priv->CVDepth.notify_one();
+	}
+}
+
+void UVisionComponent::FinishCapture()
+{
+	if (Priv->Repeat)
+	{
+		// The last packet is still in its slot, only sequence number and stamp are updated
+		Priv->Buffer->RestartReading();
+		Priv->Buffer->HeaderRead->Sequence = Priv->RepeatSequence;
+		Priv->Buffer->HeaderRead->TimestampCapture = Priv->RepeatTimestamp;
+		PublishRead();
+		FlushMessages();
+		return;
+	}
+
+	// The rendering commands have been flushed, so the raw readbacks are complete. Nothing was captured if the buffer
+	// was released.
+	const uint32 Slot = Priv->Buffer->GetWriteSlot();
+	if (Priv->Writing && Priv->Panorama.IsValid())
+	{
+		StitchPanorama();
+		ComputeLidars(Slot);
+		ApplyNoise(PacketFormat::StreamColor, Slot);
+		ApplyNoise(PacketFormat::StreamDepth, Slot);
+		Priv->Buffer->DoneWriting(Slot);
+	}
+	else if (Priv->Writing && Priv->ConfiguredGPUConversion)
+	{
+		// Compared before the distortion and noise are applied, the reference has neither
+		if (Priv->VerifyPending)
+		{
+			VerifyConversion(Slot);
+			Priv->VerifyPending = false;
+		}
+		ComputeGeometry(Slot);
+		ComputeLidars(Slot);
+		ApplyDistortion(PacketFormat::StreamColor, Slot);
+		ApplyDistortion(PacketFormat::StreamDepth, Slot);
+		ApplyDistortion(PacketFormat::StreamObject, Slot);
+		ApplyDistortion(PacketFormat::StreamNormals, Slot);
+		ApplyDistortion(PacketFormat::StreamFlow, Slot);
+		ComputeObjects(Slot);
+		ApplyNoise(PacketFormat::StreamColor, Slot);
+		ApplyNoise(PacketFormat::StreamDepth, Slot);
+		Priv->Buffer->DoneWriting(Slot);
+	}
+	Priv->Writing = false;
+
+	// Publishes the completed packets, waits for the oldest ones if the pipeline is full
+	PublishCompleted(Priv->ConfiguredPipelineDepth - 1);
+	FlushMessages();
+}
+
+void UVisionComponent::WaitPublished()
+{
+	PublishCompleted(0);
+	FlushMessages();
+	if (Priv->Publisher.IsValid())
+	{
+		Priv->Publisher->Wait();
+	}
+}
+
+// Publishes the completed packets in the order they were captured. Waits until at most MaxInFlight packets are
+// left in the pipeline, the others are only published if they are already complete.
+void UVisionComponent::PublishCompleted(const uint32 MaxInFlight)
+{
+	while (Priv->InFlight > 0)
+	{
+		if (Priv->InFlight > MaxInFlight)
+		{
+			MEASURE_TIME("Wait for processing threads");
+			StopTime Wait;
+			const bool Started = Priv->Buffer->StartReading();
+			if (Priv->RateControl.IsValid())
+			{
+				Priv->RateControl->AddStall(Wait.GetTimePassed());
+			}
+			if (!Started)
+			{
+				break;
+			}
+		}
+		else if (!Priv->Buffer->TryStartReading())
+		{
+			break;
+		}
+		--Priv->InFlight;
+		PublishRead();
+	}
+}
+
+// Records and publishes the packet that is currently read and frees its slot
+void UVisionComponent::PublishRead()
+{
+	Priv->Buffer->HeaderRead->TimestampSent = GetTimestamp();
+
+	if (Priv->Recorder.IsValid())
+	{
+		Priv->Recorder->Append(Priv->Buffer->Read, Priv->Buffer->HeaderRead->Size, Priv->Buffer->HeaderRead->TimestampCapture, Priv->Buffer->HeaderRead->Sequence);
+	}
+
+	// Batched messages reference the payloads of the packet, its slot is not written again until they are published
+	if (Priv->Publisher.IsValid())
+	{
+		Priv->ReadLease = Priv->Buffer->LeaseRead();
+		Priv->LeasedPacket = Priv->Buffer->Read;
+		Priv->LeasedSize = Priv->Buffer->HeaderRead->Size;
+	}
+
+	// The statistics of the packet were computed by its object conversion pass, a repeated packet still has them
+	Priv->StatisticsSlot = Priv->Statistics.empty() ? -1 : (int32)Priv->Buffer->GetReadSlot();
+	PublishPacket(Priv->Buffer->Read, Priv->Buffer->HeaderRead->Size, Priv->Buffer->HeaderRead->Sequence, Priv->Buffer->HeaderRead->TimestampCapture);
+
+	Priv->ReadLease.Reset();
+	Priv->LeasedPacket = nullptr;
+	Priv->LeasedSize = 0;
+
+	// Latency from the capture to the publish, logged periodically together with the depth of the pipeline. It is measured
+	// on the monotonic clock, the stamps may be simulation time
+	uint64 FrameLatency = 0;
+	if (!Priv->CaptureTimes.empty())
+	{
+		FrameLatency = MonotonicTime() - Priv->CaptureTimes.front();
+		Priv->CaptureTimes.pop_front();
+	}
+	Priv->LatencySum += FrameLatency;
+	if (Priv->RateControl.IsValid())
+	{
+		Priv->RateControl->AddLatency(FrameLatency / 1000000.0);
+	}
+	if (++Priv->LatencyFrames == 100)
+	{
+		Priv->Latency = Priv->LatencySum / 100 / 1000000.0f;
+		Priv->LatencySum = 0;
+		Priv->LatencyFrames = 0;
+		UE_LOG(LogTemp, Log, TEXT("Vision component %s: pipeline depth %d, %f ms latency from capture to publish."), *GetName(), Priv->ConfiguredPipelineDepth, Priv->Latency);
+	}
+
+	Priv->Buffer->DoneReading();
+}
+
+void UVisionComponent::TickPlayback(const float DeltaTime)
+{
+	// Limits the number of packets published in one tick, when replaying as fast as possible
+	const uint32 MaxFramesPerTick = 100;
+	CaptureFileReader &Player = *Priv->Player;
+
+	// Negative rates can not be converted into a time step, they replay as fast as possible like 0
+	const float Rate = FMath::Max(PlaybackRate, 0.0f);
+	Priv->PlaybackTime += (uint64)(DeltaTime * Rate * 1000000000.0);
+
+	for (uint32 Published = 0; Published < MaxFramesPerTick; ++Published)
+	{
+		if (Priv->PlaybackFrame >= Player.GetFrames())
+		{
+			if (!PlaybackLoop)
+			{
+				return;
+			}
+			Priv->PlaybackFrame = 0;
+			Priv->PlaybackTime = 0;
+		}
+
+		// Keep the original timing of the recording, scaled by the playback rate. Frames are paced by the time to the
+		// previous one, stamps going backwards, e.g. after the simulation time was reset, replay the frame right away.
+		const uint64 FrameStamp = Player.GetEntry(Priv->PlaybackFrame).TimestampCapture;
+		const uint64 PreviousStamp = Priv->PlaybackFrame > 0 ? Player.GetEntry(Priv->PlaybackFrame - 1).TimestampCapture : FrameStamp;
+		const uint64 FrameTimeRecorded = FrameStamp > PreviousStamp ? FrameStamp - PreviousStamp : 0;
+		if (Rate > 0)
+		{
+			if (FrameTimeRecorded > Priv->PlaybackTime)
+			{
+				break;
+			}
+			Priv->PlaybackTime -= FrameTimeRecorded;
+		}
+
+		const uint8 *Packet = Player.ReadFrame(Priv->PlaybackFrame);
+		Player.Prefetch(Priv->PlaybackFrame + 1);
+		if (Packet)
+		{
+			PublishPacket(Packet, Player.GetEntry(Priv->PlaybackFrame).Size, Priv->Sequence++, GetTimestamp());
+		}
+		++Priv->PlaybackFrame;
+	}
+}
+
+// Publishes the images, TF and camera info of a complete packet, either captured or replayed
+void UVisionComponent::PublishPacket(const uint8 *Packet, const uint32 Size, const uint32 Sequence, const uint64 TimestampCapture)
+{
+	PacketFormat::Packet Parsed;
+	const PacketFormat::ParseResult Result = PacketFormat::Parse(Packet, Size, Parsed);
+	if (Result != PacketFormat::ParseOk)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Dropping invalid packet %d, parser error %d."), Sequence, (int32)Result);
+		return;
+	}
+
+	const PacketBuffer::PacketHeader *Header = Parsed.Header;
+	const PacketFormat::StreamDescriptor *ColorStream = PacketFormat::FindStream(Parsed, PacketFormat::StreamColor);
+	const PacketFormat::StreamDescriptor *DepthStream = PacketFormat::FindStream(Parsed, PacketFormat::StreamDepth);
+	if (!ColorStream || (ColorStream->Encoding != PacketFormat::EncodingBGR8 && ColorStream->Encoding != PacketFormat::EncodingBGRA8)
+		|| !DepthStream || (DepthStream->Encoding != PacketFormat::EncodingF16 && DepthStream->Encoding != PacketFormat::EncodingF32))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Dropping packet %d without BGR8/BGRA8 color and F16/F32 depth streams."), Sequence);
+		return;
+	}
+	const uint32 PacketWidth = Header->Width;
+	const uint32 PacketHeight = Header->Height;
+
+	// * - Depth image data (width * height * 2 Bytes (Float16) or 4 Bytes (Float32))
+	const uint8_t* DepthPtr = PacketFormat::StreamData(Parsed, *DepthStream);
+	const uint8_t* DepthData = DepthPtr;
+	const TCHAR *DepthEncodingName = TEXT("32FC1");
+	uint32 DepthWidth = DepthStream->Width;
+	uint32 DepthHeight = DepthStream->Height;
+	uint32 DepthStep = DepthStream->Width * 4;
+	// True if the depth was converted into a buffer that stays valid until the message is published
+	bool DepthConverted = false;
+
+	// Clipping range in meters, like real sensor drivers invalid depth is NaN for 32FC1 and 0 for 16UC1 (REP 118)
+	const bool Clipping = DepthNearClip > 0 || DepthFarClip > 0;
+	const float Near = DepthNearClip;
+	const float Far = DepthFarClip > 0 ? DepthFarClip : std::numeric_limits<float>::infinity();
+
+	if (Priv->DepthEncoder.IsValid())
+	{
+		// Delta encoded depth keeps the samples of the packet. The encoded frame is published as a single row,
+		// the image size is part of the frame header.
+		const AlignedBytes &Encoded = Priv->DepthEncoder->Encode(*DepthStream, DepthPtr, DepthStream->Scale, Sequence);
+		DepthData = Encoded.data();
+		DepthEncodingName = TEXT("rivdelta");
+		DepthWidth = Encoded.size();
+		DepthHeight = 1;
+		DepthStep = Encoded.size();
+	}
+	else if (DepthEncoding == EVisionDepthEncoding::Millimeters16)
+	{
+		uint8 *DepthOut = DepthOutput(DepthStream->Width * DepthStream->Height * 2);
+		for (uint32 Row = 0; Row < DepthStream->Height; ++Row)
+		{
+			uint16 *Out = (uint16 *)DepthOut + Row * DepthStream->Width;
+			if (DepthStream->Encoding == PacketFormat::EncodingF16)
+			{
+				ConversionKernels::HalfToMillimeters((const uint16 *)(DepthPtr + Row * DepthStream->Stride), Out, DepthStream->Width, DepthStream->Scale, Near, Far);
+			}
+			else
+			{
+				ConversionKernels::FloatToMillimeters((const float *)(DepthPtr + Row * DepthStream->Stride), Out, DepthStream->Width, DepthStream->Scale, Near, Far);
+			}
+		}
+		DepthData = DepthOut;
+		DepthConverted = true;
+		DepthEncodingName = TEXT("16UC1");
+		DepthStep = DepthStream->Width * 2;
+	}
+	else if (DepthEncoding == EVisionDepthEncoding::HalfPassthrough && DepthStream->Encoding == PacketFormat::EncodingF16)
+	{
+		// The half floats of the packet are published without conversion, in the unit of the packet stream
+		DepthEncodingName = TEXT("16FC1");
+		DepthStep = DepthStream->Stride;
+		if (Clipping)
+		{
+			const uint16 HalfNaN = 0x7E00;
+			const size_t Count = DepthStream->Stride * DepthStream->Height / 2;
+			uint8 *DepthOut = DepthOutput(Count * 2);
+			const uint16 *In = (const uint16 *)DepthPtr;
+			uint16 *Out = (uint16 *)DepthOut;
+			FFloat16 Value;
+			for (size_t i = 0; i < Count; ++i)
+			{
+				Value.Encoded = In[i];
+				const float Meters = (float)Value * DepthStream->Scale;
+				Out[i] = Meters >= Near && Meters <= Far ? In[i] : HalfNaN;
+			}
+			DepthData = DepthOut;
+			DepthConverted = true;
+		}
+	}
+	// Depth converted to meters on the GPU is published straight from the packet
+	else if (DepthStream->Encoding != PacketFormat::EncodingF32 || DepthStream->Scale != 1.0f || DepthStream->Stride != DepthStream->Width * 4 || Clipping)
 	{
-		return;
+		uint8 *DepthOut = DepthOutput(DepthStream->Width * DepthStream->Height * 4);
+		for (uint32 Row = 0; Row < DepthStream->Height; ++Row)
+		{
+			float *Out = (float *)DepthOut + Row * DepthStream->Width;
+			StreamConversion::DepthRowToMeters(*DepthStream, DepthPtr, Row, Out);
+			if (Clipping)
+			{
+				for (uint32 Col = 0; Col < DepthStream->Width; ++Col)
+				{
+					Out[Col] = Out[Col] >= Near && Out[Col] <= Far ? Out[Col] : std::numeric_limits<float>::quiet_NaN();
+				}
+			}
+		}
+		DepthData = DepthOut;
+		DepthConverted = true;
 	}
-	TimePassed -= FrameTime;
-	MEASURE_TIME("Tick");
-
-    auto owner = GetOwner();
-	owner->UpdateComponentTransforms();
 
-	FDateTime Now = FDateTime::UtcNow();
-	Priv->Buffer->HeaderWrite->TimestampCapture = Now.ToUnixTimestamp() * 1000000000 + Now.GetMillisecond() * 1000000;
-
-	FVector Translation = GetComponentLocation();
-	FQuat Rotation = GetComponentQuat();
-	// Convert to meters and ROS coordinate system
-	Priv->Buffer->HeaderWrite->Translation.X = Translation.X / 100.0f;
-	Priv->Buffer->HeaderWrite->Translation.Y = -Translation.Y / 100.0f;
-	Priv->Buffer->HeaderWrite->Translation.Z = Translation.Z / 100.0f;
-	Priv->Buffer->HeaderWrite->Rotation.X = -Rotation.X;
-	Priv->Buffer->HeaderWrite->Rotation.Y = Rotation.Y;
-	Priv->Buffer->HeaderWrite->Rotation.Z = -Rotation.Z;
-	Priv->Buffer->HeaderWrite->Rotation.W = Rotation.W;
+	UE_LOG(LogTemp, Verbose, TEXT("Stream Offsets: %d %d"), ColorStream->Offset, DepthStream->Offset);
 
-	// Start writing to buffer
-	Priv->Buffer->StartWriting(ObjectToColor, ObjectColors);
-
-	// Read color image and notify processing thread
-	Priv->WaitColor.lock();
-	ReadImage(Color->TextureTarget, ImageColor);
-	Priv->WaitColor.unlock();
-	Priv->DoColor = true;
-	Priv->CVColor.notify_one();
-
-	// Read object image and notify processing thread
-	Priv->WaitObject.lock();
-	ReadImage(Object->TextureTarget, ImageObject);
-	Priv->WaitObject.unlock();
-	Priv->DoObject = true;
-	Priv->CVObject.notify_one();
-
-	/* Read depth image and notify processing thread. Depth processing is called last,
-	 * because the color image processing thread take more time so they can already begin.
-	 * The depth processing thread will wait for the others to be finished and then releases
-	 * the buffer.
-	 */
-	Priv->WaitDepth.lock();
-	ReadImage(Depth->TextureTarget, ImageDepth);
-	Priv->WaitDepth.unlock();
-	Priv->DoDepth = true;
-	Priv->CVDepth.notify_one();
-
-	Priv->Buffer->StartReading();
-	uint32_t xSize = Priv->Buffer->HeaderRead->Size;
-	uint32_t xSizeHeader = Priv->Buffer->HeaderRead->SizeHeader; // Size of the header
-	uint32_t xMapEntries = Priv->Buffer->HeaderRead->MapEntries; // Number of map entries at the end of the packet
-	uint32_t xWidth = Priv->Buffer->HeaderRead->Width; // Width of the images
-	uint32_t xHeight = Priv->Buffer->HeaderRead->Height; // Height of the images
-
-	// Get the data offsets for the different types of images that are in the buffer
-	const uint32_t& OffsetColor = Priv->Buffer->OffsetColor;
-	const uint32_t& OffsetDepth = Priv->Buffer->OffsetDepth;
-	const uint32_t& OffsetObject = Priv->Buffer->OffsetObject;
-	// * - Depth image data (width * height * 2 Bytes (Float16))
-	uint8_t* DepthPtr = &Priv->Buffer->Read[OffsetDepth];
-	uint32_t TargetDepthBufSize = Width*Height * 4;
-	uint8_t* TargetDepthBuf = new uint8_t[TargetDepthBufSize]; // Allocate a byte for every pixel * 4 Bytes for a single 32Bit Float
-
-	const uint32_t ColorImageSize = Width * Height * 3;
-	convertDepth((uint16_t *)DepthPtr, (__m128*)TargetDepthBuf);
-	// convertDepth((uint16_t *)packet.pDepth, (__m128*)&msgDepth->data[0]);
-
-	UE_LOG(LogTemp, Verbose, TEXT("Buffer Offsets: %d %d %d"), OffsetColor, OffsetDepth, OffsetObject);
-
-	FROSTime time = FROSTime::Now();
+	FROSTime time(TimestampCapture / 1000000000, TimestampCapture % 1000000000);
 
 	TSharedPtr<ROSMessages::sensor_msgs::Image> ImageMessage(new ROSMessages::sensor_msgs::Image());
 
-	ImageMessage->header.seq = 0;
+	ImageMessage->header.seq = Sequence;
 	ImageMessage->header.time = time;
 	ImageMessage->header.frame_id = ImageOpticalFrame;
-	ImageMessage->height = Height;
-	ImageMessage->width = Width;
-	ImageMessage->encoding = TEXT("bgr8");
-	ImageMessage->step = Width * 3;
-	ImageMessage->data = &Priv->Buffer->Read[OffsetColor];
-	ImagePublisher->Publish(ImageMessage);
+	ImageMessage->height = ColorStream->Height;
+	ImageMessage->width = ColorStream->Width;
+	ImageMessage->encoding = ColorStream->Encoding == PacketFormat::EncodingBGRA8 ? TEXT("bgra8") : TEXT("bgr8");
+	ImageMessage->step = ColorStream->Stride;
+	ImageMessage->data = StorePayload(PacketFormat::StreamData(Parsed, *ColorStream), ColorStream->Size);
+	PublishMessage(ImagePublisher, ImageMessage);
 
 	TSharedPtr<ROSMessages::sensor_msgs::Image> DepthMessage(new ROSMessages::sensor_msgs::Image());
 
-	DepthMessage->header.seq = 0;
+	DepthMessage->header.seq = Sequence;
 	DepthMessage->header.time = time;
 	DepthMessage->header.frame_id = ImageOpticalFrame;
-	DepthMessage->height = Height;
-	DepthMessage->width = Width;
-	DepthMessage->encoding = TEXT("32FC1");
-	DepthMessage->step = Width * 4;
-	DepthMessage->data = TargetDepthBuf;
-	DepthPublisher->Publish(DepthMessage);
+	DepthMessage->height = DepthHeight;
+	DepthMessage->width = DepthWidth;
+	DepthMessage->encoding = DepthEncodingName;
+	DepthMessage->step = DepthStep;
+	DepthMessage->data = DepthConverted ? DepthData : StorePayload(DepthData, DepthStep * DepthHeight);
+	PublishMessage(DepthPublisher, DepthMessage);
+
+	// The auxiliary streams are published straight from the packet
+	const PacketFormat::StreamDescriptor *NormalsStream = PacketFormat::FindStream(Parsed, PacketFormat::StreamNormals);
+	if (PublishNormals && NormalsStream && NormalsStream->Encoding == PacketFormat::EncodingF32C3)
+	{
+		TSharedPtr<ROSMessages::sensor_msgs::Image> NormalsMessage(new ROSMessages::sensor_msgs::Image());
+
+		NormalsMessage->header.seq = Sequence;
+		NormalsMessage->header.time = time;
+		NormalsMessage->header.frame_id = ImageOpticalFrame;
+		NormalsMessage->height = NormalsStream->Height;
+		NormalsMessage->width = NormalsStream->Width;
+		NormalsMessage->encoding = TEXT("32FC3");
+		NormalsMessage->step = NormalsStream->Stride;
+		NormalsMessage->data = StorePayload(PacketFormat::StreamData(Parsed, *NormalsStream), NormalsStream->Size);
+		PublishMessage(NormalsPublisher, NormalsMessage);
+	}
 
-	Priv->Buffer->DoneReading();
+	const PacketFormat::StreamDescriptor *FlowStream = PacketFormat::FindStream(Parsed, PacketFormat::StreamFlow);
+	if (PublishFlow && FlowStream && FlowStream->Encoding == PacketFormat::EncodingF32C2)
+	{
+		TSharedPtr<ROSMessages::sensor_msgs::Image> FlowMessage(new ROSMessages::sensor_msgs::Image());
+
+		FlowMessage->header.seq = Sequence;
+		FlowMessage->header.time = time;
+		FlowMessage->header.frame_id = ImageOpticalFrame;
+		FlowMessage->height = FlowStream->Height;
+		FlowMessage->width = FlowStream->Width;
+		FlowMessage->encoding = TEXT("32FC2");
+		FlowMessage->step = FlowStream->Stride;
+		FlowMessage->data = StorePayload(PacketFormat::StreamData(Parsed, *FlowStream), FlowStream->Size);
+		PublishMessage(FlowPublisher, FlowMessage);
+	}
+
+	// The n-th range stream belongs to the n-th lidar, its beams are in the camera link frame
+	int32 Lidar = 0;
+	for (uint32 Stream = 0; Stream < Header->StreamCount && Lidar < LidarPublishers.Num() && Lidar < (int32)Priv->Lidars.size(); ++Stream)
+	{
+		const PacketFormat::StreamDescriptor &RangesStream = Parsed.Streams[Stream];
+		if (RangesStream.Type != PacketFormat::StreamRanges)
+		{
+			continue;
+		}
+		const LidarEmulation &Emulation = *Priv->Lidars[Lidar];
+		const LidarEmulation::Settings &Settings = Emulation.GetSettings();
+		if (RangesStream.Encoding != PacketFormat::EncodingF32 || RangesStream.Width != Settings.Columns || RangesStream.Height != Settings.Rings)
+		{
+			++Lidar;
+			continue;
+		}
+		const float *Ranges = reinterpret_cast<const float *>(PacketFormat::StreamData(Parsed, RangesStream));
+
+		if (Lidars[Lidar].PointCloud)
+		{
+			TSharedPtr<ROSMessages::sensor_msgs::PointCloud2> CloudMessage(new ROSMessages::sensor_msgs::PointCloud2());
+
+			CloudMessage->header.seq = Sequence;
+			CloudMessage->header.time = time;
+			CloudMessage->header.frame_id = ImageFrame;
+			CloudMessage->height = Settings.Rings;
+			CloudMessage->width = Settings.Columns;
+			const TCHAR *FieldNames[] = {TEXT("x"), TEXT("y"), TEXT("z"), TEXT("ring"), TEXT("time")};
+			const uint32 FieldOffsets[] = {offsetof(LidarEmulation::Point, X), offsetof(LidarEmulation::Point, Y), offsetof(LidarEmulation::Point, Z),
+				offsetof(LidarEmulation::Point, Ring), offsetof(LidarEmulation::Point, Time)};
+			for (int32 Field = 0; Field < 5; ++Field)
+			{
+				ROSMessages::sensor_msgs::PointField PointField;
+				PointField.name = FieldNames[Field];
+				PointField.offset = FieldOffsets[Field];
+				PointField.datatype = Field == 3 ? ROSMessages::sensor_msgs::PointField::UINT16 : ROSMessages::sensor_msgs::PointField::FLOAT32;
+				PointField.count = 1;
+				CloudMessage->fields.Add(PointField);
+			}
+			CloudMessage->is_bigendian = false;
+			CloudMessage->point_step = sizeof(LidarEmulation::Point);
+			CloudMessage->row_step = sizeof(LidarEmulation::Point) * Settings.Columns;
+			uint8 *Points = LidarOutput(Emulation.GetBeamCount() * sizeof(LidarEmulation::Point), Lidar);
+			Emulation.ToPoints(Ranges, reinterpret_cast<LidarEmulation::Point *>(Points));
+			CloudMessage->data_ptr = Points;
+			// Beams without a return are NaN
+			CloudMessage->is_dense = false;
+			PublishMessage(LidarPublishers[Lidar], CloudMessage);
+		}
+		else
+		{
+			TSharedPtr<ROSMessages::sensor_msgs::LaserScan> ScanMessage(new ROSMessages::sensor_msgs::LaserScan());
+
+			ScanMessage->header.seq = Sequence;
+			ScanMessage->header.time = time;
+			ScanMessage->header.frame_id = ImageFrame;
+			ScanMessage->angle_min = FMath::DegreesToRadians(Settings.MinAzimuth);
+			ScanMessage->angle_max = FMath::DegreesToRadians(Settings.MaxAzimuth);
+			ScanMessage->angle_increment = Settings.Columns > 1 ? (ScanMessage->angle_max - ScanMessage->angle_min) / (Settings.Columns - 1) : 0;
+			ScanMessage->time_increment = Settings.ScanTime / Settings.Columns;
+			ScanMessage->scan_time = Settings.ScanTime;
+			ScanMessage->range_min = Settings.MinRange;
+			ScanMessage->range_max = Settings.MaxRange;
+			ScanMessage->ranges.Append(Ranges, Settings.Columns);
+			PublishMessage(LidarPublishers[Lidar], ScanMessage);
+		}
+		++Lidar;
+	}
 
-	double x = Priv->Buffer->HeaderRead->Translation.X;
-	double y = Priv->Buffer->HeaderRead->Translation.Y;
-	double z = Priv->Buffer->HeaderRead->Translation.Z;
-	double rx = Priv->Buffer->HeaderRead->Rotation.X;
-	double ry = Priv->Buffer->HeaderRead->Rotation.Y;
-	double rz = Priv->Buffer->HeaderRead->Rotation.Z;
-	double rw = Priv->Buffer->HeaderRead->Rotation.W;
+	double x = Header->Translation.X;
+	double y = Header->Translation.Y;
+	double z = Header->Translation.Z;
+	double rx = Header->Rotation.X;
+	double ry = Header->Rotation.Y;
+	double rz = Header->Rotation.Z;
+	double rw = Header->Rotation.W;
 
 	if (!DisableTFPublishing) {
     // Start advertising TF only if it has yet to advertise.
@@ -309,7 +1319,7 @@ void UVisionComponent::TickComponent(float DeltaTime,
     }
 		TSharedPtr<ROSMessages::tf2_msgs::TFMessage> TFImageFrame(new ROSMessages::tf2_msgs::TFMessage());
 		ROSMessages::geometry_msgs::TransformStamped TransformImage;
-		TransformImage.header.seq = 0;
+		TransformImage.header.seq = Sequence;
 		TransformImage.header.time = time;
 		TransformImage.header.frame_id = ParentLink;
 		TransformImage.child_frame_id = ImageFrame;
@@ -323,7 +1333,7 @@ void UVisionComponent::TickComponent(float DeltaTime,
 
 		TFImageFrame->transforms.Add(TransformImage);
 
-		TFPublisher->Publish(TFImageFrame);
+		PublishMessage(TFPublisher, TFImageFrame);
 
 		// Publish optical frame
 		FRotator CameraLinkRotator(0.0, -90.0, 90.0);
@@ -331,7 +1341,7 @@ void UVisionComponent::TickComponent(float DeltaTime,
 
 		TSharedPtr<ROSMessages::tf2_msgs::TFMessage> TFOpticalFrame(new ROSMessages::tf2_msgs::TFMessage());
 		ROSMessages::geometry_msgs::TransformStamped TransformOptical;
-		TransformOptical.header.seq = 0;
+		TransformOptical.header.seq = Sequence;
 		TransformOptical.header.time = time;
 		TransformOptical.header.frame_id = ImageFrame;
 		TransformOptical.child_frame_id = ImageOpticalFrame;
@@ -345,25 +1355,82 @@ void UVisionComponent::TickComponent(float DeltaTime,
 
 		TFOpticalFrame->transforms.Add(TransformOptical);
 
-		TFPublisher->Publish(TFOpticalFrame);
+		PublishMessage(TFPublisher, TFOpticalFrame);
 	}
   // Stop advertising if TF has been disabled and is already advertising.
   else if (TFPublisher->IsAdvertising()) {
     TFPublisher->Unadvertise();
   }
 
+	// Publish the object statistics, replayed packets are reduced here instead of in the processing thread. Nothing is
+	// captured while replaying, so the statistics of the first slot are free.
+	if (!Priv->Statistics.empty())
+	{
+		const PacketFormat::StreamDescriptor *ObjectStream = PacketFormat::FindStream(Parsed, PacketFormat::StreamObject);
+		ObjectStatistics &Statistics = *Priv->Statistics[FMath::Max(Priv->StatisticsSlot, 0)];
+		if (Priv->StatisticsSlot < 0 && ObjectStream)
+		{
+			Statistics.SetMap(PacketFormat::FirstMapEntry(Parsed), Header->MapEntries);
+			Statistics.Compute(*ObjectStream, PacketFormat::StreamData(Parsed, *ObjectStream));
+		}
+		Priv->StatisticsSlot = -1;
+
+		// One row per object: ID (index of the map entry), pixel count, bounding box and centroid.
+		// The sequence number and the number of objects precede the rows.
+		const uint32 Fields = 8;
+		const std::vector<ObjectStatistics::Instance> &Instances = Statistics.GetInstances();
+		TSharedPtr<ROSMessages::std_msgs::Float32MultiArray> ObjectMessage(new ROSMessages::std_msgs::Float32MultiArray());
+		ROSMessages::std_msgs::MultiArrayDimension DimensionObjects, DimensionFields;
+		DimensionObjects.label = TEXT("objects");
+		DimensionObjects.size = Instances.size();
+		DimensionObjects.stride = Instances.size() * Fields;
+		DimensionFields.label = TEXT("id,count,min_x,min_y,max_x,max_y,centroid_x,centroid_y");
+		DimensionFields.size = Fields;
+		DimensionFields.stride = Fields;
+		ObjectMessage->layout.dim.Add(DimensionObjects);
+		ObjectMessage->layout.dim.Add(DimensionFields);
+		ObjectMessage->layout.data_offset = 2;
+
+		ObjectMessage->data.Reserve(2 + Instances.size() * Fields);
+		ObjectMessage->data.Add(Sequence);
+		ObjectMessage->data.Add(Instances.size());
+		for (const ObjectStatistics::Instance &Instance : Instances)
+		{
+			ObjectMessage->data.Add(Instance.Id);
+			ObjectMessage->data.Add(Instance.Count);
+			ObjectMessage->data.Add(Instance.MinX);
+			ObjectMessage->data.Add(Instance.MinY);
+			ObjectMessage->data.Add(Instance.MaxX);
+			ObjectMessage->data.Add(Instance.MaxY);
+			ObjectMessage->data.Add(Instance.CentroidX);
+			ObjectMessage->data.Add(Instance.CentroidY);
+		}
+		PublishMessage(ObjectPublisher, ObjectMessage);
+	}
+
 	// Construct and publish CameraInfo
 
-	const float FOVX = Height > Width ? FieldOfView * Width / Height : FieldOfView;
-	const float FOVY = Width > Height ? FieldOfView * Height / Width : FieldOfView;
-	double halfFOVX = FOVX * PI / 360.0; // was M_PI on gcc
-	double halfFOVY = FOVY * PI / 360.0; // was M_PI on gcc
-	const double cX = Width / 2.0;
-	const double cY = Height / 2.0;
+	// Panoramas have no pinhole intrinsics. The forward direction of the camera is at the principal point, fx are the
+	// pixels per radian of longitude and fy the pixels per radian of latitude (equirectangular) or the focal length of
+	// the projection onto the cylinder.
+	const bool Panoramic = Header->FieldOfViewX >= 360.0f;
+	const bool Equirectangular = Panoramic && Header->FieldOfViewY >= 180.0f;
+
+	// The intrinsics are only computed again if the configuration of the packets changed
+	if (Priv->IntrinsicsWidth != PacketWidth || Priv->IntrinsicsHeight != PacketHeight || Priv->IntrinsicsFieldOfView != Header->FieldOfViewX)
+	{
+		double halfFOVX = Header->FieldOfViewX * PI / 360.0; // was M_PI on gcc
+		Priv->FocalLength = Panoramic ? PacketWidth / (2.0 * PI) : PacketWidth / 2.0 / std::tan(halfFOVX);
+		Priv->IntrinsicsWidth = PacketWidth;
+		Priv->IntrinsicsHeight = PacketHeight;
+		Priv->IntrinsicsFieldOfView = Header->FieldOfViewX;
+	}
+	const double cX = PacketWidth / 2.0;
+	const double cY = PacketHeight / 2.0;
 
-	const double K0 = cX / std::tan(halfFOVX);
+	const double K0 = Priv->FocalLength;
 	const double K2 = cX;
-	const double K4 = K0;
+	const double K4 = !Panoramic ? K0 : Equirectangular ? PacketHeight / PI : PacketHeight / 2.0 / std::tan(Header->FieldOfViewY * PI / 360.0);
 	const double K5 = cY;
 	const double K8 = 1;
 
@@ -374,17 +1441,17 @@ void UVisionComponent::TickComponent(float DeltaTime,
 	const double P10 = 1;
 
 	TSharedPtr<ROSMessages::sensor_msgs::CameraInfo> CamInfo(new ROSMessages::sensor_msgs::CameraInfo());
-	CamInfo->header.seq = 0;
+	CamInfo->header.seq = Sequence;
 	CamInfo->header.time = time;
 	//CamInfo->header.frame_id =
-	CamInfo->height = Height;
-	CamInfo->width = Width;
-	CamInfo->distortion_model = TEXT("plumb_bob");
-	CamInfo->D[0] = 0;
-	CamInfo->D[1] = 0;
-	CamInfo->D[2] = 0;
-	CamInfo->D[3] = 0;
-	CamInfo->D[4] = 0;
+	CamInfo->height = PacketHeight;
+	CamInfo->width = PacketWidth;
+	CamInfo->distortion_model = !Panoramic ? TEXT("plumb_bob") : Equirectangular ? TEXT("equirectangular") : TEXT("cylindrical");
+	CamInfo->D[0] = Panoramic ? 0 : DistortionK1;
+	CamInfo->D[1] = Panoramic ? 0 : DistortionK2;
+	CamInfo->D[2] = Panoramic ? 0 : DistortionP1;
+	CamInfo->D[3] = Panoramic ? 0 : DistortionP2;
+	CamInfo->D[4] = Panoramic ? 0 : DistortionK3;
 
 	CamInfo->K[0] = K0;
 	CamInfo->K[1] = 0;
@@ -409,7 +1476,7 @@ void UVisionComponent::TickComponent(float DeltaTime,
 	CamInfo->P[0] = P0;
 	CamInfo->P[1] = 0;
 	CamInfo->P[2] = P2;
-	CamInfo->P[3] = 0;
+	CamInfo->P[3] = -P0 * StereoBaseline; // Tx = -fx * baseline for the right cameras of a stereo rig
 	CamInfo->P[4] = 0;
 	CamInfo->P[5] = P5;
 	CamInfo->P[6] = P6;
@@ -428,21 +1495,29 @@ void UVisionComponent::TickComponent(float DeltaTime,
 	CamInfo->roi.width = 0;
 	CamInfo->roi.do_rectify = false;
 
-	CameraInfoPublisher->Publish(CamInfo);
-
-	// Clean up
-	delete[] TargetDepthBuf;
+	PublishMessage(CameraInfoPublisher, CamInfo);
 }
 
 void UVisionComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
-    Running = false;
+	UntrackMovableActors();
+	// Publish and record the packets still in the pipeline, the topics have to outlive the batched messages
+	PublishCompleted(0);
+	if (Priv->Publisher.IsValid())
+	{
+		Priv->Publisher->Flush();
+		Priv->Publisher->Wait();
+		Priv->Publisher.Reset();
+	}
+	// Captures triggered later, e.g. by a rig that ends play after this component, do not wait for a free slot
+	Priv->Buffer->Release();
 
-    // Stopping processing threads
-    Priv->DoColor = true;
-    Priv->DoDepth = true;
-    Priv->DoObject = true;
+    // Stopping processing threads, all packets were completed, so no jobs are left
+    {
+        std::lock_guard<std::mutex> LockColor(Priv->WaitColor), LockDepth(Priv->WaitDepth), LockObject(Priv->WaitObject);
+        Running = false;
+    }
     Priv->CVColor.notify_one();
     Priv->CVDepth.notify_one();
     Priv->CVObject.notify_one();
@@ -450,6 +1525,13 @@ void UVisionComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
     Priv->ThreadColor.join();
     Priv->ThreadDepth.join();
     Priv->ThreadObject.join();
+
+    // Write the frame index of the recording
+    if (Priv->Recorder.IsValid())
+    {
+        Priv->Recorder->Close();
+        Priv->Recorder.Reset();
+    }
 }
 
 void UVisionComponent::ShowFlagsBasicSetting(FEngineShowFlags &ShowFlags) const
@@ -514,19 +1596,61 @@ void UVisionComponent::ReadImageCompressed(UTextureRenderTarget2D *RenderTarget,
 	ImageWrapper->SetRaw(RawImageData.GetData(), RawImageData.GetAllocatedSize(), Width, Height, ERGBFormat::BGRA, 8);
 }
 
-void UVisionComponent::ToColorImage(const TArray<FFloat16Color> &ImageData, uint8 *Bytes) const
+void UVisionComponent::ReadImageRaw(UTextureRenderTarget2D *RenderTarget, RenderTargetReadback &Readback, const int32 Stream) const
 {
-	const FFloat16Color *itI = ImageData.GetData();
-	uint8_t *itO = Bytes;
+	// Copies the pixels without conversion directly into the stream of the packet
+	Readback.Enqueue(RenderTarget, Priv->Buffer->GetWriteStream(Stream), Priv->Buffer->Streams[Stream].Stride);
+}
 
-	// Converts Float colors to bytes
-	for (size_t i = 0; i < ImageData.Num(); ++i, ++itI, ++itO)
+// Captures color and depth of this frame into their render targets, and into the reference render targets with the
+// formats and the raw scene depth of the CPU path
+void UVisionComponent::CaptureReference()
+{
+	Color->CaptureScene();
+	Depth->CaptureScene();
+
+	UTextureRenderTarget2D *ColorTarget = Color->TextureTarget;
+	UTextureRenderTarget2D *DepthTarget = Depth->TextureTarget;
+	const ESceneCaptureSource DepthSource = Depth->CaptureSource;
+	Color->TextureTarget = ReferenceColor;
+	Depth->TextureTarget = ReferenceDepth;
+	Depth->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+	Color->CaptureScene();
+	Depth->CaptureScene();
+	Color->TextureTarget = ColorTarget;
+	Depth->TextureTarget = DepthTarget;
+	Depth->CaptureSource = DepthSource;
+}
+
+// Compares the color and depth converted on the GPU with the reference images converted like on the CPU path
+void UVisionComponent::VerifyConversion(const uint32 Slot) const
+{
+	const PacketBuffer &Buffer = *Priv->Buffer;
+	const int32 ColorStream = Buffer.FindStream(PacketFormat::StreamColor);
+	const int32 DepthStream = Buffer.FindStream(PacketFormat::StreamDepth);
+	// The color may differ by one step from rounding the half floats, the depth by the precision of half floats.
+	// The raw scene depth of the reference is in centimeters.
+	const StreamConversion::Difference Result = StreamConversion::Compare(
+		Buffer.Streams[ColorStream], Priv->Buffer->GetWriteStream(Slot, ColorStream),
+		Buffer.Streams[DepthStream], Priv->Buffer->GetWriteStream(Slot, DepthStream),
+		Priv->ReferenceColorImage.GetData(), Priv->ReferenceDepthImage.GetData(), 0.01f, 1, 0.001f);
+
+	if (Result.ColorMismatches > 0 || Result.DepthMismatches > 0)
 	{
-		*itO = (uint8_t)std::round((float)itI->B * 255.f);
-		*++itO = (uint8_t)std::round((float)itI->G * 255.f);
-		*++itO = (uint8_t)std::round((float)itI->R * 255.f);
+		UE_LOG(LogTemp, Warning, TEXT("GPU conversion of %s differs from the CPU path in %d of %d pixels of the color by up to %d and in %d pixels of the depth by up to %f %%."),
+			*GetName(), Result.ColorMismatches, Result.Pixels, Result.MaxColorError, Result.DepthMismatches, Result.MaxDepthError * 100.0f);
 	}
-	return;
+	else
+	{
+		UE_LOG(LogTemp, Display, TEXT("GPU conversion of %s matches the CPU path, the color differs by up to %d and the depth by up to %f %%."),
+			*GetName(), Result.MaxColorError, Result.MaxDepthError * 100.0f);
+	}
+}
+
+void UVisionComponent::ToColorImage(const TArray<FFloat16Color> &ImageData, uint8 *Bytes) const
+{
+	// Converts Float colors to bytes
+	ConversionKernels::HalfToBGR8(ImageData.GetData(), Bytes, ImageData.Num());
 }
 
 void UVisionComponent::ToDepthImage(const TArray<FFloat16Color> &ImageData, uint8 *Bytes) const
@@ -542,12 +1666,395 @@ void UVisionComponent::ToDepthImage(const TArray<FFloat16Color> &ImageData, uint
 	return;
 }
 
-void UVisionComponent::StoreImage(const uint8 *ImageData, const uint32 Size, const char *Name) const
+// Distorts a stream of the packet written in the slot like the lens of a real camera
+void UVisionComponent::ApplyDistortion(const uint32 StreamType, const uint32 Slot) const
 {
-	std::ofstream File(Name, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
-	File.write(reinterpret_cast<const char *>(ImageData), Size);
-	File.close();
-	return;
+	if (!Priv->Distortion.IsValid() || StreamType > PacketFormat::StreamFlow)
+	{
+		return;
+	}
+	const int32 Stream = Priv->Buffer->FindStream(StreamType);
+	if (Stream >= 0)
+	{
+		Priv->Distortion->Apply(Priv->Buffer->Streams[Stream], Priv->Buffer->GetWriteStream(Slot, Stream), Priv->DistortionScratch[StreamType]);
+	}
+}
+
+// Computes the object statistics of the packet written in the slot, while the object image is still in the cache. They
+// are kept with the slot until the packet is published.
+void UVisionComponent::ComputeObjects(const uint32 Slot)
+{
+	const int32 Stream = Priv->Buffer->FindStream(PacketFormat::StreamObject);
+	if (Priv->Statistics.empty() || Stream < 0)
+	{
+		return;
+	}
+	const PacketBuffer::PacketHeader *Header = Priv->Buffer->GetWriteHeader(Slot);
+	const uint8 *Packet = reinterpret_cast<const uint8 *>(Header);
+	Priv->Statistics[Slot]->SetMap(reinterpret_cast<const PacketFormat::MapEntry *>(Packet + Header->OffsetMap), Header->MapEntries);
+	Priv->Statistics[Slot]->Compute(Priv->Buffer->Streams[Stream], Priv->Buffer->GetWriteStream(Slot, Stream));
+}
+
+// Computes the normals and flow of the packet written in the slot from its pinhole depth, before the distortion and
+// the noise are applied
+void UVisionComponent::ComputeGeometry(const uint32 Slot)
+{
+	if (!Priv->Geometry.IsValid())
+	{
+		return;
+	}
+	PacketBuffer &Buffer = *Priv->Buffer;
+	const int32 DepthStream = Buffer.FindStream(PacketFormat::StreamDepth);
+	const int32 NormalsStream = Buffer.FindStream(PacketFormat::StreamNormals);
+	const int32 FlowStream = Buffer.FindStream(PacketFormat::StreamFlow);
+	if (DepthStream >= 0)
+	{
+		Priv->Geometry->Compute(*Buffer.GetWriteHeader(Slot), Buffer.Streams[DepthStream], Buffer.GetWriteStream(Slot, DepthStream),
+			NormalsStream >= 0 ? &Buffer.Streams[NormalsStream] : nullptr, NormalsStream >= 0 ? Buffer.GetWriteStream(Slot, NormalsStream) : nullptr,
+			FlowStream >= 0 ? &Buffer.Streams[FlowStream] : nullptr, FlowStream >= 0 ? Buffer.GetWriteStream(Slot, FlowStream) : nullptr);
+	}
+}
+
+// Samples the ranges of the lidars from the depth of the packet written in the slot, before the distortion and the
+// noise are applied
+void UVisionComponent::ComputeLidars(const uint32 Slot)
+{
+	if (Priv->Lidars.empty())
+	{
+		return;
+	}
+	PacketBuffer &Buffer = *Priv->Buffer;
+	const int32 DepthStream = Buffer.FindStream(PacketFormat::StreamDepth);
+	if (DepthStream < 0)
+	{
+		return;
+	}
+	const uint8 *DepthData = Buffer.GetWriteStream(Slot, DepthStream);
+	size_t Lidar = 0;
+	for (int32 Stream = 0; Stream < (int32)Buffer.Streams.size() && Lidar < Priv->Lidars.size(); ++Stream)
+	{
+		if (Buffer.Streams[Stream].Type == PacketFormat::StreamRanges)
+		{
+			Priv->Lidars[Lidar++]->Sample(*Buffer.GetWriteHeader(Slot), Buffer.Streams[DepthStream], DepthData, reinterpret_cast<float *>(Buffer.GetWriteStream(Slot, Stream)));
+		}
+	}
+}
+
+// Creates the cameras of the six cube map faces, attached to the component and only rendered on demand
+void UVisionComponent::CreatePanoramaFaces()
+{
+	for (uint32 Face = 0; Face < PanoramaProjection::FaceCount; ++Face)
+	{
+		USceneCaptureComponent2D *FaceColor = NewObject<USceneCaptureComponent2D>(GetOwner(), *FString::Printf(TEXT("%sPanoramaColor%d"), *GetName(), Face));
+		FaceColor->SetupAttachment(this);
+		FaceColor->SetRelativeRotation(PanoramaProjection::FaceRotation(Face));
+		FaceColor->CaptureSource = ESceneCaptureSource::SCS_FinalColorLDR;
+		FaceColor->TextureTarget = NewObject<UTextureRenderTarget2D>(FaceColor);
+		FaceColor->FOVAngle = 90.0f;
+		FaceColor->bCaptureEveryFrame = false;
+		FaceColor->bCaptureOnMovement = false;
+		ShowFlagsLit(FaceColor->ShowFlags);
+		FaceColor->RegisterComponent();
+		PanoramaColor.Add(FaceColor);
+
+		USceneCaptureComponent2D *FaceDepth = NewObject<USceneCaptureComponent2D>(GetOwner(), *FString::Printf(TEXT("%sPanoramaDepth%d"), *GetName(), Face));
+		FaceDepth->SetupAttachment(this);
+		FaceDepth->SetRelativeRotation(PanoramaProjection::FaceRotation(Face));
+		FaceDepth->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+		FaceDepth->TextureTarget = NewObject<UTextureRenderTarget2D>(FaceDepth);
+		FaceDepth->FOVAngle = 90.0f;
+		FaceDepth->bCaptureEveryFrame = false;
+		FaceDepth->bCaptureOnMovement = false;
+		FaceDepth->RegisterComponent();
+		PanoramaDepth.Add(FaceDepth);
+
+		Priv->ReadbackFaces.push_back(TSharedPtr<RenderTargetReadback>(new RenderTargetReadback()));
+		Priv->ReadbackFaces.push_back(TSharedPtr<RenderTargetReadback>(new RenderTargetReadback()));
+	}
+}
+
+// Renders the faces the panorama needs and enqueues their readbacks, they complete with the flush before FinishCapture
+void UVisionComponent::CapturePanorama()
+{
+	const uint32 FaceSize = Priv->Panorama->GetFaceSize();
+	const size_t FacePixels = (size_t)FaceSize * FaceSize;
+	for (uint32 Face = 0; Face < PanoramaProjection::FaceCount; ++Face)
+	{
+		if (!Priv->Panorama->UsesFace(Face))
+		{
+			continue;
+		}
+		PanoramaColor[Face]->CaptureScene();
+		PanoramaDepth[Face]->CaptureScene();
+		Priv->ReadbackFaces[2 * Face]->Enqueue(PanoramaColor[Face]->TextureTarget, &Priv->PanoramaColorFaces[Face * FacePixels * 4], FaceSize * 4);
+		Priv->ReadbackFaces[2 * Face + 1]->Enqueue(PanoramaDepth[Face]->TextureTarget, &Priv->PanoramaDepthFaces[Face * FacePixels * sizeof(float)], FaceSize * sizeof(float));
+	}
+}
+
+// Stitches the faces into the color and depth streams of the packet that is currently written
+void UVisionComponent::StitchPanorama()
+{
+	PacketBuffer &Buffer = *Priv->Buffer;
+	const int32 ColorStream = Buffer.FindStream(PacketFormat::StreamColor);
+	const int32 DepthStream = Buffer.FindStream(PacketFormat::StreamDepth);
+	if (ColorStream >= 0 && DepthStream >= 0)
+	{
+		Priv->Panorama->Apply(Priv->PanoramaColorFaces.data(), reinterpret_cast<const float *>(Priv->PanoramaDepthFaces.data()),
+			Buffer.Streams[ColorStream], Buffer.GetWriteStream(ColorStream), Buffer.Streams[DepthStream], Buffer.GetWriteStream(DepthStream));
+	}
+}
+
+// Publishes the message right away or adds it to the batch of the current tick
+void UVisionComponent::PublishMessage(UTopic *Topic, TSharedPtr<FROSBaseMsg> Message)
+{
+	if (Priv->Publisher.IsValid())
+	{
+		Priv->Publisher->Add(Topic, Message);
+	}
+	else
+	{
+		Topic->Publish(Message);
+	}
+}
+
+// Returns a pointer to the payload that stays valid until the message is published. Payloads inside the leased
+// packet are published in place, others are copied into the batch.
+const uint8 *UVisionComponent::StorePayload(const uint8 *Data, const size_t Size)
+{
+	if (!Priv->Publisher.IsValid())
+	{
+		return Data;
+	}
+	if (Priv->ReadLease.IsValid() && Data >= Priv->LeasedPacket && Data + Size <= Priv->LeasedPacket + Priv->LeasedSize)
+	{
+		Priv->Publisher->Hold(Priv->ReadLease);
+		return Data;
+	}
+	return Priv->Publisher->Store(Data, Size);
+}
+
+// Returns a buffer for the converted depth that stays valid until the message is published
+uint8 *UVisionComponent::DepthOutput(const size_t Size)
+{
+	if (Priv->Publisher.IsValid())
+	{
+		return Priv->Publisher->Allocate(Size);
+	}
+	Priv->DepthBuffer.resize(Size);
+	return Priv->DepthBuffer.data();
+}
+
+// Returns a buffer for the points of the given lidar that stays valid until the message is published
+uint8 *UVisionComponent::LidarOutput(const size_t Size, const int32 Lidar)
+{
+	if (Priv->Publisher.IsValid())
+	{
+		return Priv->Publisher->Allocate(Size);
+	}
+	Priv->LidarPoints[Lidar].resize(Size);
+	return Priv->LidarPoints[Lidar].data();
+}
+
+// Hands the batched messages to the background thread. This is called after the messages went out of scope of
+// PublishPacket, so that the background thread holds their only references.
+void UVisionComponent::FlushMessages()
+{
+	if (Priv->Publisher.IsValid())
+	{
+		Priv->Publisher->Flush();
+	}
+}
+
+float UVisionComponent::GetLatency() const
+{
+	return Priv->Latency;
+}
+
+float UVisionComponent::GetFramerate() const
+{
+	return Framerate;
+}
+
+// Applies the frame rate and the resolution step chosen by the adaptive controller, a new resolution is applied
+// by BeginCapture like SetResolution
+void UVisionComponent::ApplyRateControl()
+{
+	const RateController &Control = *Priv->RateControl;
+	const uint32 Step = Control.GetStep();
+	Width = Step == 0 ? Priv->BaseWidth : ResolutionLadder[Step - 1].X;
+	Height = Step == 0 ? Priv->BaseHeight : ResolutionLadder[Step - 1].Y;
+	SetFramerate(Control.GetFramerate());
+	UE_LOG(LogTemp, Display, TEXT("Vision component %s: adapting to %f fps at %dx%d, %f ms latency and %f%% stall."),
+		*GetName(), Framerate, Width, Height, Control.GetLatency(), Control.GetStall() * 100.0f);
+}
+
+// Returns true if neither the camera nor a movable actor in its view moved since the last rendered capture. The state
+// of the scene is only stored when it changed, so that slow movements below the tolerances add up.
+bool UVisionComponent::IsSceneStatic()
+{
+	const float TranslationTolerance = StaticTranslationTolerance * 100.0f;
+	const float RotationTolerance = FMath::DegreesToRadians(StaticRotationTolerance);
+	auto Moved = [TranslationTolerance, RotationTolerance](const FTransform &A, const FTransform &B)
+	{
+		return FVector::Dist(A.GetLocation(), B.GetLocation()) > TranslationTolerance
+			|| A.GetRotation().AngularDistance(B.GetRotation()) > RotationTolerance;
+	};
+
+	// Actors only matter if they are inside the view frustum before or after they moved, panoramas see all of them
+	const bool Panoramic = Priv->Panorama.IsValid();
+	FMinimalViewInfo View;
+	GetCameraView(0, View);
+	FMatrix ViewMatrix, ProjectionMatrix, ViewProjectionMatrix;
+	UGameplayStatics::GetViewProjectionMatrix(View, ViewMatrix, ProjectionMatrix, ViewProjectionMatrix);
+	FConvexVolume Frustum;
+	GetViewFrustumBounds(Frustum, ViewProjectionMatrix, false);
+	auto Visible = [&Frustum, Panoramic](const FBox &Bounds)
+	{
+		return Bounds.IsValid && (Panoramic || Frustum.IntersectBox(Bounds.GetCenter(), Bounds.GetExtent()));
+	};
+
+	const FTransform Pose = GetComponentTransform();
+	bool Static = Priv->StaticValid && !Moved(Pose, Priv->StaticPose)
+		&& (StaticRefreshInterval <= 0 || Priv->StaticFrames < (uint32)StaticRefreshInterval);
+
+	if (!Priv->ActorSpawnedHandle.IsValid())
+	{
+		TrackMovableActors();
+	}
+
+	for (int32 i = 0; i < Priv->StaticActors.Num(); ++i)
+	{
+		PrivateData::ActorState &State = Priv->StaticActors[i];
+		AActor *Actor = State.Actor.Get();
+		// Actors that were destroyed since the last capture
+		if (!Actor)
+		{
+			Static = Static && !(State.Captured && Visible(State.Bounds));
+			Priv->StaticActors.RemoveAtSwap(i--, 1, false);
+			continue;
+		}
+
+		State.CurrentPose = Actor->GetActorTransform();
+		State.CurrentBounds = Actor->GetComponentsBoundingBox(true);
+		if (!Static)
+		{
+			continue;
+		}
+		if (!State.Captured)
+		{
+			Static = !Visible(State.CurrentBounds);
+		}
+		else if (Moved(State.CurrentPose, State.Pose) || !State.CurrentBounds.Min.Equals(State.Bounds.Min, TranslationTolerance)
+			|| !State.CurrentBounds.Max.Equals(State.Bounds.Max, TranslationTolerance))
+		{
+			Static = !Visible(State.CurrentBounds) && !Visible(State.Bounds);
+		}
+	}
+
+	if (Static)
+	{
+		++Priv->StaticFrames;
+		return true;
+	}
+
+	// The capture is rendered with this state
+	Priv->StaticPose = Pose;
+	for (PrivateData::ActorState &State : Priv->StaticActors)
+	{
+		State.Pose = State.CurrentPose;
+		State.Bounds = State.CurrentBounds;
+		State.Captured = true;
+	}
+	Priv->StaticFrames = 0;
+	Priv->StaticValid = true;
+	return false;
+}
+
+// Collects the movable actors of the world once and registers for the ones spawned or streamed in later
+void UVisionComponent::TrackMovableActors()
+{
+	UWorld *World = GetWorld();
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		TrackActor(*It);
+	}
+	Priv->ActorSpawnedHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UVisionComponent::TrackActor));
+	Priv->LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UVisionComponent::TrackLevel);
+}
+
+void UVisionComponent::UntrackMovableActors()
+{
+	if (Priv->ActorSpawnedHandle.IsValid())
+	{
+		GetWorld()->RemoveOnActorSpawnedHandler(Priv->ActorSpawnedHandle);
+		FWorldDelegates::LevelAddedToWorld.Remove(Priv->LevelAddedHandle);
+		Priv->ActorSpawnedHandle.Reset();
+		Priv->LevelAddedHandle.Reset();
+	}
+	Priv->StaticActors.Empty();
+}
+
+void UVisionComponent::TrackActor(AActor *Actor)
+{
+	// Static and stationary actors can not move, so only movable ones are tracked
+	const USceneComponent *Root = Actor ? Actor->GetRootComponent() : nullptr;
+	if (Actor == GetOwner() || !Root || Root->Mobility != EComponentMobility::Movable)
+	{
+		return;
+	}
+	PrivateData::ActorState State;
+	State.Actor = Actor;
+	State.Captured = false;
+	Priv->StaticActors.Add(State);
+}
+
+void UVisionComponent::TrackLevel(ULevel *Level, UWorld *World)
+{
+	if (World != GetWorld() || !Level)
+	{
+		return;
+	}
+	// A level that is shown again still has its actors, which may be tracked already
+	for (AActor *Actor : Level->Actors)
+	{
+		if (!Priv->StaticActors.ContainsByPredicate([Actor](const PrivateData::ActorState &State) { return State.Actor == Actor; }))
+		{
+			TrackActor(Actor);
+		}
+	}
+}
+
+// Applies the simulated sensor noise to a stream of the packet written in the slot
+void UVisionComponent::ApplyNoise(const uint32 StreamType, const uint32 Slot) const
+{
+	if (!Priv->Noise.IsValid())
+	{
+		return;
+	}
+	const int32 Stream = Priv->Buffer->FindStream(StreamType);
+	if (Stream >= 0)
+	{
+		Priv->Noise->Apply(Priv->Buffer->Streams[Stream], Priv->Buffer->GetWriteStream(Slot, Stream), Priv->Buffer->GetWriteHeader(Slot)->Sequence);
+	}
+}
+
+// Returns the current time in nanoseconds, either from the world or the wall clock. The wall clock is only sampled
+// once, the stamps advance with the monotonic clock so that they never jump back when the system time is adjusted.
+uint64 UVisionComponent::GetTimestamp() const
+{
+	if (UseSimulationTime)
+	{
+		return (uint64)(GetWorld()->GetTimeSeconds() * 1000000000.0);
+	}
+	static const int64 WallOffset = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+		- (int64)MonotonicTime();
+	return MonotonicTime() + WallOffset;
+}
+
+// Returns the monotonic time in nanoseconds, used for durations like the latency
+uint64 UVisionComponent::MonotonicTime()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 /* Generates at least NumberOfColors different colors.
@@ -687,66 +2194,73 @@ bool UVisionComponent::ColorAllObjects()
 	return true;
 }
 
-void UVisionComponent::ProcessColor()
+// Waits for the next slot to convert, returns false when the component stops
+static bool NextJob(std::mutex &Mutex, std::condition_variable &CV, std::deque<uint32> &Jobs, const bool &Running, uint32 &Slot)
 {
-	while (true)
+	std::unique_lock<std::mutex> WaitLock(Mutex);
+	CV.wait(WaitLock, [&Jobs, &Running] {return !Jobs.empty() || !Running; });
+	if (!Running)
 	{
-		std::unique_lock<std::mutex> WaitLock(Priv->WaitColor);
-		Priv->CVColor.wait(WaitLock, [this] {return Priv->DoColor; });
-		Priv->DoColor = false;
-		if (!this->Running) break;
-		ToColorImage(ImageColor, Priv->Buffer->Color);
-
-		Priv->DoneColor = true;
-		Priv->CVDone.notify_one();
+		return false;
 	}
+	Slot = Jobs.front();
+	Jobs.pop_front();
+	return true;
 }
 
-void UVisionComponent::ProcessDepth()
+// Completes the packet of the slot once all processing threads converted their part of it. The lock is held until
+// the buffer is done with it, so that a reconfiguration can not replace the buffer before.
+void UVisionComponent::DoneConverting(const uint32 Slot)
 {
-	while (true)
+	std::lock_guard<std::mutex> Lock(Priv->WaitDone);
+	if (--Priv->ConversionsLeft[Slot] == 0)
 	{
-		std::unique_lock<std::mutex> WaitLock(Priv->WaitDepth);
-		Priv->CVDepth.wait(WaitLock, [this] {return Priv->DoDepth; });
-		Priv->DoDepth = false;
-		if (!this->Running) break;
-		ToDepthImage(ImageDepth, Priv->Buffer->Depth);
-
-		// Wait for both other processing threads to be done.
-		std::unique_lock<std::mutex> WaitDoneLock(Priv->WaitDone);
-		Priv->CVDone.wait(WaitDoneLock, [this] {return Priv->DoneColor && Priv->DoneObject; });
-
-		Priv->DoneColor = false;
-		Priv->DoneObject = false;
-
-		// Complete Buffer
-		Priv->Buffer->DoneWriting();
+		Priv->Buffer->DoneWriting(Slot);
 	}
 }
 
-void UVisionComponent::ProcessObject()
+void UVisionComponent::ProcessColor()
 {
-	while (true)
+	ThreadPlacement::Apply(TEXT("VisionColor"), ColorThreadCores, ThreadPriority);
+	uint32 Slot;
+	while (NextJob(Priv->WaitColor, Priv->CVColor, Priv->JobsColor, Running, Slot))
 	{
-		std::unique_lock<std::mutex> WaitLock(Priv->WaitObject);
-		Priv->CVObject.wait(WaitLock, [this] {return Priv->DoObject; });
-		Priv->DoObject = false;
-		if (!this->Running) break;
-		ToColorImage(ImageObject, Priv->Buffer->Object);
+		const int32 Stream = Priv->Buffer->FindStream(PacketFormat::StreamColor);
+		ToColorImage(Priv->Staging[Slot].Color, Priv->Buffer->GetWriteStream(Slot, Stream));
+		ApplyDistortion(PacketFormat::StreamColor, Slot);
+		ApplyNoise(PacketFormat::StreamColor, Slot);
+		DoneConverting(Slot);
+	}
+}
 
-		Priv->DoneObject = true;
-		Priv->CVDone.notify_one();
+void UVisionComponent::ProcessDepth()
+{
+	ThreadPlacement::Apply(TEXT("VisionDepth"), DepthThreadCores, ThreadPriority);
+	uint32 Slot;
+	while (NextJob(Priv->WaitDepth, Priv->CVDepth, Priv->JobsDepth, Running, Slot))
+	{
+		const int32 Stream = Priv->Buffer->FindStream(PacketFormat::StreamDepth);
+		ToDepthImage(Priv->Staging[Slot].Depth, Priv->Buffer->GetWriteStream(Slot, Stream));
+		ComputeGeometry(Slot);
+		ComputeLidars(Slot);
+		ApplyDistortion(PacketFormat::StreamDepth, Slot);
+		ApplyDistortion(PacketFormat::StreamNormals, Slot);
+		ApplyDistortion(PacketFormat::StreamFlow, Slot);
+		ApplyNoise(PacketFormat::StreamDepth, Slot);
+		DoneConverting(Slot);
 	}
 }
 
-// TODO maybe shift towards "server" who publishs async
-void UVisionComponent::convertDepth(const uint16_t *in, __m128 *out) const
+void UVisionComponent::ProcessObject()
 {
-	const size_t size = (Width * Height) / 4;
-	for (size_t i = 0; i < size; ++i, in += 4, ++out)
+	ThreadPlacement::Apply(TEXT("VisionObject"), ObjectThreadCores, ThreadPriority);
+	uint32 Slot;
+	while (NextJob(Priv->WaitObject, Priv->CVObject, Priv->JobsObject, Running, Slot))
 	{
-    // Divide by 100 here in order to convert UU (cm) into ROS units (m)
-		*out = _mm_cvtph_ps(_mm_set_epi16(
-        0, 0, 0, 0, *(in + 3), *(in + 2), *(in + 1), *(in + 0))) / 100;
+		const int32 Stream = Priv->Buffer->FindStream(PacketFormat::StreamObject);
+		ToColorImage(Priv->Staging[Slot].Object, Priv->Buffer->GetWriteStream(Slot, Stream));
+		ApplyDistortion(PacketFormat::StreamObject, Slot);
+		ComputeObjects(Slot);
+		DoneConverting(Slot);
 	}
 }
@@ -0,0 +1,257 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "VisionLockstepActor.h"
+
+#include "Common/TcpSocketBuilder.h"
+#include "EngineUtils.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/App.h"
+#include "RenderingThread.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+#include "LockstepProtocol.h"
+#include "StopTime.h"
+#include "VisionRigActor.h"
+
+// Sets default values
+AVisionLockstepActor::AVisionLockstepActor() : AActor(),
+Port(10001),
+StepTime(0.05f),
+StepTimeout(0),
+Listener(nullptr),
+Client(nullptr),
+PreviousFixedTimeStep(false),
+PreviousFixedDeltaTime(0),
+Frame(0),
+StepsLeft(0),
+Sequence(0),
+Waiting(false),
+WaitStart(0)
+{
+	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+	// The cameras are captured after everything else in the world moved in the frame
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+	// Polls for step requests while the world is paused
+	PrimaryActorTick.bTickEvenWhenPaused = true;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+	SetRootComponent(RootComponent);
+}
+
+// Called when the game starts or when spawned
+void AVisionLockstepActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Every frame advances the world by exactly one step, however long it takes
+	PreviousFixedTimeStep = FApp::UseFixedTimeStep();
+	PreviousFixedDeltaTime = FApp::GetFixedDeltaTime();
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(StepTime);
+
+	Listener = FTcpSocketBuilder(TEXT("VisionLockstep"))
+		.AsReusable()
+		.BoundToEndpoint(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), Port))
+		.Listening(1)
+		.Build();
+	if (!Listener)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Vision lockstep could not listen on port %d, the cameras are not stepped."), Port);
+	}
+}
+
+// Called every frame
+void AVisionLockstepActor::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	if (!Listener)
+	{
+		return;
+	}
+
+	// Paused frames do not advance the world
+	if (!GetWorld()->IsPaused())
+	{
+		++Frame;
+		if (StepsLeft > 0 && --StepsLeft == 0)
+		{
+			Capture();
+		}
+	}
+	if (StepsLeft > 0)
+	{
+		return;
+	}
+
+	// The world waits paused for the next step request instead of holding the game thread
+	if (!Waiting)
+	{
+		PauseWorld(true);
+	}
+	if (ReceiveStep())
+	{
+		PauseWorld(false);
+	}
+	else if (StepTimeout > 0 && FPlatformTime::Seconds() - WaitStart >= StepTimeout)
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("No step request within %f seconds, frame %llu passes without capture."), StepTimeout, Frame);
+		PauseWorld(false);
+	}
+}
+
+void AVisionLockstepActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	if (Waiting)
+	{
+		PauseWorld(false);
+	}
+	CloseClient();
+	if (Listener)
+	{
+		Listener->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Listener);
+		Listener = nullptr;
+	}
+
+	FApp::SetUseFixedTimeStep(PreviousFixedTimeStep);
+	FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+}
+
+TArray<UVisionComponent *> AVisionLockstepActor::FindCameras()
+{
+	// Looked up on every capture, so that cameras spawned later are stepped as well
+	TArray<UVisionComponent *> Cameras;
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		AVisionRigActor *Rig = Cast<AVisionRigActor>(*It);
+		if (Rig)
+		{
+			Rig->SetActorTickEnabled(false);
+		}
+
+		TArray<UVisionComponent *> Components;
+		It->GetComponents<UVisionComponent>(Components);
+		for (UVisionComponent *Camera : Components)
+		{
+			// Replaying cameras keep publishing their capture files on their own
+			if (Camera->PlaybackFile.IsEmpty())
+			{
+				Camera->SetComponentTickEnabled(false);
+				Camera->SetLockstep();
+				Cameras.Add(Camera);
+			}
+		}
+	}
+	return Cameras;
+}
+
+void AVisionLockstepActor::Capture()
+{
+	MEASURE_TIME("Lockstep Capture");
+	const TArray<UVisionComponent *> Cameras = FindCameras();
+
+	// All cameras share stamp and sequence number of the step, the stamp is the simulated time and does not depend
+	// on how long the frames took
+	const uint64 TimestampCapture = Frame * (uint64)FMath::RoundToDouble(StepTime * 1000000000.0);
+	uint32 Captured = 0;
+	for (UVisionComponent *Camera : Cameras)
+	{
+		if (!Camera->IsPaused())
+		{
+			Camera->BeginCapture(Sequence, TimestampCapture);
+			++Captured;
+		}
+	}
+
+	// Completes the readbacks of all cameras at once
+	FlushRenderingCommands();
+
+	for (UVisionComponent *Camera : Cameras)
+	{
+		if (!Camera->IsPaused())
+		{
+			Camera->FinishCapture();
+		}
+	}
+
+	// The step is only acknowledged once no packet of it is left in any pipeline
+	for (UVisionComponent *Camera : Cameras)
+	{
+		if (!Camera->IsPaused())
+		{
+			Camera->WaitPublished();
+		}
+	}
+
+	LockstepProtocol::StepReply Reply = {LockstepProtocol::Magic, Sequence, TimestampCapture, Captured, 0};
+	int32 BytesSent = 0;
+	if (Client && !Client->Send(reinterpret_cast<const uint8 *>(&Reply), sizeof(Reply), BytesSent))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Vision lockstep could not acknowledge step %d, the client is disconnected."), Sequence);
+		CloseClient();
+	}
+	++Sequence;
+}
+
+bool AVisionLockstepActor::ReceiveStep()
+{
+	// Short enough to keep the frame rate of the paused world interactive
+	const FTimespan Slice = FTimespan::FromMilliseconds(10);
+	if (!Client)
+	{
+		bool Pending = false;
+		if (!Listener->WaitForPendingConnection(Pending, Slice) || !Pending)
+		{
+			return false;
+		}
+		Client = Listener->Accept(TEXT("VisionLockstepClient"));
+		if (!Client)
+		{
+			return false;
+		}
+		Client->SetNonBlocking(false);
+		Client->SetNoDelay(true);
+	}
+
+	if (!Client->Wait(ESocketWaitConditions::WaitForRead, Slice))
+	{
+		return false;
+	}
+	// A closed connection is readable as well, but receives nothing
+	LockstepProtocol::StepRequest Request;
+	int32 BytesRead = 0;
+	if (!Client->Recv(reinterpret_cast<uint8 *>(&Request), sizeof(Request), BytesRead, ESocketReceiveFlags::WaitAll)
+		|| BytesRead != sizeof(Request) || Request.Magic != LockstepProtocol::Magic)
+	{
+		CloseClient();
+		return false;
+	}
+	StepsLeft = FMath::Max<uint32>(Request.Steps, 1);
+	return true;
+}
+
+void AVisionLockstepActor::PauseWorld(const bool Pause)
+{
+	Waiting = Pause;
+	WaitStart = FPlatformTime::Seconds();
+	// Pausing needs a local player controller. Without one the frames pass without capture while waiting.
+	if (!UGameplayStatics::SetGamePaused(this, Pause) && Pause)
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("Vision lockstep could not pause the world, frame %llu passes without capture."), Frame);
+	}
+}
+
+void AVisionLockstepActor::CloseClient()
+{
+	if (Client)
+	{
+		Client->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Client);
+		Client = nullptr;
+	}
+}
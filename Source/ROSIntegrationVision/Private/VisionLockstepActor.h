@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+
+#include "VisionComponent.h"
+
+#include "VisionLockstepActor.generated.h"
+
+class FSocket;
+
+/**
+ * Drives all vision components of the world in lockstep with an external client, e.g. a dataset generator, instead
+ * of real time. The engine runs with a fixed time step and the world is paused at the end of every step until the
+ * client requests the next one over a local TCP socket, see LockstepProtocol.h. After the requested number of
+ * steps all cameras are captured with the same stamp and sequence number and the reply is sent once their packets
+ * are published, so every dataset frame reflects a defined world state independent of the speed of the machine.
+ */
+UCLASS()
+class ROSINTEGRATIONVISION_API AVisionLockstepActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AVisionLockstepActor();
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called every frame
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UPROPERTY(EditAnywhere, Category = "Vision Lockstep")
+		int32 Port; // Port of the step socket, only bound to the loopback interface.
+	UPROPERTY(EditAnywhere, Category = "Vision Lockstep")
+		float StepTime; // Fixed time in seconds the world advances per step.
+	UPROPERTY(EditAnywhere, Category = "Vision Lockstep")
+		float StepTimeout; // Seconds to wait for a step request before letting a frame pass without capture, 0 waits forever with the world paused.
+
+private:
+	FSocket *Listener, *Client;
+	bool PreviousFixedTimeStep;
+	double PreviousFixedDeltaTime;
+	// Frames ticked since play began, steps left until the next capture and the sequence number of the next capture
+	uint64 Frame;
+	uint32 StepsLeft;
+	uint32 Sequence;
+	// True while the world is paused waiting for a step request, since the given time
+	bool Waiting;
+	double WaitStart;
+
+	// Returns the cameras of the world and takes over their captures from their own ticks and rigs, they only render when captured
+	TArray<UVisionComponent *> FindCameras();
+	// Captures all cameras, waits until their packets are published and sends the reply
+	void Capture();
+	// Polls for the next step request for a short time, accepting a client if none is connected
+	bool ReceiveStep();
+	// Pauses the world until the next step request, the game thread keeps running so that the editor stays responsive
+	void PauseWorld(const bool Pause);
+	void CloseClient();
+};
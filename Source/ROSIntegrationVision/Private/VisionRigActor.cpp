@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "VisionRigActor.h"
+
+#include "RenderingThread.h"
+
+#include "StopTime.h"
+
+// Sets default values
+AVisionRigActor::AVisionRigActor() : AActor(),
+CameraCount(2),
+Baseline(0.12f),
+Width(960),
+Height(540),
+FieldOfView(90.0f),
+Framerate(30),
+UseGPUConversion(true),
+TopicNamespace(TEXT("/unreal_ros/stereo")),
+ParentLink(TEXT("/world")),
+TimePassed(0),
+Sequence(0)
+{
+	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+	SetRootComponent(RootComponent);
+}
+
+// Called when the game starts or when spawned
+void AVisionRigActor::BeginPlay()
+{
+	// The cameras are created before the components begin play, so that they are configured already
+	for (int32 i = 0; i < CameraCount; ++i)
+	{
+		const FString Name = CameraCount == 2 ? (i == 0 ? TEXT("left") : TEXT("right")) : FString::Printf(TEXT("camera%d"), i);
+		const FString Namespace = TopicNamespace + TEXT("/") + Name;
+
+		UVisionComponent *Camera = NewObject<UVisionComponent>(this, *Name);
+		Camera->SetupAttachment(RootComponent);
+		// Cameras are placed to the right of the first one, UE uses centimeters
+		Camera->SetRelativeLocation(FVector(0, i * Baseline * 100.0f, 0));
+		Camera->Width = Width;
+		Camera->Height = Height;
+		Camera->FieldOfView = FieldOfView;
+		Camera->Framerate = Framerate;
+		Camera->UseGPUConversion = UseGPUConversion;
+		Camera->ParentLink = ParentLink;
+		Camera->TopicNamespace = Namespace;
+		Camera->ImageFrame = Namespace + TEXT("/image_frame");
+		Camera->ImageOpticalFrame = Namespace + TEXT("/image_optical_frame");
+		Camera->SetRig(true, i * Baseline);
+		Camera->RegisterComponent();
+		Cameras.Add(Camera);
+	}
+
+	Super::BeginPlay();
+}
+
+// Called every frame
+void AVisionRigActor::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Check for framerate
+	TimePassed += DeltaTime;
+	if (Cameras.Num() == 0 || TimePassed < 1.0f / Framerate)
+	{
+		return;
+	}
+	TimePassed -= 1.0f / Framerate;
+	MEASURE_TIME("Rig Tick");
+
+	// All cameras share stamp and sequence number of the frame
+	const uint64 TimestampCapture = Cameras[0]->GetTimestamp();
+	for (UVisionComponent *Camera : Cameras)
+	{
+		if (!Camera->IsPaused())
+		{
+			Camera->BeginCapture(Sequence, TimestampCapture);
+		}
+	}
+	++Sequence;
+
+	// Completes the readbacks of all cameras at once
+	if (UseGPUConversion)
+	{
+		FlushRenderingCommands();
+	}
+
+	for (UVisionComponent *Camera : Cameras)
+	{
+		if (!Camera->IsPaused())
+		{
+			Camera->FinishCapture();
+		}
+	}
+}
@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+
+#include "VisionComponent.h"
+
+#include "VisionRigActor.generated.h"
+
+/**
+ * Rig of several vision components next to each other along the Y axis of the actor, e.g. a stereo pair.
+ * All cameras are captured in the same frame with the same stamp and sequence number and their readbacks
+ * complete with a single flush of the rendering commands.
+ */
+UCLASS()
+class ROSINTEGRATIONVISION_API AVisionRigActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AVisionRigActor();
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called every frame
+	virtual void Tick(float DeltaSeconds) override;
+
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		int32 CameraCount; // Number of cameras. A pair is named left and right, otherwise they are named camera0, camera1 and so on.
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		float Baseline; // Distance between neighbouring cameras in meters.
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		uint32 Width;
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		uint32 Height;
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		float FieldOfView;
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		float Framerate;
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		bool UseGPUConversion; // Needed for batching the readbacks of all cameras.
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		FString TopicNamespace; // The topics of each camera are placed below this namespace, e.g. /unreal_ros/stereo/left.
+	UPROPERTY(EditAnywhere, Category = "Vision Rig")
+		FString ParentLink;
+
+	UPROPERTY(VisibleAnywhere, Category = "Vision Rig")
+		TArray<UVisionComponent *> Cameras;
+
+private:
+	float TimePassed;
+	uint32 Sequence;
+};
@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "PacketFormat.h"
+
+/**
+ * Keyframe and tile delta encoding of depth images. A keyframe contains all tiles of the image, the following
+ * frames only contain the tiles that changed since the previous frame. Like PacketFormat.h this header only
+ * depends on the C++ standard library, so that subscribers can include it to decode the depth images.
+ *
+ * frame format:
+ * - FrameHeader
+ * - Tile mask, one bit per tile in row-major order starting with the least significant bit, padded to 4 Bytes
+ * - Samples of the changed tiles in row-major order, each tile stored row by row. Tiles at the right and bottom
+ *   border are cropped to the image.
+ */
+namespace DepthDelta
+{
+  const uint32_t Magic = 0x44564952; // "RIVD"
+  const uint32_t Version = 1;
+  const uint32_t TileSize = 16;
+
+  enum FrameFlags : uint32_t
+  {
+    FlagKeyframe = 1
+  };
+
+  struct FrameHeader
+  {
+    uint32_t Magic; // Magic
+    uint32_t Version; // Version of the frame format
+    uint32_t Size; // Size of the complete frame
+    uint32_t Flags; // FrameFlags
+    uint32_t Sequence; // Sequence number of the frame
+    uint32_t Reference; // Sequence number of the frame the tiles are applied to, equal to Sequence for keyframes
+    uint32_t Width; // Width of the image in pixels
+    uint32_t Height; // Height of the image in pixels
+    uint32_t Encoding; // PacketFormat::StreamEncoding of the samples
+    float Scale; // Factor converting the samples to meters
+    uint32_t ChangedTiles; // Number of tiles stored in the frame
+    uint32_t Reserved;
+  };
+
+  enum DecodeResult
+  {
+    DecodeOk = 0,
+    DecodeBadFrame, // The frame is malformed
+    DecodeNeedKeyframe // The reference frame is missing, frames are dropped until the next keyframe
+  };
+
+  inline uint32_t TilesX(const uint32_t Width)
+  {
+    return (uint32_t)(((uint64_t)Width + TileSize - 1) / TileSize);
+  }
+
+  inline uint32_t TilesY(const uint32_t Height)
+  {
+    return (uint32_t)(((uint64_t)Height + TileSize - 1) / TileSize);
+  }
+
+  // Computed in 64 bits, the sizes in a header received by a decoder are not trusted
+  inline uint64_t MaskSize(const uint32_t Width, const uint32_t Height)
+  {
+    return ((uint64_t)TilesX(Width) * TilesY(Height) + 31) / 32 * 4;
+  }
+
+  // Converts a half precision float, for decoders that do not have a half float type available
+  inline float HalfToFloat(const uint16_t Half)
+  {
+    const uint32_t Exponent = (Half >> 10) & 0x1F;
+    const uint32_t Mantissa = Half & 0x3FF;
+    const float Sign = (Half & 0x8000) ? -1.0f : 1.0f;
+    if(Exponent == 0)
+    {
+      return Sign * std::ldexp((float)Mantissa, -24);
+    }
+    if(Exponent == 31)
+    {
+      return Mantissa == 0 ? Sign * INFINITY : NAN;
+    }
+    return Sign * std::ldexp((float)(Mantissa | 0x400), (int)Exponent - 25);
+  }
+
+  /**
+   * Reconstructs the depth images from a continuous stream of frames. The decoded image keeps the encoding of
+   * the samples, ToMeters converts it.
+   */
+  class Decoder
+  {
+  private:
+    std::vector<uint8_t> Image;
+    FrameHeader Current;
+    bool Valid;
+
+  public:
+    Decoder() : Valid(false)
+    {
+    }
+
+    DecodeResult Decode(const uint8_t *Data, const size_t Size)
+    {
+      if(Size < sizeof(FrameHeader))
+      {
+        return DecodeBadFrame;
+      }
+
+      const FrameHeader *Header = reinterpret_cast<const FrameHeader *>(Data);
+      const uint32_t Bytes = PacketFormat::BytesPerPixel(Header->Encoding);
+      const uint64_t Mask = MaskSize(Header->Width, Header->Height);
+      if(Header->Magic != Magic || Header->Version != Version || Header->Size > Size || Bytes == 0 || sizeof(FrameHeader) + Mask > Header->Size)
+      {
+        return DecodeBadFrame;
+      }
+
+      // A keyframe has to contain every tile, so that no tile of an earlier image is left in the decoded one
+      const uint32_t CountX = TilesX(Header->Width);
+      const uint32_t CountY = TilesY(Header->Height);
+      const uint64_t Pixels = (uint64_t)Header->Width * Header->Height;
+      if(Pixels > UINT64_MAX / Bytes || Pixels * Bytes > SIZE_MAX)
+      {
+        return DecodeBadFrame;
+      }
+      const bool Keyframe = (Header->Flags & FlagKeyframe) != 0;
+      if(Keyframe && (Header->ChangedTiles != (uint64_t)CountX * CountY || Header->Size != sizeof(FrameHeader) + Mask + Pixels * Bytes))
+      {
+        Valid = false;
+        return DecodeBadFrame;
+      }
+
+      if(!Keyframe && (!Valid || Header->Reference != Current.Sequence || Header->Width != Current.Width
+                       || Header->Height != Current.Height || Header->Encoding != Current.Encoding))
+      {
+        Valid = false;
+        return DecodeNeedKeyframe;
+      }
+
+      const uint64_t Stride = (uint64_t)Header->Width * Bytes;
+      if(Keyframe)
+      {
+        Image.resize((size_t)(Pixels * Bytes));
+      }
+
+      const uint8_t *TileMask = Data + sizeof(FrameHeader);
+      const uint8_t *Samples = TileMask + Mask;
+      const uint8_t *End = Data + Header->Size;
+
+      for(uint32_t TileY = 0; TileY < CountY; ++TileY)
+      {
+        const uint32_t Y = TileY * TileSize;
+        const uint32_t Rows = std::min(TileSize, Header->Height - Y);
+        for(uint32_t TileX = 0; TileX < CountX; ++TileX)
+        {
+          const uint32_t Tile = TileY * CountX + TileX;
+          if(!(TileMask[Tile / 8] & (1 << (Tile % 8))))
+          {
+            continue;
+          }
+
+          const uint32_t X = TileX * TileSize;
+          const uint32_t RowSize = std::min(TileSize, Header->Width - X) * Bytes;
+          if((size_t)(End - Samples) < (size_t)RowSize * Rows)
+          {
+            Valid = false;
+            return DecodeBadFrame;
+          }
+          for(uint32_t Row = 0; Row < Rows; ++Row, Samples += RowSize)
+          {
+            memcpy(&Image[(size_t)((Y + Row) * Stride + (uint64_t)X * Bytes)], Samples, RowSize);
+          }
+        }
+      }
+      if(Keyframe && Samples != End)
+      {
+        Valid = false;
+        return DecodeBadFrame;
+      }
+
+      Current = *Header;
+      Valid = true;
+      return DecodeOk;
+    }
+
+    // Returns true once a keyframe was decoded
+    bool IsValid() const
+    {
+      return Valid;
+    }
+
+    // Returns the decoded samples, rows are GetWidth() * BytesPerPixel(GetEncoding()) Bytes apart
+    const uint8_t *GetData() const
+    {
+      return Image.data();
+    }
+
+    uint32_t GetWidth() const
+    {
+      return Valid ? Current.Width : 0;
+    }
+
+    uint32_t GetHeight() const
+    {
+      return Valid ? Current.Height : 0;
+    }
+
+    uint32_t GetEncoding() const
+    {
+      return Current.Encoding;
+    }
+
+    uint32_t GetSequence() const
+    {
+      return Current.Sequence;
+    }
+
+    // Converts the decoded image to meters, Out needs room for GetWidth() * GetHeight() floats
+    void ToMeters(float *Out) const
+    {
+      const size_t Count = (size_t)GetWidth() * GetHeight();
+      if(Current.Encoding == PacketFormat::EncodingF16)
+      {
+        const uint16_t *In = reinterpret_cast<const uint16_t *>(Image.data());
+        for(size_t i = 0; i < Count; ++i)
+        {
+          Out[i] = HalfToFloat(In[i]) * Current.Scale;
+        }
+      }
+      else if(Current.Encoding == PacketFormat::EncodingF32)
+      {
+        const float *In = reinterpret_cast<const float *>(Image.data());
+        for(size_t i = 0; i < Count; ++i)
+        {
+          Out[i] = In[i] * Current.Scale;
+        }
+      }
+    }
+  };
+}
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Messages exchanged with AVisionLockstepActor over its local TCP socket, in little endian byte order. This header
+ * only depends on the C++ standard library, so that dataset generators outside of Unreal can include it.
+ *
+ * The client sends a StepRequest, the world advances by Steps fixed time steps, all vision components are captured
+ * and once their packets are published the actor answers with a StepReply. Requests are handled one at a time.
+ */
+namespace LockstepProtocol
+{
+  const uint32_t Magic = 0x53564952; // "RIVS"
+
+  struct StepRequest
+  {
+    uint32_t Magic;
+    uint32_t Steps; // Number of fixed time steps to advance before the capture, 0 is handled like 1
+  };
+
+  struct StepReply
+  {
+    uint32_t Magic;
+    uint32_t Sequence; // Sequence number of the published packets, counting the captures since play began
+    uint64_t TimestampCapture; // Stamp of the published messages in nanoseconds, the simulated time since play began
+    uint32_t Cameras; // Number of cameras captured
+    uint32_t Reserved;
+  };
+
+  static_assert(sizeof(StepRequest) == 8, "StepRequest has to be packed");
+  static_assert(sizeof(StepReply) == 24, "StepReply has to be packed");
+}
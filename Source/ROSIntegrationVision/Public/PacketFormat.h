@@ -0,0 +1,259 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Self-describing format of the packets written by the PacketBuffer, either streamed or recorded to capture files.
+ * This header only depends on the C++ standard library, so that consumers outside of Unreal can include it to
+ * parse and validate packets.
+ *
+ * packet format:
+ * - PacketHeader
+ * - StreamDescriptor table with PacketHeader::StreamCount entries
+ * - Stream payloads, each one starting at a multiple of PayloadAlignment relative to the beginning of the packet
+ * - List of map entries starting at PacketHeader::OffsetMap, each one padded to a multiple of MapAlignment
+ */
+namespace PacketFormat
+{
+  const uint32_t Magic = 0x50564952; // "RIVP"
+  const uint32_t Version = 2;
+  const uint32_t PayloadAlignment = 64;
+  const uint32_t MapAlignment = 4;
+
+  enum StreamType : uint32_t
+  {
+    StreamColor = 0,
+    StreamDepth = 1,
+    StreamObject = 2,
+    StreamNormals = 3, // Unit surface normals in the optical frame of the camera, facing the camera
+    StreamFlow = 4, // Image motion in pixels since the previous frame
+    StreamRanges = 5 // Ranges in meters of an emulated lidar, one row per ring and one column per beam
+  };
+
+  enum StreamEncoding : uint32_t
+  {
+    EncodingBGR8 = 0, // 3 Bytes per pixel
+    EncodingBGRA8 = 1, // 4 Bytes per pixel
+    EncodingF16 = 2, // Half precision float per pixel
+    EncodingF32 = 3, // Single precision float per pixel
+    EncodingF32C2 = 4, // Two single precision floats per pixel
+    EncodingF32C3 = 5 // Three single precision floats per pixel
+  };
+
+  enum ParseResult
+  {
+    ParseOk = 0,
+    ParseTooSmall,
+    ParseBadMagic,
+    ParseBadVersion,
+    ParseBadHeader,
+    ParseBadStream,
+    ParseBadMap
+  };
+
+  struct Vector
+  {
+    float X;
+    float Y;
+    float Z;
+  };
+
+  struct Quaternion
+  {
+    float X;
+    float Y;
+    float Z;
+    float W;
+  };
+
+  struct PacketHeader
+  {
+    uint32_t Magic; // Magic
+    uint32_t Version; // Version of the packet format
+    uint32_t Size; // Size of the complete packet
+    uint32_t SizeHeader; // Size of the header including the stream descriptor table
+    uint32_t StreamCount; // Number of entries in the stream descriptor table
+    uint32_t MapEntries; // Number of map entries at the end of the packet
+    uint32_t OffsetMap; // Offset of the first map entry
+    uint32_t Width; // Width of the camera images
+    uint32_t Height; // Height of the camera images
+    uint32_t Sequence; // Sequence number of the frame, increasing monotonically per component
+    uint64_t TimestampCapture; // Timestamp from capture in nanoseconds
+    uint64_t TimestampSent; // Timestamp from sending in nanoseconds
+    float FieldOfViewX; // FOV in X direction, 360 for panoramas
+    float FieldOfViewY; // FOV in Y dircetion, 180 for equirectangular panoramas, cylindrical ones have less
+    Vector Translation; // Translation of the camera for current frame
+    Quaternion Rotation; // Rotation of the camera for current frame
+  };
+
+  struct StreamDescriptor
+  {
+    uint32_t Type; // StreamType
+    uint32_t Encoding; // StreamEncoding
+    uint32_t Width; // Width of the image in pixels
+    uint32_t Height; // Height of the image in pixels
+    uint32_t Offset; // Offset of the payload from the beginning of the packet, a multiple of PayloadAlignment
+    uint32_t Stride; // Bytes per row
+    uint32_t Size; // Size of the payload
+    float Scale; // Factor converting the values to SI units, e.g. centimeters to meters for depth
+  };
+
+  struct MapEntry
+  {
+    uint32_t Size; // Size of the complete map entry, including the padding
+    uint32_t NameLength; // Length of the name in Bytes, without a trailing '\0'
+    uint8_t R; // Red channel
+    uint8_t G; // Green channel
+    uint8_t B; // Blue channel
+    uint8_t Reserved;
+    char FirstChar; // Position of the first character of the name
+  };
+
+  // A validated packet, all pointers point into the parsed data
+  struct Packet
+  {
+    const uint8_t *Data;
+    const PacketHeader *Header;
+    const StreamDescriptor *Streams;
+  };
+
+  inline uint32_t Align(const uint32_t Value, const uint32_t To)
+  {
+    return (Value + To - 1) / To * To;
+  }
+
+  // Bytes per pixel of the encoding, 0 if the encoding is unknown
+  inline uint32_t BytesPerPixel(const uint32_t Encoding)
+  {
+    switch(Encoding)
+    {
+    case EncodingBGR8:
+      return 3;
+    case EncodingBGRA8:
+      return 4;
+    case EncodingF16:
+      return 2;
+    case EncodingF32:
+      return 4;
+    case EncodingF32C2:
+      return 8;
+    case EncodingF32C3:
+      return 12;
+    }
+    return 0;
+  }
+
+  // Size of a map entry with a name of the given length, computed in 64 bits so that it can not wrap around
+  inline uint64_t MapEntrySize(const uint32_t NameLength)
+  {
+    return ((uint64_t)offsetof(MapEntry, FirstChar) + NameLength + MapAlignment - 1) / MapAlignment * MapAlignment;
+  }
+
+  // Validates the packet at the beginning of Data and fills in Out
+  inline ParseResult Parse(const uint8_t *Data, const size_t Size, Packet &Out)
+  {
+    if(Size < sizeof(PacketHeader))
+    {
+      return ParseTooSmall;
+    }
+
+    const PacketHeader *Header = reinterpret_cast<const PacketHeader *>(Data);
+    if(Header->Magic != Magic)
+    {
+      return ParseBadMagic;
+    }
+    if(Header->Version != Version)
+    {
+      return ParseBadVersion;
+    }
+    if(Header->Size > Size)
+    {
+      return ParseTooSmall;
+    }
+    if(Header->SizeHeader != sizeof(PacketHeader) + (uint64_t)Header->StreamCount * sizeof(StreamDescriptor) || Header->SizeHeader > Header->Size)
+    {
+      return ParseBadHeader;
+    }
+
+    const StreamDescriptor *Streams = reinterpret_cast<const StreamDescriptor *>(Data + sizeof(PacketHeader));
+    for(uint32_t i = 0; i < Header->StreamCount; ++i)
+    {
+      const StreamDescriptor &Stream = Streams[i];
+      const uint32_t Bytes = BytesPerPixel(Stream.Encoding);
+      if(Stream.Offset % PayloadAlignment != 0 || Stream.Offset < Header->SizeHeader
+         || (uint64_t)Stream.Offset + Stream.Size > Header->Size
+         || (Bytes != 0 && (uint64_t)Stream.Stride < (uint64_t)Stream.Width * Bytes)
+         || (uint64_t)Stream.Size < (uint64_t)Stream.Stride * Stream.Height)
+      {
+        return ParseBadStream;
+      }
+
+      // Payloads must not overlap
+      for(uint32_t j = 0; j < i; ++j)
+      {
+        if(Stream.Offset < Streams[j].Offset + Streams[j].Size && Streams[j].Offset < Stream.Offset + Stream.Size)
+        {
+          return ParseBadStream;
+        }
+      }
+    }
+
+    uint64_t OffsetMap = Header->OffsetMap;
+    if(OffsetMap < Header->SizeHeader || OffsetMap % MapAlignment != 0)
+    {
+      return ParseBadMap;
+    }
+    for(uint32_t i = 0; i < Header->MapEntries; ++i)
+    {
+      if(OffsetMap + offsetof(MapEntry, FirstChar) > Header->Size)
+      {
+        return ParseBadMap;
+      }
+      const MapEntry *Entry = reinterpret_cast<const MapEntry *>(Data + OffsetMap);
+      // The name has to fit into the rest of the packet, consumers read NameLength characters
+      if(Entry->Size < offsetof(MapEntry, FirstChar) || Entry->NameLength > Header->Size - OffsetMap - offsetof(MapEntry, FirstChar)
+         || Entry->Size != MapEntrySize(Entry->NameLength) || OffsetMap + Entry->Size > Header->Size)
+      {
+        return ParseBadMap;
+      }
+      OffsetMap += Entry->Size;
+    }
+
+    Out.Data = Data;
+    Out.Header = Header;
+    Out.Streams = Streams;
+    return ParseOk;
+  }
+
+  // Returns the first stream of the given type, nullptr if the packet has none
+  inline const StreamDescriptor *FindStream(const Packet &In, const uint32_t Type)
+  {
+    for(uint32_t i = 0; i < In.Header->StreamCount; ++i)
+    {
+      if(In.Streams[i].Type == Type)
+      {
+        return &In.Streams[i];
+      }
+    }
+    return nullptr;
+  }
+
+  inline const uint8_t *StreamData(const Packet &In, const StreamDescriptor &Stream)
+  {
+    return In.Data + Stream.Offset;
+  }
+
+  // Returns the first map entry, iterate with NextMapEntry for PacketHeader::MapEntries entries
+  inline const MapEntry *FirstMapEntry(const Packet &In)
+  {
+    return reinterpret_cast<const MapEntry *>(In.Data + In.Header->OffsetMap);
+  }
+
+  inline const MapEntry *NextMapEntry(const MapEntry *Entry)
+  {
+    return reinterpret_cast<const MapEntry *>(reinterpret_cast<const uint8_t *>(Entry) + Entry->Size);
+  }
+}
@@ -9,6 +9,55 @@
 
 #include "VisionComponent.generated.h"
 
+class RenderTargetReadback;
+class ULevel;
+
+UENUM()
+enum class EVisionDepthEncoding : uint8
+{
+  Float32 UMETA(DisplayName = "32FC1 (meters)"),
+  Millimeters16 UMETA(DisplayName = "16UC1 (millimeters)"),
+  HalfPassthrough UMETA(DisplayName = "16FC1 (half float passthrough)")
+};
+
+UENUM()
+enum class EVisionPanorama : uint8
+{
+  None UMETA(DisplayName = "None"),
+  Equirectangular UMETA(DisplayName = "Equirectangular (360 x 180 degrees)"),
+  Cylindrical UMETA(DisplayName = "Cylindrical (360 degrees x field of view)")
+};
+
+// A lidar emulated from the depth image of the camera, mounted at the camera link
+USTRUCT()
+struct ROSINTEGRATIONVISION_API FVisionLidar
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    FString Topic = TEXT("scan"); // Topic below TopicNamespace.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool PointCloud = false; // Publishes a PointCloud2 with ring and time fields instead of a LaserScan of the first ring.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 Rings = 1; // Number of beams vertically.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 Columns = 360; // Number of beams horizontally.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MinAzimuth = -45; // Angle in degrees of the first column, counter-clockwise from forward.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MaxAzimuth = 45; // Angle in degrees of the last column.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MinElevation = 0; // Angle in degrees of the first ring, upwards from forward.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MaxElevation = 0; // Angle in degrees of the last ring.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MinRange = 0.1f; // Ranges in meters below this are published as -Inf.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MaxRange = 30; // Ranges in meters above this are published as +Inf.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float ScanTime = 0; // Duration of a sweep in seconds, the time of the beams increases by ScanTime / Columns per column.
+};
+
 UCLASS()
 class ROSINTEGRATIONVISION_API UVisionComponent : public UCameraComponent
 {
@@ -19,8 +68,29 @@ public:
   ~UVisionComponent();
   
   void SetFramerate(const float _FrameRate);
+  // Changes resolution and field of view, the buffers are reallocated before the next capture
+  void SetResolution(const uint32 _Width, const uint32 _Height, const float _FieldOfView);
   void Pause(const bool _Pause = true);
   bool IsPaused() const;
+  // Rigged cameras are captured by their rig instead of their own tick, the baseline in meters to the
+  // first camera of the rig is published in the projection matrix of the camera info
+  void SetRig(const bool _Rigged, const float _StereoBaseline = 0);
+  // Stepped cameras only render when captured, so that a capture shows the world of the current frame
+  void SetLockstep();
+  // Starts a capture with the given sequence number and stamp. With GPU conversion or a panorama the readbacks are only
+  // enqueued, the rendering commands have to be flushed before FinishCapture.
+  void BeginCapture(const uint32 Sequence, const uint64 TimestampCapture);
+  // Completes the packet of BeginCapture, then records and publishes it
+  void FinishCapture();
+  // Publishes all packets still in the pipeline and waits until their batched messages were handed to ROS
+  void WaitPublished();
+  // Stamp for ROS messages in nanoseconds, simulation time or wall time advancing monotonically
+  uint64 GetTimestamp() const;
+  static uint64 MonotonicTime();
+  // Average time in milliseconds from capture to publish of the last 100 frames
+  float GetLatency() const;
+  // Capture rate currently used, adapted to the pipeline with AdaptiveFramerate
+  float GetFramerate() const;
   
   UPROPERTY(EditAnywhere, Category = "Vision Component")
     FString ParentLink; // Defines the link that binds to the image frame.
@@ -34,8 +104,106 @@ public:
     float Framerate;
   UPROPERTY(EditAnywhere, Category = "Vision Component")
     bool UseEngineFramerate; 
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool AdaptiveFramerate; // Lowers the capture rate, then the resolution, while the pipeline can not keep up and raises them again with headroom.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MinFramerate; // Lowest capture rate of the adaptive controller.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MaxFramerate; // Highest capture rate of the adaptive controller, with UseEngineFramerate every tick is captured while it is reached.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float TargetLatency; // Average latency in ms from capture to publish the adaptive controller keeps the pipeline below.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float MaxStall; // Fraction of the time the game thread may wait for the pipeline before the adaptive controller lowers the rate.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    TArray<FIntPoint> ResolutionLadder; // Resolutions below Width x Height the adaptive controller steps down to at MinFramerate, from highest to lowest.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool UseSimulationTime; // Stamps the frames with the world time instead of the wall clock.
   UPROPERTY(EditAnywhere, Category = "Vision Component")
     int32 ServerPort;
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    FString RecordFile; // Records every captured packet to this capture file, relative paths are inside the Saved directory.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool RecordCompressed; // Compresses the chunks of the capture file with LZ4.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    FString PlaybackFile; // Publishes the packets of this capture file instead of capturing, relative paths are inside the Saved directory.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float PlaybackRate; // Speed of the playback relative to the recording, 0 replays as fast as possible.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool PlaybackLoop; // Restarts the playback at the end of the capture file.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool UseGPUConversion; // Renders into BGRA8 and R32F targets and copies them into the packet without conversion on the CPU.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    UMaterialInterface * DepthMaterial; // Post process material writing the scene depth in meters, used with UseGPUConversion.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool VerifyGPUConversion; // Captures the first frame after configuring the GPU conversion also like the CPU path and logs how far the images differ.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool DepthDelta; // Publishes the depth as keyframes and changed tiles on image_depth_delta, decoded with DepthDelta.h.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 DepthKeyframeInterval; // Number of frames between two depth keyframes.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    EVisionDepthEncoding DepthEncoding; // Encoding of the published depth images, 16FC1 only with the CPU conversion.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthNearClip; // Depth closer than this in meters is published as invalid, 0 disables it.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthFarClip; // Depth farther than this in meters is published as invalid, 0 disables it.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    TArray<int32> ColorThreadCores; // Cores the color processing thread is pinned to, empty allows all cores.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    TArray<int32> DepthThreadCores; // Cores the depth processing thread is pinned to, empty allows all cores.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    TArray<int32> ObjectThreadCores; // Cores the object processing thread is pinned to, empty allows all cores.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool UseHugePages; // Backs the packet buffers with 2 MiB pages where the OS supports transparent huge pages.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool BatchPublish; // Publishes the messages of each tick from a background thread, batched with the other cameras.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 PipelineDepth; // Number of frames in flight. With more than 1 a frame is published in a later tick while the next ones are captured.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 ThreadPriority; // Priority of the processing threads relative to normal, from -2 (lowest) to 2 (highest).
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool SkipStaticFrames; // Republishes the last packet with a new stamp instead of rendering, while neither the camera nor a movable actor in its view moves.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float StaticTranslationTolerance; // Movements in meters below this are considered static.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float StaticRotationTolerance; // Rotations in degrees below this are considered static.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 StaticRefreshInterval; // Maximum number of republished frames before rendering again, e.g. for animations and lighting, 0 disables it.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool PublishObjects; // Colors all objects and publishes their bounding boxes, pixel counts and centroids on the objects topic.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool PublishNormals; // Computes surface normals from the depth and publishes them on image_normals (32FC3).
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    bool PublishFlow; // Computes the image motion caused by the camera motion since the previous frame and publishes it on image_flow (32FC2).
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DistortionK1; // Radial distortion coefficient of the plumb_bob model, published in CameraInfo.D.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DistortionK2; // Radial distortion coefficient of the plumb_bob model.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DistortionP1; // Tangential distortion coefficient of the plumb_bob model.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DistortionP2; // Tangential distortion coefficient of the plumb_bob model.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DistortionK3; // Radial distortion coefficient of the plumb_bob model.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 NoiseSeed; // Seed of the simulated sensor noise, the noise of a frame only depends on the seed and its sequence number.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthNoise; // Standard deviation of the depth noise in meters at 1 meter, grows quadratically with the depth.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthQuantization; // Step size of the depth in meters, 0 disables it.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthEdgeThreshold; // Depth difference in meters between neighbouring pixels that is considered an edge.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float DepthEdgeDropout; // Probability of invalidating depth on edges.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float ColorShotNoise; // Variance of the photon shot noise of the color image per intensity level.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    float ColorReadNoise; // Standard deviation of the read noise of the color image in intensity levels.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    EVisionPanorama Panorama; // Renders the six faces of a cube map in one batch and publishes them stitched into one Width x Height color and depth image.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    int32 PanoramaFaceSize; // Resolution of the cube map faces, 0 uses Width / 4 which matches the resolution of the panorama at the horizon.
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    TArray<FVisionLidar> Lidars; // Lidars sampled from the depth of every frame and published with its stamp.
     
   // The cameras for color, depth and objects;
   UPROPERTY(EditAnywhere, Category = "Vision Component")
@@ -44,7 +212,14 @@ public:
   	USceneCaptureComponent2D * Depth;
   UPROPERTY(EditAnywhere, Category = "Vision Component")
     USceneCaptureComponent2D * Object;
+  // The cameras of the cube map faces of panoramas, created when play begins
+  UPROPERTY(VisibleAnywhere, Category = "Vision Component")
+    TArray<USceneCaptureComponent2D *> PanoramaColor;
+  UPROPERTY(VisibleAnywhere, Category = "Vision Component")
+    TArray<USceneCaptureComponent2D *> PanoramaDepth;
   
+  UPROPERTY(BlueprintReadWrite, Category = "Vision Component")
+    FString TopicNamespace = TEXT("/unreal_ros"); // Prefix of the image, depth and camera info topics.
   UPROPERTY(BlueprintReadWrite, Category = "Vision Component")
     FString ImageFrame = TEXT("/unreal_ros/image_frame");
   UPROPERTY(BlueprintReadWrite, Category = "Vision Component")
@@ -58,10 +233,20 @@ public:
    UTopic * ImagePublisher;
   UPROPERTY(EditAnywhere, Category = "Vision Component")
    UTopic * TFPublisher;
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    UTopic * ObjectPublisher;
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    UTopic * NormalsPublisher;
+  UPROPERTY(EditAnywhere, Category = "Vision Component")
+    UTopic * FlowPublisher;
+  // The publishers of the lidars, created when play begins
+  UPROPERTY(VisibleAnywhere, Category = "Vision Component")
+    TArray<UTopic *> LidarPublishers;
 
 protected:
   
   virtual void InitializeComponent() override;
+  virtual void OnRegister() override;
   virtual void BeginPlay() override;
   virtual void TickComponent(float DeltaTime, 
                              enum ELevelTick TickType,
@@ -77,13 +262,18 @@ private:
 	PrivateData *Priv;
 
 	UMaterialInstanceDynamic *MaterialDepthInstance;
+	// Color and depth render targets in the formats of the CPU path, the reference of VerifyGPUConversion
+	UPROPERTY(Transient)
+	UTextureRenderTarget2D *ReferenceColor;
+	UPROPERTY(Transient)
+	UTextureRenderTarget2D *ReferenceDepth;
   
-  TArray<FFloat16Color> ImageColor, ImageDepth, ImageObject;
   TArray<uint8> DataColor, DataDepth, DataObject;
   TArray<FColor> ObjectColors;
   TMap<FString, uint32> ObjectToColor;
   uint32 ColorsUsed;
-  bool Running, Paused;
+  bool Running, Paused, Rigged, Lockstep;
+  float StereoBaseline;
   
   void ShowFlagsBasicSetting(FEngineShowFlags &ShowFlags) const;
   void ShowFlagsLit(FEngineShowFlags &ShowFlags) const;
@@ -92,14 +282,38 @@ private:
   void ReadImageCompressed(UTextureRenderTarget2D *RenderTarget, TArray<FFloat16Color> &ImageData) const;
   void ToColorImage(const TArray<FFloat16Color> &ImageData, uint8 *Bytes) const;
   void ToDepthImage(const TArray<FFloat16Color> &ImageData, uint8 *Bytes) const;
-  void StoreImage(const uint8 *ImageData, const uint32 Size, const char *Name) const;
+  void ApplyDistortion(const uint32 StreamType, const uint32 Slot) const;
+  void ComputeObjects(const uint32 Slot);
+  void ComputeGeometry(const uint32 Slot);
+  void ComputeLidars(const uint32 Slot);
+  void CreatePanoramaFaces();
+  void CapturePanorama();
+  void StitchPanorama();
+  bool IsSceneStatic();
+  void TrackMovableActors();
+  void UntrackMovableActors();
+  void TrackActor(AActor *Actor);
+  void TrackLevel(ULevel *Level, UWorld *World);
+  void ApplyNoise(const uint32 StreamType, const uint32 Slot) const;
+  void ReadImageRaw(UTextureRenderTarget2D *RenderTarget, RenderTargetReadback &Readback, const int32 Stream) const;
+  void CaptureReference();
+  void VerifyConversion(const uint32 Slot) const;
+  void Configure();
+  void TickPlayback(const float DeltaTime);
+  void PublishMessage(UTopic *Topic, TSharedPtr<FROSBaseMsg> Message);
+  const uint8 *StorePayload(const uint8 *Data, const size_t Size);
+  uint8 *DepthOutput(const size_t Size);
+  uint8 *LidarOutput(const size_t Size, const int32 Lidar);
+  void FlushMessages();
+  void ApplyRateControl();
+  void PublishCompleted(const uint32 MaxInFlight);
+  void PublishRead();
+  void PublishPacket(const uint8 *Packet, const uint32 Size, const uint32 Sequence, const uint64 TimestampCapture);
   void GenerateColors(const uint32_t NumberOfColors);
   bool ColorObject(AActor *Actor, const FString &name);
   bool ColorAllObjects();
+  void DoneConverting(const uint32 Slot);
   void ProcessColor();
   void ProcessDepth();
   void ProcessObject();
-
-  // in must hold Width*Height*2(float) Bytes
-  void convertDepth(const uint16_t *in, __m128 *out) const;
 };
@@ -42,6 +42,7 @@ public class ROSIntegrationVision : ModuleRules
         "CoreUObject",
         "Engine",
         "RenderCore",
+        "RHI",
         "Sockets",
         "Networking",
         "ROSIntegration"
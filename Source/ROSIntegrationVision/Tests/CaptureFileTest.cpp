@@ -0,0 +1,219 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "PacketBuffer.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the capture file reader with recordings that were closed properly, not closed at all, truncated or
+ * corrupted. The reader may only return frames whose packets lie completely inside the file, so that playback never
+ * reads out of bounds, whatever the index or the chunks claim.
+ */
+namespace
+{
+  const char *Filename = "CaptureFileTest.rivc";
+  const uint32 Frames = 20;
+
+  std::vector<uint8> CreatePacket(const uint32 Frame)
+  {
+    // Packets of varying size, about two per chunk
+    std::vector<uint8> Packet(sizeof(PacketBuffer::PacketHeader) + 2000 + Frame * 97);
+    for(size_t i = sizeof(PacketBuffer::PacketHeader); i < Packet.size(); ++i)
+    {
+      Packet[i] = (uint8)(i * 31 + Frame);
+    }
+    PacketBuffer::PacketHeader *Header = reinterpret_cast<PacketBuffer::PacketHeader *>(Packet.data());
+    Header->Size = (uint32)Packet.size();
+    Header->Sequence = Frame;
+    Header->TimestampCapture = 1000000 + Frame * 50000000ull;
+    return Packet;
+  }
+
+  // Records the packets and returns the content of the closed file
+  std::vector<uint8> Record()
+  {
+    {
+      CaptureFileWriter Writer(Filename, 8192);
+      for(uint32 Frame = 0; Frame < Frames; ++Frame)
+      {
+        const std::vector<uint8> Packet = CreatePacket(Frame);
+        const PacketBuffer::PacketHeader *Header = reinterpret_cast<const PacketBuffer::PacketHeader *>(Packet.data());
+        Writer.Append(Packet.data(), Header->Size, Header->TimestampCapture, Header->Sequence);
+      }
+    }
+    std::ifstream File(Filename, std::ios::binary);
+    return std::vector<uint8>(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+  }
+
+  void Write(const std::vector<uint8> &Content)
+  {
+    std::ofstream File(Filename, std::ios::binary | std::ios::trunc);
+    File.write(reinterpret_cast<const char *>(Content.data()), Content.size());
+  }
+
+  const CaptureFile::FileFooter &Footer(const std::vector<uint8> &Content)
+  {
+    return *reinterpret_cast<const CaptureFile::FileFooter *>(Content.data() + Content.size() - sizeof(CaptureFile::FileFooter));
+  }
+
+  CaptureFile::IndexEntry &Entry(std::vector<uint8> &Content, const uint32 Frame)
+  {
+    return reinterpret_cast<CaptureFile::IndexEntry *>(Content.data() + Footer(Content).IndexOffset)[Frame];
+  }
+
+  CaptureFile::ChunkHeader &Chunk(std::vector<uint8> &Content, const uint32 Frame)
+  {
+    return *reinterpret_cast<CaptureFile::ChunkHeader *>(Content.data() + Entry(Content, Frame).Chunk);
+  }
+
+  // The first frame of the chunk after the one of the given frame
+  uint32 NextChunk(std::vector<uint8> &Content, const uint32 Frame)
+  {
+    uint32 Next = Frame;
+    while(Next < Frames && Entry(Content, Next).Chunk == Entry(Content, Frame).Chunk)
+    {
+      ++Next;
+    }
+    return Next;
+  }
+
+  // Returns true if every frame of the reader is the recorded packet
+  bool FramesIntact(CaptureFileReader &Reader)
+  {
+    for(uint32 Frame = 0; Frame < Reader.GetFrames(); ++Frame)
+    {
+      Reader.Prefetch(Frame);
+      const uint8 *Data = Reader.ReadFrame(Frame);
+      const std::vector<uint8> Packet = CreatePacket(Frame);
+      if(!Data || Reader.GetEntry(Frame).Size != Packet.size() || memcmp(Data, Packet.data(), Packet.size()) != 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+TEST_CASE(ClosedFileIsReadFromIndex)
+{
+  Record();
+  CaptureFileReader Reader(Filename);
+  REQUIRE(Reader.IsOpen());
+  CHECK(Reader.GetFrames() == Frames);
+  CHECK(FramesIntact(Reader));
+  CHECK(Reader.FindFrame(1000000 + 3 * 50000000ull) == 3);
+  CHECK(Reader.ReadFrame(Frames) == nullptr);
+}
+
+TEST_CASE(UnclosedFileIsRebuilt)
+{
+  std::vector<uint8> Content = Record();
+  Content.resize(Footer(Content).IndexOffset);
+  Write(Content);
+  CaptureFileReader Reader(Filename);
+  CHECK(Reader.GetFrames() == Frames);
+  CHECK(FramesIntact(Reader));
+}
+
+TEST_CASE(TruncatedChunkEndsIndex)
+{
+  std::vector<uint8> Content = Record();
+  // The file ends in the middle of the packets of a chunk
+  const uint32 Cut = 9;
+  const CaptureFile::IndexEntry Truncated = Entry(Content, Cut);
+  uint32 First = Cut;
+  while(First > 0 && Entry(Content, First - 1).Chunk == Truncated.Chunk)
+  {
+    --First;
+  }
+  Content.resize(Truncated.Chunk + CaptureFile::ChunkHeaderSize + Truncated.Offset + Truncated.Size / 2);
+  Write(Content);
+  CaptureFileReader Reader(Filename);
+  CHECK(Reader.GetFrames() == First);
+  CHECK(FramesIntact(Reader));
+}
+
+TEST_CASE(OversizedPacketEndsIndex)
+{
+  std::vector<uint8> Content = Record();
+  const uint32 Broken = 5;
+  const CaptureFile::IndexEntry Packet = Entry(Content, Broken);
+  Content.resize(Footer(Content).IndexOffset);
+  // A packet size running past the data of its chunk
+  PacketBuffer::PacketHeader *Header = reinterpret_cast<PacketBuffer::PacketHeader *>(
+    Content.data() + Packet.Chunk + CaptureFile::ChunkHeaderSize + Packet.Offset);
+  Header->Size = 0x7fffffff;
+  Write(Content);
+  CaptureFileReader Reader(Filename);
+  CHECK(Reader.GetFrames() == Broken);
+  CHECK(FramesIntact(Reader));
+}
+
+TEST_CASE(InvalidIndexEntriesAreRebuilt)
+{
+  const std::vector<uint8> Recorded = Record();
+  const size_t Members[] = {offsetof(CaptureFile::IndexEntry, Chunk), offsetof(CaptureFile::IndexEntry, Offset),
+                            offsetof(CaptureFile::IndexEntry, Size)};
+  for(const size_t Member : Members)
+  {
+    // Entries pointing beyond the file, past the data of their chunk or into the middle of a chunk
+    std::vector<uint8> Content = Recorded;
+    uint8 *Field = reinterpret_cast<uint8 *>(&Entry(Content, 7)) + Member;
+    if(Member == offsetof(CaptureFile::IndexEntry, Chunk))
+    {
+      *reinterpret_cast<uint64 *>(Field) += 64;
+    }
+    else
+    {
+      *reinterpret_cast<uint32 *>(Field) = 0xfffff000;
+    }
+    Write(Content);
+    const uint32 Warnings = ShimLog::Warnings;
+    CaptureFileReader Reader(Filename);
+    CHECK(ShimLog::Warnings > Warnings);
+    CHECK(Reader.GetFrames() == Frames);
+    CHECK(FramesIntact(Reader));
+  }
+
+  // An index larger than the file
+  std::vector<uint8> Content = Recorded;
+  const_cast<CaptureFile::FileFooter &>(Footer(Content)).Frames = ~0ull / sizeof(CaptureFile::IndexEntry) + 2;
+  Write(Content);
+  CaptureFileReader Reader(Filename);
+  CHECK(Reader.GetFrames() == Frames);
+  CHECK(FramesIntact(Reader));
+}
+
+TEST_CASE(InconsistentChunkEndsIndex)
+{
+  std::vector<uint8> Content = Record();
+  const uint32 Broken = NextChunk(Content, NextChunk(Content, 0));
+  REQUIRE(Broken < Frames);
+
+  // Uncompressed data claiming to be larger than stored, then a chunk without its magic
+  Chunk(Content, Broken).RawSize += 4096;
+  Write(Content);
+  {
+    CaptureFileReader Reader(Filename);
+    CHECK(Reader.GetFrames() == Broken);
+    CHECK(FramesIntact(Reader));
+  }
+  Chunk(Content, Broken).RawSize -= 4096;
+  Chunk(Content, Broken).Magic = 0;
+  Write(Content);
+  CaptureFileReader Reader(Filename);
+  CHECK(Reader.GetFrames() == Broken);
+  CHECK(FramesIntact(Reader));
+}
+
+int main()
+{
+  const int Result = TestHarness::RunTests();
+  remove(Filename);
+  return Result;
+}
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <vector>
+
+#include "DepthDelta.h"
+#include "DepthDeltaEncoder.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the depth delta decoder, which subscribers use on frames received over the network. Frames of the encoder
+ * have to decode to the encoded images, malformed frames have to be rejected without touching memory outside of the
+ * decoded image, whatever their header claims.
+ */
+namespace
+{
+  const uint32 Width = 45, Height = 37;
+
+  PacketFormat::StreamDescriptor DepthStream()
+  {
+    PacketFormat::StreamDescriptor Stream = {};
+    Stream.Type = PacketFormat::StreamDepth;
+    Stream.Encoding = PacketFormat::EncodingF32;
+    Stream.Width = Width;
+    Stream.Height = Height;
+    Stream.Stride = Width * sizeof(float);
+    return Stream;
+  }
+
+  std::vector<float> CreateImage(const uint32 Frame)
+  {
+    std::vector<float> Image(Width * Height);
+    for(uint32 i = 0; i < Width * Height; ++i)
+    {
+      Image[i] = 100.0f + i;
+    }
+    // A few tiles change per frame
+    for(uint32 Y = 0; Y < 5; ++Y)
+    {
+      Image[(Y + Frame) % Height * Width + Frame % Width] = (float)Frame;
+    }
+    return Image;
+  }
+
+  std::vector<uint8> Encode(DepthDeltaEncoder &Encoder, const std::vector<float> &Image, const uint32 Sequence)
+  {
+    const AlignedBytes &Frame = Encoder.Encode(DepthStream(), reinterpret_cast<const uint8 *>(Image.data()), 0.01f, Sequence);
+    return std::vector<uint8>(Frame.begin(), Frame.end());
+  }
+
+  DepthDelta::FrameHeader &Header(std::vector<uint8> &Frame)
+  {
+    return *reinterpret_cast<DepthDelta::FrameHeader *>(Frame.data());
+  }
+
+  bool Decoded(const DepthDelta::Decoder &Decoder, const std::vector<float> &Image)
+  {
+    return Decoder.IsValid() && Decoder.GetWidth() == Width && Decoder.GetHeight() == Height
+           && memcmp(Decoder.GetData(), Image.data(), Image.size() * sizeof(float)) == 0;
+  }
+}
+
+TEST_CASE(DecodesKeyframesAndDeltas)
+{
+  DepthDeltaEncoder Encoder(4);
+  DepthDelta::Decoder Decoder;
+  for(uint32 Sequence = 0; Sequence < 10; ++Sequence)
+  {
+    const std::vector<float> Image = CreateImage(Sequence);
+    std::vector<uint8> Frame = Encode(Encoder, Image, Sequence);
+    const bool Keyframe = (Header(Frame).Flags & DepthDelta::FlagKeyframe) != 0;
+    CHECK(Keyframe == (Sequence % 4 == 0));
+    CHECK(Keyframe || Frame.size() < Image.size() * sizeof(float) / 2);
+    CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeOk);
+    CHECK(Decoded(Decoder, Image));
+  }
+}
+
+TEST_CASE(DeltaWithoutReferenceNeedsKeyframe)
+{
+  DepthDeltaEncoder Encoder(8);
+  DepthDelta::Decoder Decoder;
+  Encode(Encoder, CreateImage(0), 0);
+  std::vector<uint8> Delta = Encode(Encoder, CreateImage(1), 1);
+  CHECK(Decoder.Decode(Delta.data(), Delta.size()) == DepthDelta::DecodeNeedKeyframe);
+  CHECK(!Decoder.IsValid());
+}
+
+TEST_CASE(RejectsOverflowingSizes)
+{
+  DepthDeltaEncoder Encoder(8);
+  const std::vector<uint8> Keyframe = Encode(Encoder, CreateImage(0), 0);
+  // Sizes whose stride, mask or image size wrap around in 32 bits, e.g. a stride of 0x40000000 * 4 Bytes
+  const uint32 Sizes[][2] = {{0x40000000, 1}, {0x40000000, 0x40000000}, {0xffffffff, 0xffffffff}, {0x10000, 0x10000},
+                             {0xfffffff0, 16}};
+  for(const auto &Size : Sizes)
+  {
+    std::vector<uint8> Frame = Keyframe;
+    Header(Frame).Width = Size[0];
+    Header(Frame).Height = Size[1];
+    DepthDelta::Decoder Decoder;
+    CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeBadFrame);
+    CHECK(!Decoder.IsValid());
+  }
+}
+
+TEST_CASE(RejectsIncompleteKeyframes)
+{
+  DepthDeltaEncoder Encoder(8);
+  const std::vector<float> First = CreateImage(0);
+  const std::vector<uint8> Keyframe = Encode(Encoder, First, 0);
+  const size_t MaskOffset = sizeof(DepthDelta::FrameHeader);
+
+  // A keyframe without the first tile would keep the tile of the previous image
+  std::vector<uint8> Frame = Keyframe;
+  Frame[MaskOffset] &= ~1;
+  DepthDelta::Decoder Decoder;
+  CHECK(Decoder.Decode(Keyframe.data(), Keyframe.size()) == DepthDelta::DecodeOk);
+  CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeBadFrame);
+  CHECK(!Decoder.IsValid());
+
+  // Fewer tiles than the image has, with the size of the stored tiles
+  Frame = Keyframe;
+  Header(Frame).ChangedTiles -= 1;
+  CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeBadFrame);
+
+  // Samples missing or left over
+  Frame = Keyframe;
+  Header(Frame).Size -= 4;
+  CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeBadFrame);
+  Frame = Keyframe;
+  Frame.resize(Frame.size() + 64);
+  Header(Frame).Size += 64;
+  CHECK(Decoder.Decode(Frame.data(), Frame.size()) == DepthDelta::DecodeBadFrame);
+
+  // Larger than the received data
+  Frame = Keyframe;
+  CHECK(Decoder.Decode(Frame.data(), Frame.size() - 1) == DepthDelta::DecodeBadFrame);
+  CHECK(Decoder.Decode(Keyframe.data(), Keyframe.size()) == DepthDelta::DecodeOk);
+  CHECK(Decoded(Decoder, First));
+}
+
+TEST_CASE(RejectsTruncatedDeltas)
+{
+  DepthDeltaEncoder Encoder(8);
+  DepthDelta::Decoder Decoder;
+  std::vector<uint8> Keyframe = Encode(Encoder, CreateImage(0), 0);
+  std::vector<uint8> Delta = Encode(Encoder, CreateImage(1), 1);
+  CHECK(Decoder.Decode(Keyframe.data(), Keyframe.size()) == DepthDelta::DecodeOk);
+  // All tiles marked as changed, but only the samples of the changed ones stored
+  memset(Delta.data() + sizeof(DepthDelta::FrameHeader), 0xff, DepthDelta::MaskSize(Width, Height));
+  CHECK(Decoder.Decode(Delta.data(), Delta.size()) == DepthDelta::DecodeBadFrame);
+  CHECK(!Decoder.IsValid());
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <cmath>
+#include <vector>
+
+#include "LensDistortion.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the remap table of the lens distortion, which is limited to 65535 pixels per side. Larger images must
+ * neither write past the table nor be distorted with a table of another size.
+ */
+namespace
+{
+  PacketFormat::StreamDescriptor DepthStream(const uint32 Width, const uint32 Height)
+  {
+    PacketFormat::StreamDescriptor Stream = {};
+    Stream.Type = PacketFormat::StreamDepth;
+    Stream.Encoding = PacketFormat::EncodingF32;
+    Stream.Width = Width;
+    Stream.Height = Height;
+    Stream.Stride = Width * sizeof(float);
+    Stream.Scale = 1.0f;
+    return Stream;
+  }
+
+  std::vector<float> CreateDepth(const uint32 Width, const uint32 Height)
+  {
+    std::vector<float> Depth((size_t)Width * Height);
+    for(size_t i = 0; i < Depth.size(); ++i)
+    {
+      Depth[i] = 1.0f + i % 1000;
+    }
+    return Depth;
+  }
+}
+
+TEST_CASE(ZeroDistortionKeepsImage)
+{
+  const uint32 Width = 80, Height = 60;
+  LensDistortion Lens(Width, Height, 70.0, Width / 2.0, Height / 2.0, {0, 0, 0, 0, 0});
+  std::vector<float> Depth = CreateDepth(Width, Height);
+  const std::vector<float> Original = Depth;
+  AlignedBytes Scratch;
+  Lens.Apply(DepthStream(Width, Height), reinterpret_cast<uint8 *>(Depth.data()), Scratch);
+  CHECK(Depth == Original);
+}
+
+TEST_CASE(BarrelDistortionInvalidatesCorners)
+{
+  const uint32 Width = 80, Height = 60;
+  LensDistortion Lens(Width, Height, 50.0, Width / 2.0, Height / 2.0, {-0.1f, 0, 0, 0, 0});
+  std::vector<float> Depth = CreateDepth(Width, Height);
+  AlignedBytes Scratch;
+  Lens.Apply(DepthStream(Width, Height), reinterpret_cast<uint8 *>(Depth.data()), Scratch);
+  CHECK(std::isfinite(Depth[Height / 2 * Width + Width / 2]));
+  CHECK(std::isnan(Depth[0]));
+}
+
+TEST_CASE(SizesBeyondTableAreClamped)
+{
+  // The table is 65535 x 2, the loops used to run over the requested width and write past it
+  const uint32 Width = 70000, Height = 2;
+  LensDistortion Lens(Width, Height, 35000.0, Width / 2.0, Height / 2.0, {0.1f, 0, 0, 0, 0});
+
+  // Streams of the requested size do not match the table and stay unchanged
+  std::vector<float> Depth = CreateDepth(Width, Height);
+  const std::vector<float> Original = Depth;
+  AlignedBytes Scratch;
+  Lens.Apply(DepthStream(Width, Height), reinterpret_cast<uint8 *>(Depth.data()), Scratch);
+  CHECK(Depth == Original);
+
+  // Streams of the clamped size are distorted with a table computed for that size
+  std::vector<float> Clamped = CreateDepth(65535, Height);
+  Lens.Apply(DepthStream(65535, Height), reinterpret_cast<uint8 *>(Clamped.data()), Scratch);
+  uint32 Valid = 0;
+  for(const float Value : Clamped)
+  {
+    Valid += std::isfinite(Value);
+  }
+  CHECK(Valid > 0 && Valid <= 65535u * Height);
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
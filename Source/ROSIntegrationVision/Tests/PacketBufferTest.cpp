@@ -0,0 +1,518 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "PacketBuffer.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the packet ring shared by the game thread, the processing threads and the publishing side. The pipeline
+ * is emulated like in UVisionComponent: one thread starts the packets, several workers complete them in any order,
+ * one thread reads them in order and leases some of them to a publisher, which checks that a leased packet is not
+ * overwritten before it releases the lease.
+ */
+namespace
+{
+  typedef TSharedPtr<PacketBuffer::Lease, ESPMode::ThreadSafe> LeasePtr;
+
+  // Frames/s of a VGA camera without sanitizers, far below what the ring allows, so that only a regression like
+  // serialized slots or lost wakeups fails it
+  const double MinimumFramesPerSecond = 60;
+
+  TMap<FString, uint32> ObjectToColor()
+  {
+    TMap<FString, uint32> Map;
+    Map.Add("Cube", 0);
+    Map.Add("Sphere", 1);
+    return Map;
+  }
+
+  const TArray<FColor> ObjectColors = {FColor(255, 0, 0), FColor(0, 255, 0)};
+
+  // Byte at Index of the given stream of the packet with the given sequence number
+  uint8 Pattern(const uint32 Sequence, const uint32 Stream, const uint32 Index)
+  {
+    return (uint8)(Sequence * 31 + Stream * 7 + Index);
+  }
+
+  void WritePayloads(PacketBuffer &Buffer, const uint32 Slot, const uint32 Sequence)
+  {
+    for(size_t Stream = 0; Stream < Buffer.Streams.size(); ++Stream)
+    {
+      uint8 *Data = Buffer.GetWriteStream(Slot, Stream);
+      for(uint32 i = 0; i < Buffer.Streams[Stream].Size; ++i)
+      {
+        Data[i] = Pattern(Sequence, Stream, i);
+      }
+    }
+  }
+
+  // Returns true if the packet has the given sequence number, its payloads the pattern and the map both entries
+  bool CheckPacket(const PacketBuffer &Buffer, const uint8 *Packet, const uint32 Sequence)
+  {
+    const PacketBuffer::PacketHeader *Header = reinterpret_cast<const PacketBuffer::PacketHeader *>(Packet);
+    if(Header->Magic != PacketFormat::Magic || Header->Sequence != Sequence || Header->MapEntries != 2)
+    {
+      return false;
+    }
+    for(size_t Stream = 0; Stream < Buffer.Streams.size(); ++Stream)
+    {
+      const uint8 *Data = Packet + Buffer.Streams[Stream].Offset;
+      uint8 Difference = 0;
+      for(uint32 i = 0; i < Buffer.Streams[Stream].Size; ++i)
+      {
+        Difference |= Data[i] ^ Pattern(Sequence, Stream, i);
+      }
+      if(Difference != 0)
+      {
+        return false;
+      }
+    }
+    const PacketBuffer::MapEntry *Entry = reinterpret_cast<const PacketBuffer::MapEntry *>(Packet + Header->OffsetMap);
+    return Entry->NameLength == 4 && memcmp(&Entry->FirstChar, "Cube", 4) == 0 && Entry->R == 255;
+  }
+
+  struct PipelineSettings
+  {
+    uint32 Workers;
+    uint32 Frames;
+    uint32 FirstSequence;
+    // Every LeaseEvery-th packet is leased to the publisher, 0 leases none
+    uint32 LeaseEvery;
+    // After every RestartEvery-th packet the writer pauses and the packet is read again, 0 never rereads
+    uint32 RestartEvery;
+  };
+
+  struct PipelineResult
+  {
+    uint32 Read;
+    uint32 Errors;
+    double Seconds;
+  };
+
+  // Writes, reads and publishes the frames and returns once all leases are released
+  PipelineResult RunPipeline(PacketBuffer &Buffer, const PipelineSettings &Settings)
+  {
+    std::mutex Lock;
+    std::condition_variable CVJobs, CVLeases, CVConsumed;
+    std::deque<std::pair<uint32, uint32>> Jobs;
+    std::deque<std::tuple<LeasePtr, const uint8 *, uint32>> Leases;
+    bool JobsDone = false, LeasesDone = false;
+    uint32 Consumed = 0;
+    std::atomic<uint32> Errors(0);
+
+    const auto Start = std::chrono::steady_clock::now();
+
+    // Processing threads completing the packets out of order
+    std::vector<std::thread> Workers;
+    for(uint32 Worker = 0; Worker < Settings.Workers; ++Worker)
+    {
+      Workers.emplace_back([&, Worker]
+      {
+        std::minstd_rand Random(Worker + 1);
+        while(true)
+        {
+          std::pair<uint32, uint32> Job;
+          {
+            std::unique_lock<std::mutex> WaitLock(Lock);
+            CVJobs.wait(WaitLock, [&] {return !Jobs.empty() || JobsDone; });
+            if(Jobs.empty())
+            {
+              return;
+            }
+            Job = Jobs.front();
+            Jobs.pop_front();
+          }
+          if(Random() % 4 == 0)
+          {
+            std::this_thread::yield();
+          }
+          WritePayloads(Buffer, Job.first, Job.second);
+          Buffer.DoneWriting(Job.first);
+        }
+      });
+    }
+
+    // Publisher checking the leased packets before it releases them
+    std::thread Publisher([&]
+    {
+      std::minstd_rand Random(1234);
+      while(true)
+      {
+        std::tuple<LeasePtr, const uint8 *, uint32> Leased;
+        {
+          std::unique_lock<std::mutex> WaitLock(Lock);
+          CVLeases.wait(WaitLock, [&] {return !Leases.empty() || LeasesDone; });
+          if(Leases.empty())
+          {
+            return;
+          }
+          Leased = Leases.front();
+          Leases.pop_front();
+        }
+        if(Random() % 2 == 0)
+        {
+          std::this_thread::yield();
+        }
+        if(!CheckPacket(Buffer, std::get<1>(Leased), std::get<2>(Leased)))
+        {
+          fprintf(stderr, "leased packet %u was overwritten\n", std::get<2>(Leased));
+          ++Errors;
+        }
+      }
+    });
+
+    // Reading thread, reads the packets in order
+    std::thread Reader([&]
+    {
+      for(uint32 Frame = 0; Frame < Settings.Frames; ++Frame)
+      {
+        const uint32 Sequence = Settings.FirstSequence + Frame;
+        if(!Buffer.StartReading())
+        {
+          ++Errors;
+          return;
+        }
+        if(!CheckPacket(Buffer, Buffer.Read, Sequence))
+        {
+          fprintf(stderr, "packet %u is corrupted or out of order, read %u\n", Sequence, Buffer.HeaderRead->Sequence);
+          ++Errors;
+        }
+        if(Settings.LeaseEvery > 0 && Frame % Settings.LeaseEvery == 0)
+        {
+          LeasePtr Lease = Buffer.LeaseRead();
+          std::lock_guard<std::mutex> Guard(Lock);
+          Leases.emplace_back(Lease, Buffer.Read, Sequence);
+          CVLeases.notify_one();
+        }
+        Buffer.DoneReading();
+
+        if(Settings.RestartEvery > 0 && (Frame + 1) % Settings.RestartEvery == 0)
+        {
+          Buffer.RestartReading();
+          if(!CheckPacket(Buffer, Buffer.Read, Sequence))
+          {
+            fprintf(stderr, "packet %u is not the same when read again\n", Sequence);
+            ++Errors;
+          }
+          Buffer.DoneReading();
+        }
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        ++Consumed;
+        CVConsumed.notify_all();
+      }
+    });
+
+    // Starting the packets like the game thread
+    for(uint32 Frame = 0; Frame < Settings.Frames; ++Frame)
+    {
+      if(Settings.RestartEvery > 0 && Frame > 0 && Frame % Settings.RestartEvery == 0)
+      {
+        std::unique_lock<std::mutex> WaitLock(Lock);
+        CVConsumed.wait(WaitLock, [&] {return Consumed == Frame; });
+      }
+      if(!Buffer.StartWriting(ObjectToColor(), ObjectColors))
+      {
+        ++Errors;
+        break;
+      }
+      const uint32 Slot = Buffer.GetWriteSlot();
+      Buffer.GetWriteHeader(Slot)->Sequence = Settings.FirstSequence + Frame;
+
+      std::lock_guard<std::mutex> Guard(Lock);
+      Jobs.emplace_back(Slot, Settings.FirstSequence + Frame);
+      CVJobs.notify_one();
+    }
+
+    Reader.join();
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      JobsDone = true;
+      LeasesDone = true;
+    }
+    CVJobs.notify_all();
+    CVLeases.notify_all();
+    for(std::thread &Worker : Workers)
+    {
+      Worker.join();
+    }
+    Publisher.join();
+
+    const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    return {Consumed, Errors, Seconds};
+  }
+}
+
+TEST_CASE(ManyWritersOneReader)
+{
+  for(const uint32 Slots : {1u, 2u, 4u})
+  {
+    PacketBuffer Buffer(64, 48, 90.0f, PacketBuffer::DefaultStreams(64, 48), false, Slots);
+    PipelineResult Result;
+    TestHarness::CompleteWithin(60, "ManyWritersOneReader", [&]
+    {
+      Result = RunPipeline(Buffer, {4, 2000, 0, 3, 0});
+    });
+    CHECK(Result.Read == 2000);
+    CHECK(Result.Errors == 0);
+  }
+}
+
+TEST_CASE(RestartReadingRereadsLastPacket)
+{
+  for(const uint32 Slots : {1u, 3u})
+  {
+    PacketBuffer Buffer(64, 48, 90.0f, PacketBuffer::DefaultStreams(64, 48), false, Slots);
+    PipelineResult Result;
+    TestHarness::CompleteWithin(60, "RestartReadingRereadsLastPacket", [&]
+    {
+      Result = RunPipeline(Buffer, {3, 1000, 0, 2, 7});
+    });
+    CHECK(Result.Read == 1000);
+    CHECK(Result.Errors == 0);
+  }
+}
+
+TEST_CASE(ReleaseUnblocksWriting)
+{
+  PacketBuffer Buffer(16, 16, 90.0f, PacketBuffer::DefaultStreams(16, 16), false, 1);
+  REQUIRE(Buffer.StartWriting(ObjectToColor(), ObjectColors));
+
+  // The only slot is still written, so the next packet waits until the buffer is released
+  bool Started = true;
+  TestHarness::CompleteWithin(10, "StartWriting after Release", [&]
+  {
+    std::thread Writer([&] {Started = Buffer.StartWriting(ObjectToColor(), ObjectColors); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    Buffer.Release();
+    Writer.join();
+  });
+  CHECK(!Started);
+}
+
+TEST_CASE(ReleaseUnblocksReading)
+{
+  PacketBuffer Buffer(16, 16, 90.0f, PacketBuffer::DefaultStreams(16, 16), false, 2);
+  bool Read = true;
+  TestHarness::CompleteWithin(10, "StartReading after Release", [&]
+  {
+    std::thread Reader([&] {Read = Buffer.StartReading(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    Buffer.Release();
+    Reader.join();
+  });
+  CHECK(!Read);
+}
+
+TEST_CASE(ReleaseUnblocksWritingOnLeasedSlot)
+{
+  PacketBuffer Buffer(16, 16, 90.0f, PacketBuffer::DefaultStreams(16, 16), false, 1);
+  REQUIRE(Buffer.StartWriting(ObjectToColor(), ObjectColors));
+  Buffer.DoneWriting(Buffer.GetWriteSlot());
+  REQUIRE(Buffer.StartReading());
+  LeasePtr Lease = Buffer.LeaseRead();
+  Buffer.DoneReading();
+
+  // The slot stays taken by the lease, e.g. of a message that is never published
+  bool Started = true;
+  TestHarness::CompleteWithin(10, "StartWriting on a leased slot after Release", [&]
+  {
+    std::thread Writer([&] {Started = Buffer.StartWriting(ObjectToColor(), ObjectColors); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    Buffer.Release();
+    Writer.join();
+  });
+  CHECK(!Started);
+  Lease.Reset();
+}
+
+TEST_CASE(ReleaseKeepsCompletedPackets)
+{
+  PacketBuffer Buffer(16, 16, 90.0f, PacketBuffer::DefaultStreams(16, 16), false, 3);
+  for(uint32 Sequence = 0; Sequence < 2; ++Sequence)
+  {
+    REQUIRE(Buffer.StartWriting(ObjectToColor(), ObjectColors));
+    const uint32 Slot = Buffer.GetWriteSlot();
+    Buffer.GetWriteHeader(Slot)->Sequence = Sequence;
+    WritePayloads(Buffer, Slot, Sequence);
+    Buffer.DoneWriting(Slot);
+  }
+  // Started, but never completed
+  REQUIRE(Buffer.StartWriting(ObjectToColor(), ObjectColors));
+  Buffer.Release();
+
+  CHECK(!Buffer.StartWriting(ObjectToColor(), ObjectColors));
+  for(uint32 Sequence = 0; Sequence < 2; ++Sequence)
+  {
+    REQUIRE(Buffer.StartReading());
+    CHECK(CheckPacket(Buffer, Buffer.Read, Sequence));
+    Buffer.DoneReading();
+  }
+  TestHarness::CompleteWithin(10, "StartReading of an incomplete packet after Release", [&]
+  {
+    CHECK(!Buffer.StartReading());
+  });
+}
+
+TEST_CASE(ShutdownWithPacketsInFlight)
+{
+  // Like EndPlay: the buffer is released while the game thread, the workers and the reader are all busy. Every
+  // thread has to leave its loop, whatever it waits for.
+  PacketBuffer Buffer(64, 48, 90.0f, PacketBuffer::DefaultStreams(64, 48), false, 3);
+  TestHarness::CompleteWithin(20, "shutdown with packets in flight", [&]
+  {
+    std::mutex Lock;
+    std::condition_variable CVJobs;
+    std::deque<uint32> Jobs;
+    bool Running = true;
+    std::atomic<uint32> Read(0);
+
+    std::vector<std::thread> Workers;
+    for(uint32 Worker = 0; Worker < 3; ++Worker)
+    {
+      Workers.emplace_back([&]
+      {
+        while(true)
+        {
+          uint32 Slot;
+          {
+            std::unique_lock<std::mutex> WaitLock(Lock);
+            CVJobs.wait(WaitLock, [&] {return !Jobs.empty() || !Running; });
+            if(Jobs.empty())
+            {
+              return;
+            }
+            Slot = Jobs.front();
+            Jobs.pop_front();
+          }
+          WritePayloads(Buffer, Slot, Buffer.GetWriteHeader(Slot)->Sequence);
+          Buffer.DoneWriting(Slot);
+        }
+      });
+    }
+    std::thread Reader([&]
+    {
+      std::deque<LeasePtr> Leases;
+      while(Buffer.StartReading())
+      {
+        // Some leases are never released before the shutdown
+        if(Leases.size() < 2)
+        {
+          Leases.push_back(Buffer.LeaseRead());
+        }
+        Buffer.DoneReading();
+        ++Read;
+      }
+    });
+    std::thread Writer([&]
+    {
+      for(uint32 Sequence = 0; Buffer.StartWriting(ObjectToColor(), ObjectColors); ++Sequence)
+      {
+        const uint32 Slot = Buffer.GetWriteSlot();
+        Buffer.GetWriteHeader(Slot)->Sequence = Sequence;
+        std::lock_guard<std::mutex> Guard(Lock);
+        Jobs.push_back(Slot);
+        CVJobs.notify_one();
+      }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    Buffer.Release();
+    Writer.join();
+    Reader.join();
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Running = false;
+    }
+    CVJobs.notify_all();
+    for(std::thread &Worker : Workers)
+    {
+      Worker.join();
+    }
+    CHECK(Read > 0);
+  });
+}
+
+TEST_CASE(ReconfigurationKeepsPacketsIntact)
+{
+  // The component drains the pipeline and waits for the publisher before it replaces the buffer, only the lease of
+  // the packet read last may still be held, e.g. by a paused camera republishing it
+  std::unique_ptr<PacketBuffer> Old(new PacketBuffer(64, 48, 90.0f, PacketBuffer::DefaultStreams(64, 48), false, 2));
+  PipelineResult Result;
+  TestHarness::CompleteWithin(60, "pipeline before reconfiguration", [&]
+  {
+    Result = RunPipeline(*Old, {3, 500, 0, 2, 0});
+  });
+  CHECK(Result.Errors == 0);
+
+  Old->RestartReading();
+  LeasePtr Lease = Old->LeaseRead();
+  const uint8 *Leased = Old->Read;
+  Old->DoneReading();
+  REQUIRE(CheckPacket(*Old, Leased, 499));
+
+  // Another resolution with the GPU formats, auxiliary streams, lidar ranges and more slots
+  std::vector<PacketBuffer::StreamDescriptor> Streams = PacketBuffer::GPUStreams(160, 120, 1.0f);
+  const std::vector<PacketBuffer::StreamDescriptor> Auxiliary = PacketBuffer::AuxiliaryStreams(160, 120, true, true);
+  Streams.insert(Streams.end(), Auxiliary.begin(), Auxiliary.end());
+  Streams.push_back({PacketFormat::StreamRanges, PacketFormat::EncodingF32, 1024, 16, 0, 0, 0, 1.0f});
+  PacketBuffer New(160, 120, 90.0f, Streams, false, 3);
+
+  uint32 End = New.SizeHeader;
+  for(const PacketBuffer::StreamDescriptor &Stream : New.Streams)
+  {
+    CHECK(Stream.Offset % PacketFormat::PayloadAlignment == 0);
+    CHECK(Stream.Offset >= End);
+    CHECK(Stream.Size == Stream.Stride * Stream.Height);
+    End = Stream.Offset + Stream.Size;
+  }
+  CHECK(New.OffsetMap >= End);
+  for(uint32 Slot = 0; Slot < New.GetSlotCount(); ++Slot)
+  {
+    const PacketBuffer::PacketHeader *Header = New.GetWriteHeader(Slot);
+    CHECK(Header->Width == 160 && Header->Height == 120 && Header->StreamCount == Streams.size());
+  }
+
+  TestHarness::CompleteWithin(60, "pipeline after reconfiguration", [&]
+  {
+    Result = RunPipeline(New, {4, 500, 500, 3, 5});
+  });
+  CHECK(Result.Read == 500);
+  CHECK(Result.Errors == 0);
+
+  // Nothing written to the new buffer touched the packet leased from the old one
+  CHECK(CheckPacket(*Old, Leased, 499));
+  Lease.Reset();
+  Old.reset();
+}
+
+TEST_CASE(Throughput)
+{
+  PacketBuffer Buffer(640, 480, 90.0f, PacketBuffer::DefaultStreams(640, 480), false, 3);
+  PipelineResult Result;
+  TestHarness::CompleteWithin(120, "Throughput", [&]
+  {
+    Result = RunPipeline(Buffer, {2, 300, 0, 2, 0});
+  });
+  CHECK(Result.Errors == 0);
+  const double FramesPerSecond = Result.Read / Result.Seconds;
+  printf("VGA packets written, read and verified: %.1f frames/s\n", FramesPerSecond);
+#ifndef VISION_TESTS_SANITIZED
+  CHECK(FramesPerSecond >= MinimumFramesPerSecond);
+#endif
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
@@ -0,0 +1,349 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "PacketBuffer.h"
+#include "PublishQueue.h"
+#include "TestHarness.h"
+
+/**
+ * Benchmark of publishing the messages of several cameras one by one from the game thread against batching them in
+ * the PublishQueue, with a local stand-in for rosbridge receiving them over TCP. Every frame of a camera publishes
+ * its color and depth image, two transforms and the camera info, like UVisionComponent. The images are filled with
+ * a value per camera and frame, which the stand-in checks, so a payload that changed before it was sent is found.
+ */
+namespace
+{
+  const uint32 Width = 640, Height = 480;
+
+  // Stand-in for the image messages, the payload is referenced like the data of sensor_msgs/Image
+  class ImageMessage : public FROSBaseMsg
+  {
+  public:
+    const uint8 *Data;
+    uint32 Size;
+    uint8 Value;
+
+    ImageMessage(const uint8 *Data, const uint32 Size, const uint8 Value) : Data(Data), Size(Size), Value(Value)
+    {
+    }
+
+    void Serialize(std::vector<uint8> &Out) const override
+    {
+      Out.push_back(1);
+      Out.push_back(Value);
+      Out.insert(Out.end(), Data, Data + Size);
+    }
+  };
+
+  // Stand-in for the small messages, e.g. transforms and camera infos
+  class SmallMessage : public FROSBaseMsg
+  {
+  public:
+    uint32 Size;
+
+    SmallMessage(const uint32 Size) : Size(Size)
+    {
+    }
+
+    void Serialize(std::vector<uint8> &Out) const override
+    {
+      Out.push_back(0);
+      Out.resize(Out.size() + Size, 0);
+    }
+  };
+
+  // Receives the frames of UTopic on a loopback socket, counts them and checks the image payloads
+  class RosbridgeStandIn
+  {
+  private:
+    int Listener, Connection, Client;
+    std::thread ThreadReceive;
+    std::mutex Lock;
+    std::condition_variable CVReceived;
+    uint64 Messages, Bytes;
+    uint32 Errors;
+
+    bool ReceiveAll(uint8 *Data, const size_t Size)
+    {
+      for(size_t Received = 0; Received < Size;)
+      {
+        const ssize_t Result = recv(Connection, Data + Received, Size - Received, 0);
+        if(Result <= 0)
+        {
+          return false;
+        }
+        Received += Result;
+      }
+      return true;
+    }
+
+    void Receive()
+    {
+      std::vector<uint8> Frame;
+      uint32 Size;
+      while(ReceiveAll(reinterpret_cast<uint8 *>(&Size), sizeof(Size)))
+      {
+        Frame.resize(Size);
+        if(!ReceiveAll(Frame.data(), Size))
+        {
+          break;
+        }
+        // Topic name, message type and for images the value of every byte of the payload
+        const size_t Name = strlen(reinterpret_cast<const char *>(Frame.data())) + 1;
+        bool Valid = Name + 1 <= Size;
+        if(Valid && Frame[Name] == 1)
+        {
+          const uint8 Value = Frame[Name + 1];
+          uint8 Difference = 0;
+          for(size_t i = Name + 2; i < Size; ++i)
+          {
+            Difference |= Frame[i] ^ Value;
+          }
+          Valid = Difference == 0;
+        }
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        ++Messages;
+        Bytes += Size + sizeof(Size);
+        Errors += Valid ? 0 : 1;
+        CVReceived.notify_all();
+      }
+    }
+
+  public:
+    std::mutex SocketLock;
+
+    RosbridgeStandIn() : Listener(-1), Connection(-1), Client(-1), Messages(0), Bytes(0), Errors(0)
+    {
+      sockaddr_in Address = {};
+      Address.sin_family = AF_INET;
+      Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t Length = sizeof(Address);
+      Listener = socket(AF_INET, SOCK_STREAM, 0);
+      check(bind(Listener, reinterpret_cast<sockaddr *>(&Address), sizeof(Address)) == 0);
+      check(listen(Listener, 1) == 0);
+      check(getsockname(Listener, reinterpret_cast<sockaddr *>(&Address), &Length) == 0);
+
+      Client = socket(AF_INET, SOCK_STREAM, 0);
+      const int NoDelay = 1;
+      setsockopt(Client, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+      check(connect(Client, reinterpret_cast<sockaddr *>(&Address), sizeof(Address)) == 0);
+      Connection = accept(Listener, nullptr, nullptr);
+      check(Connection >= 0);
+      ThreadReceive = std::thread(&RosbridgeStandIn::Receive, this);
+    }
+
+    ~RosbridgeStandIn()
+    {
+      shutdown(Client, SHUT_RDWR);
+      ThreadReceive.join();
+      close(Client);
+      close(Connection);
+      close(Listener);
+    }
+
+    int GetClientSocket() const
+    {
+      return Client;
+    }
+
+    // Waits until the given number of messages was received in total, returns the number of invalid ones
+    uint32 WaitReceived(const uint64 Count)
+    {
+      std::unique_lock<std::mutex> WaitLock(Lock);
+      CVReceived.wait(WaitLock, [&] {return Messages >= Count; });
+      return Errors;
+    }
+
+    uint64 GetBytes()
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      return Bytes;
+    }
+  };
+
+  // The topics and packets of a camera
+  struct Camera
+  {
+    UTopic Color, Depth, TF, CameraInfo;
+    PacketBuffer Buffer;
+    // Converted depth of the unbatched path, like the depth buffer of the component
+    AlignedBytes DepthOutput;
+
+    Camera(RosbridgeStandIn &Bridge, const uint32 Index, const uint32 SlotCount) :
+      Color(Bridge.GetClientSocket(), Bridge.SocketLock, FString::Printf("/camera%u/image_color", Index)),
+      Depth(Bridge.GetClientSocket(), Bridge.SocketLock, FString::Printf("/camera%u/image_depth", Index)),
+      TF(Bridge.GetClientSocket(), Bridge.SocketLock, "/tf"),
+      CameraInfo(Bridge.GetClientSocket(), Bridge.SocketLock, FString::Printf("/camera%u/camera_info", Index)),
+      Buffer(Width, Height, 90.0f, PacketBuffer::DefaultStreams(Width, Height), false, SlotCount)
+    {
+    }
+  };
+
+  struct PublishResult
+  {
+    double GameThreadSeconds;
+    double TotalSeconds;
+    uint64 Bytes;
+    uint32 Errors;
+  };
+
+  // Captures and publishes the frames of all cameras, with the queue or without it
+  PublishResult RunPublish(const bool Batched, const uint32 CameraCount, const uint32 Frames)
+  {
+    RosbridgeStandIn Bridge;
+    TSharedPtr<PublishQueue, ESPMode::ThreadSafe> Queue;
+    if(Batched)
+    {
+      Queue = PublishQueue::GetShared();
+    }
+    std::vector<std::unique_ptr<Camera>> Cameras;
+    for(uint32 Index = 0; Index < CameraCount; ++Index)
+    {
+      // Batched messages lease the slot of their packet, like in UVisionComponent::Configure
+      Cameras.emplace_back(new Camera(Bridge, Index, Batched ? 2 : 1));
+    }
+    const TMap<FString, uint32> ObjectToColor;
+    const TArray<FColor> ObjectColors;
+
+    double GameThreadSeconds = 0;
+    const auto Start = std::chrono::steady_clock::now();
+    for(uint32 Frame = 0; Frame < Frames; ++Frame)
+    {
+      const auto StartFrame = std::chrono::steady_clock::now();
+      for(uint32 Index = 0; Index < CameraCount; ++Index)
+      {
+        Camera &Cam = *Cameras[Index];
+        PacketBuffer &Buffer = Cam.Buffer;
+        const uint8 Value = (uint8)(Frame * 7 + Index * 13);
+
+        // The capture written by the processing threads
+        Buffer.StartWriting(ObjectToColor, ObjectColors);
+        const uint32 Slot = Buffer.GetWriteSlot();
+        memset(Buffer.GetWriteStream(Slot, 0), Value, Buffer.Streams[0].Size);
+        memset(Buffer.GetWriteStream(Slot, 1), Value + 1, Buffer.Streams[1].Size);
+        Buffer.DoneWriting(Slot);
+
+        // Publishing it like PublishPacket, the color straight from the packet and the converted depth from its own
+        // buffer
+        Buffer.StartReading();
+        const uint8 *Color = Buffer.Read + Buffer.Streams[0].Offset;
+        const uint8 *Depth = Buffer.Read + Buffer.Streams[1].Offset;
+        const uint32 DepthSize = Width * Height * 2;
+        uint8 *DepthOutput;
+        if(Batched)
+        {
+          Queue->Hold(Buffer.LeaseRead());
+          DepthOutput = Queue->Allocate(DepthSize);
+        }
+        else
+        {
+          Cam.DepthOutput.resize(DepthSize);
+          DepthOutput = Cam.DepthOutput.data();
+        }
+        memcpy(DepthOutput, Depth, DepthSize);
+
+        const TSharedPtr<FROSBaseMsg> Messages[] = {
+          TSharedPtr<FROSBaseMsg>(new SmallMessage(120)),
+          TSharedPtr<FROSBaseMsg>(new SmallMessage(120)),
+          TSharedPtr<FROSBaseMsg>(new SmallMessage(350)),
+          TSharedPtr<FROSBaseMsg>(new ImageMessage(Color, Buffer.Streams[0].Size, Value)),
+          TSharedPtr<FROSBaseMsg>(new ImageMessage(DepthOutput, DepthSize, Value + 1))};
+        UTopic *Topics[] = {&Cam.TF, &Cam.TF, &Cam.CameraInfo, &Cam.Color, &Cam.Depth};
+        for(uint32 i = 0; i < 5; ++i)
+        {
+          if(Batched)
+          {
+            Queue->Add(Topics[i], Messages[i]);
+          }
+          else
+          {
+            Topics[i]->Publish(Messages[i]);
+          }
+        }
+        Buffer.DoneReading();
+      }
+      // The messages of all cameras of the tick go out together
+      if(Batched)
+      {
+        Queue->Flush();
+      }
+      GameThreadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - StartFrame).count();
+    }
+
+    if(Batched)
+    {
+      Queue->Wait();
+    }
+    const uint32 Errors = Bridge.WaitReceived((uint64)Frames * CameraCount * 5);
+    const double TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    const uint64 Bytes = Bridge.GetBytes();
+    Queue.Reset();
+    return {GameThreadSeconds, TotalSeconds, Bytes, Errors};
+  }
+}
+
+TEST_CASE(BenchmarkPerMessageAgainstBatched)
+{
+  const uint32 CameraCount = 4, Frames = 60;
+  PublishResult Results[2];
+  for(const bool Batched : {false, true})
+  {
+    PublishResult &Result = Results[Batched ? 1 : 0];
+    TestHarness::CompleteWithin(120, Batched ? "batched publish" : "per message publish", [&]
+    {
+      Result = RunPublish(Batched, CameraCount, Frames);
+    });
+    printf("%s: game thread %.3f ms per tick, %.1f ticks/s end to end, %.1f MB/s to the stand-in rosbridge\n",
+           Batched ? "batched" : "per message", Result.GameThreadSeconds * 1000.0 / Frames, Frames / Result.TotalSeconds,
+           Result.Bytes / Result.TotalSeconds / 1e6);
+    CHECK(Result.Errors == 0);
+  }
+  CHECK(Results[0].Bytes == Results[1].Bytes);
+}
+
+TEST_CASE(BatchKeepsLeasedPacketsUntilPublished)
+{
+  // The single slot is leased by the batch, so the next capture waits until the batch is published instead of
+  // overwriting the image that is still sent
+  RosbridgeStandIn Bridge;
+  TSharedPtr<PublishQueue, ESPMode::ThreadSafe> Queue = PublishQueue::GetShared();
+  Camera Cam(Bridge, 0, 1);
+  const TMap<FString, uint32> ObjectToColor;
+  const TArray<FColor> ObjectColors;
+  TestHarness::CompleteWithin(60, "publishing from a leased slot", [&]
+  {
+    for(uint32 Frame = 0; Frame < 20; ++Frame)
+    {
+      REQUIRE(Cam.Buffer.StartWriting(ObjectToColor, ObjectColors));
+      const uint32 Slot = Cam.Buffer.GetWriteSlot();
+      memset(Cam.Buffer.GetWriteStream(Slot, 0), Frame, Cam.Buffer.Streams[0].Size);
+      Cam.Buffer.DoneWriting(Slot);
+      REQUIRE(Cam.Buffer.StartReading());
+      Queue->Hold(Cam.Buffer.LeaseRead());
+      Queue->Add(&Cam.Color, TSharedPtr<FROSBaseMsg>(new ImageMessage(Cam.Buffer.Read + Cam.Buffer.Streams[0].Offset, Cam.Buffer.Streams[0].Size, Frame)));
+      Cam.Buffer.DoneReading();
+      Queue->Flush();
+    }
+    Queue->Wait();
+    CHECK(Bridge.WaitReceived(20) == 0);
+  });
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
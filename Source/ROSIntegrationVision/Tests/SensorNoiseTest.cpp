@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "ConversionKernels.h"
+#include "SensorNoise.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the depth noise on images with pixels beyond the range of the depth target, e.g. the sky, which the half
+ * float target of the CPU path saturates to +Inf. They have to stay a missing return (+Inf, REP 117) and must not
+ * turn into invalid measurements (NaN) with the noise, the quantization or the edge dropout.
+ */
+namespace
+{
+  const uint32 Width = 64, Height = 48;
+
+  SensorNoise::Settings DepthSettings(const float EdgeDropout)
+  {
+    SensorNoise::Settings Settings = {};
+    Settings.Seed = 7;
+    Settings.DepthNoise = 0.01f;
+    Settings.DepthQuantization = 0.001f;
+    Settings.DepthEdgeThreshold = 0.5f;
+    Settings.DepthEdgeDropout = EdgeDropout;
+    return Settings;
+  }
+
+  PacketFormat::StreamDescriptor DepthStream(const uint32 Encoding)
+  {
+    PacketFormat::StreamDescriptor Stream = {};
+    Stream.Type = PacketFormat::StreamDepth;
+    Stream.Encoding = Encoding;
+    Stream.Width = Width;
+    Stream.Height = Height;
+    Stream.Stride = Width * PacketFormat::BytesPerPixel(Encoding);
+    Stream.Scale = 0.01f;
+    return Stream;
+  }
+
+  // The upper half is the sky, the lower half a floor at 2 to 5 meters, in centimeters
+  std::vector<float> CreateDepth()
+  {
+    std::vector<float> Depth(Width * Height);
+    for(uint32 Y = 0; Y < Height; ++Y)
+    {
+      for(uint32 X = 0; X < Width; ++X)
+      {
+        Depth[Y * Width + X] = Y < Height / 2 ? std::numeric_limits<float>::infinity() : 200.0f + (Y - Height / 2) * 12.5f;
+      }
+    }
+    return Depth;
+  }
+
+  std::vector<float> ApplyNoise(const std::vector<float> &Depth, const uint32 Encoding, const float EdgeDropout)
+  {
+    const PacketFormat::StreamDescriptor Stream = DepthStream(Encoding);
+    std::vector<uint8> Data(Stream.Stride * Height);
+    if(Encoding == PacketFormat::EncodingF16)
+    {
+      ConversionKernels::FloatToHalf(Depth.data(), reinterpret_cast<uint16 *>(Data.data()), Width * Height);
+    }
+    else
+    {
+      memcpy(Data.data(), Depth.data(), Data.size());
+    }
+
+    SensorNoise Noise(DepthSettings(EdgeDropout));
+    Noise.Apply(Stream, Data.data(), 1);
+
+    std::vector<float> Out(Width * Height);
+    if(Encoding == PacketFormat::EncodingF16)
+    {
+      ConversionKernels::HalfToFloat(reinterpret_cast<const uint16 *>(Data.data()), Out.data(), Width * Height, 1.0f);
+    }
+    else
+    {
+      memcpy(Out.data(), Data.data(), Data.size());
+    }
+    return Out;
+  }
+}
+
+TEST_CASE(DepthBeyondRangeStaysMissing)
+{
+  ConversionKernels::Select();
+  const std::vector<float> Depth = CreateDepth();
+  for(const uint32 Encoding : {(uint32)PacketFormat::EncodingF16, (uint32)PacketFormat::EncodingF32})
+  {
+    const std::vector<float> Out = ApplyNoise(Depth, Encoding, 0.0f);
+    uint32 Changed = 0;
+    for(uint32 i = 0; i < Width * Height; ++i)
+    {
+      if(std::isinf(Depth[i]))
+      {
+        CHECK(std::isinf(Out[i]) && Out[i] > 0);
+      }
+      else
+      {
+        // The sum of four uniform numbers stays within 3.5 standard deviations, plus the quantization step
+        const float Meters = Depth[i] / 100.0f;
+        CHECK(std::isfinite(Out[i]) && std::abs(Out[i] - Depth[i]) <= (3.5f * 0.01f * Meters * Meters + 0.001f) * 100.0f * 1.01f);
+        Changed += Out[i] != Depth[i];
+      }
+    }
+    CHECK(Changed > Width * Height / 4);
+  }
+}
+
+TEST_CASE(EdgeDropoutKeepsMissingDepth)
+{
+  // Every pixel next to the sky is an edge and dropped, the sky itself is no measurement that could be dropped
+  const std::vector<float> Depth = CreateDepth();
+  const std::vector<float> Out = ApplyNoise(Depth, PacketFormat::EncodingF16, 1.0f);
+  for(uint32 X = 0; X < Width; ++X)
+  {
+    CHECK(std::isinf(Out[(Height / 2 - 1) * Width + X]));
+    CHECK(std::isnan(Out[Height / 2 * Width + X]));
+    CHECK(std::isfinite(Out[(Height / 2 + 2) * Width + X]));
+  }
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
@@ -0,0 +1,15 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Stand-in for the task graph of the engine, the iterations run one after another on the calling thread
+template<typename Function>
+void ParallelFor(const int32 Num, Function Body)
+{
+  for(int32 Index = 0; Index < Num; ++Index)
+  {
+    Body(Index);
+  }
+}
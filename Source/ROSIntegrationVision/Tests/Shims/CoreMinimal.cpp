@@ -0,0 +1,5 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CoreMinimal.h"
+
+std::atomic<uint32> ShimLog::Warnings(0);
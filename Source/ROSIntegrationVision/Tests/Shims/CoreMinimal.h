@@ -0,0 +1,505 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal stand-in for the parts of the Unreal core used by the engine independent classes of the plugin, e.g.
+ * PacketBuffer, ConversionKernels and PublishQueue, so that they can be built and tested without the engine.
+ * Only what these classes use is provided, with the same semantics as in the engine where it matters, e.g. FFloat16
+ * rounding and FMath::Clamp with NaN.
+ */
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef int64_t int64;
+typedef uintptr_t UPTRINT;
+typedef char TCHAR;
+
+#define PLATFORM_WINDOWS 0
+#define PLATFORM_LINUX 1
+#define ROSINTEGRATIONVISION_API
+#define PI 3.14159265358979323846f
+#define MAX_int32 ((int32)0x7fffffff)
+#define MAX_uint32 ((uint32)0xffffffff)
+
+#define TEXT(x) x
+#define TCHAR_TO_ANSI(x) (x)
+#define TCHAR_TO_UTF8(x) (x)
+
+#define check(x) do { if(!(x)) { fprintf(stderr, "check failed: %s\n", #x); abort(); } } while(0)
+#define checkf(x, ...) check(x)
+
+// Warnings and errors are printed and counted, so that tests can check that invalid settings are reported
+namespace ShimLog
+{
+  extern std::atomic<uint32> Warnings;
+
+  inline void Log(const char *Verbosity, const char *Format, ...)
+  {
+    const bool Warning = strcmp(Verbosity, "Warning") == 0 || strcmp(Verbosity, "Error") == 0;
+    if(Warning)
+    {
+      ++Warnings;
+    }
+    if(Warning || strcmp(Verbosity, "Display") == 0)
+    {
+      va_list Arguments;
+      va_start(Arguments, Format);
+      fprintf(stderr, "%s: ", Verbosity);
+      vfprintf(stderr, Format, Arguments);
+      fprintf(stderr, "\n");
+      va_end(Arguments);
+    }
+  }
+}
+
+#define UE_LOG(Category, Verbosity, Format, ...) ShimLog::Log(#Verbosity, Format, ##__VA_ARGS__)
+
+class FString
+{
+private:
+  std::string Data;
+
+public:
+  FString()
+  {
+  }
+
+  FString(const char *String) : Data(String)
+  {
+  }
+
+  FString(const std::string &String) : Data(String)
+  {
+  }
+
+  const char *operator*() const
+  {
+    return Data.c_str();
+  }
+
+  int32 Len() const
+  {
+    return (int32)Data.size();
+  }
+
+  bool IsEmpty() const
+  {
+    return Data.empty();
+  }
+
+  bool operator==(const FString &Other) const
+  {
+    return Data == Other.Data;
+  }
+
+  static FString Printf(const char *Format, ...)
+  {
+    char Buffer[1024];
+    va_list Arguments;
+    va_start(Arguments, Format);
+    vsnprintf(Buffer, sizeof(Buffer), Format, Arguments);
+    va_end(Arguments);
+    return FString(Buffer);
+  }
+};
+
+template<typename T>
+class TArray
+{
+private:
+  std::vector<T> Data;
+
+public:
+  TArray()
+  {
+  }
+
+  TArray(std::initializer_list<T> Values) : Data(Values)
+  {
+  }
+
+  T *GetData()
+  {
+    return Data.data();
+  }
+
+  const T *GetData() const
+  {
+    return Data.data();
+  }
+
+  int32 Num() const
+  {
+    return (int32)Data.size();
+  }
+
+  T &operator[](const int32 Index)
+  {
+    return Data[Index];
+  }
+
+  const T &operator[](const int32 Index) const
+  {
+    return Data[Index];
+  }
+
+  int32 Add(const T &Value)
+  {
+    Data.push_back(Value);
+    return (int32)Data.size() - 1;
+  }
+
+  void AddUninitialized(const int32 Count)
+  {
+    Data.resize(Data.size() + Count);
+  }
+
+  void SetNumUninitialized(const int32 Count)
+  {
+    Data.resize(Count);
+  }
+
+  void Empty()
+  {
+    Data.clear();
+  }
+
+  void Reset()
+  {
+    Data.clear();
+  }
+
+  typename std::vector<T>::iterator begin()
+  {
+    return Data.begin();
+  }
+
+  typename std::vector<T>::iterator end()
+  {
+    return Data.end();
+  }
+
+  typename std::vector<T>::const_iterator begin() const
+  {
+    return Data.begin();
+  }
+
+  typename std::vector<T>::const_iterator end() const
+  {
+    return Data.end();
+  }
+};
+
+// Iterates its pairs in insertion order like TMap without removals
+template<typename KeyType, typename ValueType>
+class TMap
+{
+public:
+  struct ElementType
+  {
+    KeyType Key;
+    ValueType Value;
+  };
+
+private:
+  std::vector<ElementType> Pairs;
+
+public:
+  ValueType &Add(const KeyType &Key, const ValueType &Value)
+  {
+    ValueType *Existing = Find(Key);
+    if(Existing)
+    {
+      *Existing = Value;
+      return *Existing;
+    }
+    Pairs.push_back({Key, Value});
+    return Pairs.back().Value;
+  }
+
+  ValueType *Find(const KeyType &Key)
+  {
+    for(ElementType &Pair : Pairs)
+    {
+      if(Pair.Key == Key)
+      {
+        return &Pair.Value;
+      }
+    }
+    return nullptr;
+  }
+
+  int32 Num() const
+  {
+    return (int32)Pairs.size();
+  }
+
+  void Empty()
+  {
+    Pairs.clear();
+  }
+
+  typename std::vector<ElementType>::const_iterator begin() const
+  {
+    return Pairs.begin();
+  }
+
+  typename std::vector<ElementType>::const_iterator end() const
+  {
+    return Pairs.end();
+  }
+};
+
+struct FColor
+{
+  uint8 B, G, R, A;
+
+  FColor()
+  {
+  }
+
+  FColor(const uint8 R, const uint8 G, const uint8 B, const uint8 A = 255) : B(B), G(G), R(R), A(A)
+  {
+  }
+};
+
+// IEEE half float, converted with round to nearest even like FFloat16
+struct FFloat16
+{
+  uint16 Encoded;
+
+  FFloat16()
+  {
+  }
+
+  FFloat16(const float Value)
+  {
+    *this = Value;
+  }
+
+  FFloat16 &operator=(const float Value)
+  {
+    uint32 Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    const uint32 Sign = (Bits >> 16) & 0x8000;
+    const uint32 Mantissa = Bits & 0x7FFFFF;
+    const int32 Exponent = (int32)((Bits >> 23) & 0xFF) - 127 + 15;
+    if(((Bits >> 23) & 0xFF) == 0xFF)
+    {
+      Encoded = Sign | 0x7C00 | (Mantissa ? 0x200 : 0);
+    }
+    else if(Exponent >= 31)
+    {
+      Encoded = Sign | 0x7C00;
+    }
+    else if(Exponent <= 0)
+    {
+      // Denormals, which are flushed to zero below half of the smallest one
+      const uint32 Shift = 14 - Exponent;
+      if(Shift > 24)
+      {
+        Encoded = Sign;
+      }
+      else
+      {
+        const uint32 Full = Mantissa | 0x800000;
+        uint32 Half = Full >> Shift;
+        const uint32 Rest = Full & ((1u << Shift) - 1), Middle = 1u << (Shift - 1);
+        if(Rest > Middle || (Rest == Middle && (Half & 1)))
+        {
+          ++Half;
+        }
+        Encoded = Sign | Half;
+      }
+    }
+    else
+    {
+      uint32 Half = Sign | (Exponent << 10) | (Mantissa >> 13);
+      const uint32 Rest = Mantissa & 0x1FFF;
+      if(Rest > 0x1000 || (Rest == 0x1000 && (Half & 1)))
+      {
+        ++Half;
+      }
+      Encoded = Half;
+    }
+    return *this;
+  }
+
+  operator float() const
+  {
+    const uint32 Sign = (Encoded & 0x8000) << 16, Exponent = (Encoded >> 10) & 0x1F, Mantissa = Encoded & 0x3FF;
+    if(Exponent == 0)
+    {
+      const float Value = Mantissa / 16777216.0f;
+      return Sign ? -Value : Value;
+    }
+    const uint32 Bits = Exponent == 31 ? Sign | 0x7F800000 | (Mantissa << 13) : Sign | ((Exponent - 15 + 127) << 23) | (Mantissa << 13);
+    float Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+  }
+};
+
+struct FFloat16Color
+{
+  FFloat16 R, G, B, A;
+};
+
+namespace FMath
+{
+  template<typename T>
+  T Max(const T A, const T B)
+  {
+    return A > B ? A : B;
+  }
+
+  template<typename T>
+  T Min(const T A, const T B)
+  {
+    return A < B ? A : B;
+  }
+
+  // Same order of comparisons as the engine, so NaN passes through
+  template<typename T>
+  T Clamp(const T X, const T Low, const T High)
+  {
+    return X < Low ? Low : X < High ? X : High;
+  }
+
+  template<typename T>
+  T DegreesToRadians(const T Degrees)
+  {
+    return Degrees * (T)(3.14159265358979323846 / 180.0);
+  }
+
+  inline int32 RoundToInt(const float Value)
+  {
+    return (int32)std::floor(Value + 0.5f);
+  }
+}
+
+struct FMemory
+{
+  static void *Malloc(const size_t Size, const uint32 Alignment = 16)
+  {
+    const size_t Align = FMath::Max<size_t>(Alignment, sizeof(void *));
+    return aligned_alloc(Align, (Size + Align - 1) / Align * Align);
+  }
+
+  static void Free(void *Pointer)
+  {
+    free(Pointer);
+  }
+
+  static void Memzero(void *Pointer, const size_t Size)
+  {
+    memset(Pointer, 0, Size);
+  }
+
+  static void Memcpy(void *Destination, const void *Source, const size_t Size)
+  {
+    memcpy(Destination, Source, Size);
+  }
+};
+
+struct FPlatformMemory
+{
+  static void OnOutOfMemory(const uint64 Size, const uint32 Alignment)
+  {
+    fprintf(stderr, "out of memory allocating %llu bytes\n", (unsigned long long)Size);
+    abort();
+  }
+};
+
+struct FPlatformProcess
+{
+  static void SetThreadName(const TCHAR *Name)
+  {
+  }
+};
+
+namespace ESPMode
+{
+  enum Type
+  {
+    NotThreadSafe,
+    ThreadSafe
+  };
+}
+
+// Shared pointers are always thread safe here, which is stricter than the engine for NotThreadSafe
+template<typename T, ESPMode::Type Mode = ESPMode::NotThreadSafe>
+class TSharedPtr : public std::shared_ptr<T>
+{
+public:
+  TSharedPtr(T *Pointer = nullptr) : std::shared_ptr<T>(Pointer)
+  {
+  }
+
+  TSharedPtr(const std::shared_ptr<T> &Pointer) : std::shared_ptr<T>(Pointer)
+  {
+  }
+
+  template<typename U>
+  TSharedPtr(const TSharedPtr<U, Mode> &Pointer) : std::shared_ptr<T>(Pointer)
+  {
+  }
+
+  bool IsValid() const
+  {
+    return (bool)*this;
+  }
+
+  void Reset()
+  {
+    this->reset();
+  }
+
+  T *Get() const
+  {
+    return this->get();
+  }
+};
+
+template<typename T, ESPMode::Type Mode = ESPMode::NotThreadSafe>
+class TWeakPtr : public std::weak_ptr<T>
+{
+public:
+  TWeakPtr()
+  {
+  }
+
+  TWeakPtr(const TSharedPtr<T, Mode> &Pointer) : std::weak_ptr<T>(Pointer)
+  {
+  }
+
+  TSharedPtr<T, Mode> Pin() const
+  {
+    return TSharedPtr<T, Mode>(this->lock());
+  }
+};
+
+template<typename T, typename... Args>
+TSharedPtr<T> MakeShared(Args&&... Arguments)
+{
+  return TSharedPtr<T>(std::make_shared<T>(std::forward<Args>(Arguments)...));
+}
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Stand-in for the compression of the engine without any codec. Compressing fails, so that the capture file stores
+ * its chunks uncompressed, and compressed chunks cannot be read.
+ */
+#define NAME_LZ4 "LZ4"
+
+struct FCompression
+{
+  static int32 CompressMemoryBound(const char *Format, const int32 UncompressedSize)
+  {
+    return UncompressedSize;
+  }
+
+  static bool CompressMemory(const char *Format, void *CompressedBuffer, int32 &CompressedSize, const void *UncompressedBuffer,
+                             const int32 UncompressedSize)
+  {
+    return false;
+  }
+
+  static bool UncompressMemory(const char *Format, void *UncompressedBuffer, const int32 UncompressedSize, const void *CompressedBuffer,
+                               const int32 CompressedSize)
+  {
+    return false;
+  }
+};
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "RI/Topic.h"
+
+#include <sys/socket.h>
+
+UTopic::UTopic(const int Socket, std::mutex &SocketLock, const FString &Name) :
+  Socket(Socket), SocketLock(&SocketLock), Name(Name)
+{
+}
+
+bool UTopic::Publish(TSharedPtr<FROSBaseMsg> Message)
+{
+  std::vector<uint8> Frame(sizeof(uint32) + Name.Len() + 1);
+  memcpy(&Frame[sizeof(uint32)], *Name, Name.Len() + 1);
+  Message->Serialize(Frame);
+  const uint32 Size = Frame.size() - sizeof(uint32);
+  memcpy(Frame.data(), &Size, sizeof(Size));
+
+  std::lock_guard<std::mutex> Guard(*SocketLock);
+  for(size_t Sent = 0; Sent < Frame.size();)
+  {
+    const ssize_t Result = send(Socket, Frame.data() + Sent, Frame.size() - Sent, MSG_NOSIGNAL);
+    if(Result <= 0)
+    {
+      return false;
+    }
+    Sent += Result;
+  }
+  return true;
+}
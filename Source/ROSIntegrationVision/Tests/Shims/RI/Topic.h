@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+/**
+ * Stand-in for the messages and topics of ROSIntegration. Like its rosbridge client, Publish serializes the message
+ * into a new buffer and writes it to the socket of the connection, which is shared by all topics. The frames on the
+ * socket are the size of the rest of the frame, the topic name with a trailing '\0' and the serialized message.
+ */
+class FROSBaseMsg
+{
+public:
+  virtual ~FROSBaseMsg()
+  {
+  }
+
+  // Appends the serialized message, the stand-in for the BSON conversion
+  virtual void Serialize(std::vector<uint8> &Out) const = 0;
+};
+
+class UTopic
+{
+private:
+  int Socket;
+  std::mutex *SocketLock;
+  FString Name;
+
+public:
+  // Publishes to the connected socket, the lock serializes the writes of all topics sharing it
+  UTopic(const int Socket, std::mutex &SocketLock, const FString &Name);
+
+  // Returns false if the connection failed
+  bool Publish(TSharedPtr<FROSBaseMsg> Message);
+};
@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "ConversionKernels.h"
+#include "PacketBuffer.h"
+#include "StreamConversion.h"
+#include "TestHarness.h"
+
+/**
+ * Tests of the GPU conversion against the CPU path. A scene is emulated as the float colors and depths the renderer
+ * writes, stored once like the half float render targets read back by the CPU path and once like the BGRA8 and R32F
+ * render targets of the GPU conversion, with and without a depth material. Both have to agree after converting them
+ * like for publishing, with every kernel path the CPU supports.
+ */
+namespace
+{
+  const uint32 Width = 97, Height = 31;
+
+  struct Scene
+  {
+    std::vector<float> Red, Green, Blue;
+    // Scene depth in centimeters
+    std::vector<float> Depth;
+  };
+
+  Scene CreateScene(const uint32 Seed)
+  {
+    std::mt19937 Random(Seed);
+    std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+    // From 10 cm to 600 m, below the largest half float
+    std::uniform_real_distribution<float> Exponent(1.0f, 4.77f);
+    Scene Result;
+    for(uint32 i = 0; i < Width * Height; ++i)
+    {
+      Result.Red.push_back(Unit(Random));
+      Result.Green.push_back(Unit(Random));
+      Result.Blue.push_back(Unit(Random));
+      Result.Depth.push_back(std::pow(10.0f, Exponent(Random)));
+    }
+    return Result;
+  }
+
+  // The render targets of the CPU path
+  void RenderHalf(const Scene &Input, std::vector<FFloat16Color> &Color, std::vector<FFloat16Color> &Depth)
+  {
+    Color.resize(Width * Height);
+    Depth.resize(Width * Height);
+    for(uint32 i = 0; i < Width * Height; ++i)
+    {
+      Color[i].R = Input.Red[i];
+      Color[i].G = Input.Green[i];
+      Color[i].B = Input.Blue[i];
+      Color[i].A = 1.0f;
+      Depth[i].R = Input.Depth[i];
+      Depth[i].G = 0.0f;
+      Depth[i].B = 0.0f;
+      Depth[i].A = 1.0f;
+    }
+  }
+
+  uint8 ToByte(const float Value)
+  {
+    return (uint8)FMath::Clamp(std::round(Value * 255.0f), 0.0f, 255.0f);
+  }
+
+  // The render targets of the GPU conversion written into the streams of a packet, with a depth material writing
+  // meters or the raw scene depth in centimeters
+  void RenderGPU(const Scene &Input, const PacketBuffer &Buffer, uint8 *Packet, const bool DepthMaterial)
+  {
+    const PacketBuffer::StreamDescriptor &ColorStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamColor)];
+    const PacketBuffer::StreamDescriptor &DepthStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamDepth)];
+    for(uint32 Row = 0; Row < Height; ++Row)
+    {
+      uint8 *Color = Packet + ColorStream.Offset + Row * ColorStream.Stride;
+      float *Depth = reinterpret_cast<float *>(Packet + DepthStream.Offset + Row * DepthStream.Stride);
+      for(uint32 Col = 0; Col < Width; ++Col)
+      {
+        const uint32 i = Row * Width + Col;
+        Color[Col * 4] = ToByte(Input.Blue[i]);
+        Color[Col * 4 + 1] = ToByte(Input.Green[i]);
+        Color[Col * 4 + 2] = ToByte(Input.Red[i]);
+        Color[Col * 4 + 3] = 255;
+        Depth[Col] = DepthMaterial ? Input.Depth[i] / 100.0f : Input.Depth[i];
+      }
+    }
+  }
+
+  std::vector<ConversionKernels::KernelPath> SupportedPaths()
+  {
+    std::vector<ConversionKernels::KernelPath> Paths;
+    for(int32 Path = 0; Path < ConversionKernels::PathCount; ++Path)
+    {
+      if(ConversionKernels::IsSupported((ConversionKernels::KernelPath)Path))
+      {
+        Paths.push_back((ConversionKernels::KernelPath)Path);
+      }
+    }
+    return Paths;
+  }
+}
+
+TEST_CASE(GPUStreamsScaleToMeters)
+{
+  const std::vector<PacketBuffer::StreamDescriptor> Material = PacketBuffer::GPUStreams(Width, Height, 1.0f);
+  const std::vector<PacketBuffer::StreamDescriptor> Raw = PacketBuffer::GPUStreams(Width, Height, 0.01f);
+  const std::vector<PacketBuffer::StreamDescriptor> CPU = PacketBuffer::DefaultStreams(Width, Height);
+  CHECK(Material[0].Encoding == PacketFormat::EncodingBGRA8 && Material[2].Encoding == PacketFormat::EncodingBGRA8);
+  CHECK(Material[1].Encoding == PacketFormat::EncodingF32 && Material[1].Scale == 1.0f);
+  CHECK(Raw[1].Encoding == PacketFormat::EncodingF32 && Raw[1].Scale == 0.01f);
+  CHECK(CPU[1].Encoding == PacketFormat::EncodingF16 && CPU[1].Scale == 0.01f);
+
+  // Depths exactly representable as half floats convert to the same meters from all three streams
+  PacketBuffer::StreamDescriptor HalfStream = CPU[1], MaterialStream = Material[1], RawStream = Raw[1];
+  HalfStream.Stride = Width * 2;
+  MaterialStream.Stride = RawStream.Stride = Width * 4;
+  std::vector<uint16> Halfs(Width);
+  std::vector<float> Meters(Width), Centimeters(Width), Reference(Width), Out(Width);
+  for(uint32 Col = 0; Col < Width; ++Col)
+  {
+    FFloat16 Half(10.0f + Col * 37.25f);
+    Halfs[Col] = Half.Encoded;
+    Centimeters[Col] = Half;
+  }
+  for(const ConversionKernels::KernelPath Path : SupportedPaths())
+  {
+    ConversionKernels::Select(Path);
+    ConversionKernels::HalfToFloat(Halfs.data(), Reference.data(), Width, 0.01f);
+    for(uint32 Col = 0; Col < Width; ++Col)
+    {
+      Meters[Col] = Reference[Col];
+    }
+
+    StreamConversion::DepthRowToMeters(HalfStream, reinterpret_cast<const uint8 *>(Halfs.data()), 0, Out.data());
+    CHECK(Out == Reference);
+    StreamConversion::DepthRowToMeters(MaterialStream, reinterpret_cast<const uint8 *>(Meters.data()), 0, Out.data());
+    CHECK(Out == Reference);
+    StreamConversion::DepthRowToMeters(RawStream, reinterpret_cast<const uint8 *>(Centimeters.data()), 0, Out.data());
+    for(uint32 Col = 0; Col < Width; ++Col)
+    {
+      CHECK(Out[Col] == Centimeters[Col] * 0.01f);
+      CHECK(std::abs(Out[Col] - Reference[Col]) <= 1e-6f * Reference[Col]);
+    }
+  }
+  ConversionKernels::Select();
+}
+
+TEST_CASE(GPUConversionMatchesCPUPath)
+{
+  const Scene Input = CreateScene(42);
+  std::vector<FFloat16Color> ReferenceColor, ReferenceDepth;
+  RenderHalf(Input, ReferenceColor, ReferenceDepth);
+
+  for(const bool DepthMaterial : {true, false})
+  {
+    PacketBuffer Buffer(Width, Height, 90.0f, PacketBuffer::GPUStreams(Width, Height, DepthMaterial ? 1.0f : 0.01f));
+    std::vector<uint8> Packet(Buffer.Size);
+    RenderGPU(Input, Buffer, Packet.data(), DepthMaterial);
+    const PacketBuffer::StreamDescriptor &ColorStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamColor)];
+    const PacketBuffer::StreamDescriptor &DepthStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamDepth)];
+
+    for(const ConversionKernels::KernelPath Path : SupportedPaths())
+    {
+      ConversionKernels::Select(Path);
+      const StreamConversion::Difference Result = StreamConversion::Compare(
+        ColorStream, Packet.data() + ColorStream.Offset, DepthStream, Packet.data() + DepthStream.Offset,
+        ReferenceColor.data(), ReferenceDepth.data(), 0.01f, 1, 0.001f);
+      CHECK(Result.Pixels == Width * Height);
+      CHECK(Result.ColorMismatches == 0 && Result.MaxColorError <= 1);
+      CHECK(Result.DepthMismatches == 0 && Result.MaxDepthError <= 0.001f);
+    }
+  }
+  ConversionKernels::Select();
+}
+
+TEST_CASE(CompareFindsConversionErrors)
+{
+  const Scene Input = CreateScene(7);
+  std::vector<FFloat16Color> ReferenceColor, ReferenceDepth;
+  RenderHalf(Input, ReferenceColor, ReferenceDepth);
+
+  // A raw scene depth in centimeters published as meters, e.g. a missing depth material
+  PacketBuffer Buffer(Width, Height, 90.0f, PacketBuffer::GPUStreams(Width, Height, 1.0f));
+  std::vector<uint8> Packet(Buffer.Size);
+  RenderGPU(Input, Buffer, Packet.data(), false);
+  const PacketBuffer::StreamDescriptor &ColorStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamColor)];
+  const PacketBuffer::StreamDescriptor &DepthStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamDepth)];
+  StreamConversion::Difference Result = StreamConversion::Compare(
+    ColorStream, Packet.data() + ColorStream.Offset, DepthStream, Packet.data() + DepthStream.Offset,
+    ReferenceColor.data(), ReferenceDepth.data(), 0.01f, 1, 0.001f);
+  CHECK(Result.ColorMismatches == 0);
+  CHECK(Result.DepthMismatches == Width * Height);
+
+  // Red and blue swapped, e.g. a render target in RGBA8, and invalid depth
+  for(uint32 Row = 0; Row < Height; ++Row)
+  {
+    uint8 *Color = Packet.data() + ColorStream.Offset + Row * ColorStream.Stride;
+    float *Depth = reinterpret_cast<float *>(Packet.data() + DepthStream.Offset + Row * DepthStream.Stride);
+    for(uint32 Col = 0; Col < Width; ++Col)
+    {
+      std::swap(Color[Col * 4], Color[Col * 4 + 2]);
+      Depth[Col] = std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+  Result = StreamConversion::Compare(
+    ColorStream, Packet.data() + ColorStream.Offset, DepthStream, Packet.data() + DepthStream.Offset,
+    ReferenceColor.data(), ReferenceDepth.data(), 0.01f, 1, 0.001f);
+  CHECK(Result.ColorMismatches > Width * Height / 2);
+  CHECK(Result.MaxColorError > 100);
+  CHECK(Result.DepthMismatches == Width * Height);
+  CHECK(std::isinf(Result.MaxDepthError));
+}
+
+TEST_CASE(CompareSkipsDepthBeyondHalfRange)
+{
+  // The sky is beyond the range of the half float target of the CPU path, which saturates to infinity
+  std::vector<FFloat16Color> ReferenceColor(Width * Height), ReferenceDepth(Width * Height);
+  for(uint32 i = 0; i < Width * Height; ++i)
+  {
+    ReferenceColor[i].R = ReferenceColor[i].G = ReferenceColor[i].B = ReferenceColor[i].A = 0.0f;
+    ReferenceDepth[i].R = 1e6f;
+  }
+  PacketBuffer Buffer(Width, Height, 90.0f, PacketBuffer::GPUStreams(Width, Height, 1.0f));
+  std::vector<uint8> Packet(Buffer.Size, 0);
+  const PacketBuffer::StreamDescriptor &ColorStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamColor)];
+  const PacketBuffer::StreamDescriptor &DepthStream = Buffer.Streams[Buffer.FindStream(PacketFormat::StreamDepth)];
+  for(uint32 i = 0; i < Width * Height; ++i)
+  {
+    reinterpret_cast<float *>(Packet.data() + DepthStream.Offset)[i] = 10000.0f;
+  }
+  const StreamConversion::Difference Result = StreamConversion::Compare(
+    ColorStream, Packet.data() + ColorStream.Offset, DepthStream, Packet.data() + DepthStream.Offset,
+    ReferenceColor.data(), ReferenceDepth.data(), 0.01f, 1, 0.001f);
+  CHECK(Result.ColorMismatches == 0);
+  CHECK(Result.DepthMismatches == 0);
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal test runner for the headless tests. Every test executable registers its cases with TEST_CASE and runs
+ * them with RunTests in main. A failed CHECK is reported with its location and fails the case, the process exits with
+ * 1 if any case failed, so that ctest reports it.
+ */
+namespace TestHarness
+{
+  struct Case
+  {
+    const char *Name;
+    void (*Function)();
+  };
+
+  inline std::vector<Case> &Cases()
+  {
+    static std::vector<Case> All;
+    return All;
+  }
+
+  inline int &Failures()
+  {
+    static int Count = 0;
+    return Count;
+  }
+
+  struct Registration
+  {
+    Registration(const char *Name, void (*Function)())
+    {
+      Cases().push_back({Name, Function});
+    }
+  };
+
+  inline int RunTests()
+  {
+    int Failed = 0;
+    for(const Case &Test : Cases())
+    {
+      const int Before = Failures();
+      const auto Start = std::chrono::steady_clock::now();
+      Test.Function();
+      const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+      const bool Passed = Failures() == Before;
+      printf("%s %s (%.3f s)\n", Passed ? "PASS" : "FAIL", Test.Name, Seconds);
+      Failed += Passed ? 0 : 1;
+    }
+    printf("%d of %d cases failed\n", Failed, (int)Cases().size());
+    return Failed > 0 ? 1 : 0;
+  }
+
+  // Runs the function on its own thread and ends the test run if it does not return within the timeout, so that a
+  // deadlock fails the test instead of hanging it
+  inline void CompleteWithin(const double Seconds, const char *What, const std::function<void()> &Function)
+  {
+    std::packaged_task<void()> Task(Function);
+    std::future<void> Done = Task.get_future();
+    std::thread Thread(std::move(Task));
+    if(Done.wait_for(std::chrono::duration<double>(Seconds)) != std::future_status::ready)
+    {
+      fprintf(stderr, "%s did not complete within %.1f s\n", What, Seconds);
+      fflush(stdout);
+      fflush(stderr);
+      std::_Exit(1);
+    }
+    Thread.join();
+    Done.get();
+  }
+}
+
+#define TEST_CASE(Name) \
+  static void Name(); \
+  static TestHarness::Registration Name##Registration(#Name, Name); \
+  static void Name()
+
+#define CHECK(Condition) \
+  do \
+  { \
+    if(!(Condition)) \
+    { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #Condition); \
+      ++TestHarness::Failures(); \
+    } \
+  } while(0)
+
+// Checks a condition that the rest of the case depends on and returns from the case if it fails
+#define REQUIRE(Condition) \
+  do \
+  { \
+    if(!(Condition)) \
+    { \
+      fprintf(stderr, "%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__, #Condition); \
+      ++TestHarness::Failures(); \
+      return; \
+    } \
+  } while(0)
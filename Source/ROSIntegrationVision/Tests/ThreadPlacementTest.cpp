@@ -0,0 +1,214 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "AlignedAllocator.h"
+#include "ConversionKernels.h"
+#include "TestHarness.h"
+#include "ThreadPlacement.h"
+
+/**
+ * Tests of the thread placement and a benchmark of the processing threads converting VGA color images, unpinned and
+ * pinned, with their buffers first touched by the main thread or by themselves. The difference shows on machines
+ * with several NUMA nodes, where the pinned threads touching their own buffers keep their memory traffic local.
+ */
+namespace
+{
+  bool SameCores(const TArray<int32> &A, const std::vector<int32> &B)
+  {
+    if(A.Num() != (int32)B.size())
+    {
+      return false;
+    }
+    for(int32 i = 0; i < A.Num(); ++i)
+    {
+      if(A[i] != B[i])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns the cores the calling thread may run on
+  std::vector<int32> CurrentCores()
+  {
+    const int32 CoreCount = ThreadPlacement::GetCoreCount();
+    cpu_set_t *Set = CPU_ALLOC(CoreCount);
+    const size_t SetSize = CPU_ALLOC_SIZE(CoreCount);
+    std::vector<int32> Cores;
+    if(pthread_getaffinity_np(pthread_self(), SetSize, Set) == 0)
+    {
+      for(int32 Core = 0; Core < CoreCount; ++Core)
+      {
+        if(CPU_ISSET_S(Core, SetSize, Set))
+        {
+          Cores.push_back(Core);
+        }
+      }
+    }
+    CPU_FREE(Set);
+    return Cores;
+  }
+
+  struct Placement
+  {
+    bool Pinned;
+    bool FirstTouchedByWorker;
+  };
+
+  // Returns the images converted per second by the threads, each converting its own image
+  double ConvertImages(const Placement &Setup, const uint32 Threads, const double Seconds)
+  {
+    const uint32 Pixels = 640 * 480;
+    const std::vector<int32> Allowed = CurrentCores();
+    std::vector<FFloat16Color *> Inputs(Threads, nullptr);
+    std::vector<uint8 *> Outputs(Threads, nullptr);
+
+    auto Touch = [&](const uint32 Thread)
+    {
+      Inputs[Thread] = static_cast<FFloat16Color *>(AlignedMemory::Allocate(Pixels * sizeof(FFloat16Color), false));
+      Outputs[Thread] = static_cast<uint8 *>(AlignedMemory::Allocate(Pixels * 3, false));
+      for(uint32 i = 0; i < Pixels; ++i)
+      {
+        Inputs[Thread][i].R = (i % 256) / 255.0f;
+        Inputs[Thread][i].G = ((i / 256) % 256) / 255.0f;
+        Inputs[Thread][i].B = 0.5f;
+        Inputs[Thread][i].A = 1.0f;
+      }
+      memset(Outputs[Thread], 0, Pixels * 3);
+    };
+
+    if(!Setup.FirstTouchedByWorker)
+    {
+      for(uint32 Thread = 0; Thread < Threads; ++Thread)
+      {
+        Touch(Thread);
+      }
+    }
+
+    std::atomic<bool> Running(true);
+    std::atomic<uint32> Ready(0);
+    std::atomic<uint64> Converted(0);
+    std::vector<std::thread> Workers;
+    for(uint32 Thread = 0; Thread < Threads; ++Thread)
+    {
+      Workers.emplace_back([&, Thread]
+      {
+        // Spread over the machine like cores picked per socket
+        TArray<int32> Cores;
+        if(Setup.Pinned)
+        {
+          Cores.Add(Allowed[Thread * Allowed.size() / Threads]);
+        }
+        ThreadPlacement::Apply(TEXT("VisionBenchmark"), Cores, 0);
+        if(Setup.FirstTouchedByWorker)
+        {
+          Touch(Thread);
+        }
+        ++Ready;
+        while(Ready < Threads)
+        {
+          std::this_thread::yield();
+        }
+
+        uint64 Count = 0;
+        while(Running)
+        {
+          ConversionKernels::HalfToBGR8(Inputs[Thread], Outputs[Thread], Pixels);
+          ++Count;
+        }
+        Converted += Count;
+      });
+    }
+
+    while(Ready < Threads)
+    {
+      std::this_thread::yield();
+    }
+    const auto Start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(Seconds));
+    Running = false;
+    for(std::thread &Worker : Workers)
+    {
+      Worker.join();
+    }
+    const double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    for(uint32 Thread = 0; Thread < Threads; ++Thread)
+    {
+      AlignedMemory::Free(Inputs[Thread], Pixels * sizeof(FFloat16Color));
+      AlignedMemory::Free(Outputs[Thread], Pixels * 3);
+    }
+    return Converted / Elapsed;
+  }
+}
+
+TEST_CASE(ValidCoresKeepsCoresBeyond64)
+{
+  const uint32 Before = ShimLog::Warnings;
+  const TArray<int32> Valid = ThreadPlacement::ValidCores({0, 63, 64, 100, 255, 63}, 256);
+  CHECK(SameCores(Valid, {0, 63, 64, 100, 255}));
+  CHECK(ShimLog::Warnings == Before);
+}
+
+TEST_CASE(ValidCoresWarnsAboutInvalidCores)
+{
+  const uint32 Before = ShimLog::Warnings;
+  const TArray<int32> Valid = ThreadPlacement::ValidCores({-1, 2, 128, 5}, 128);
+  CHECK(SameCores(Valid, {2, 5}));
+  CHECK(ShimLog::Warnings == Before + 2);
+}
+
+TEST_CASE(ApplyPinsToTheLastCore)
+{
+  // The highest core the process may use, beyond the first 64 on large servers
+  const int32 Last = CurrentCores().back();
+  std::vector<int32> Cores;
+  std::thread([&]
+  {
+    ThreadPlacement::Apply(TEXT("VisionTest"), {Last}, 0);
+    Cores = CurrentCores();
+  }).join();
+  CHECK(Cores == std::vector<int32>({Last}));
+}
+
+TEST_CASE(ApplyWithoutValidCoresDoesNotPin)
+{
+  const std::vector<int32> Before = CurrentCores();
+  const uint32 Warnings = ShimLog::Warnings;
+  std::vector<int32> Cores;
+  std::thread([&]
+  {
+    ThreadPlacement::Apply(TEXT("VisionTest"), {-3, ThreadPlacement::GetCoreCount()}, 0);
+    Cores = CurrentCores();
+  }).join();
+  CHECK(Cores == Before);
+  CHECK(ShimLog::Warnings > Warnings);
+}
+
+TEST_CASE(BenchmarkPlacement)
+{
+  ConversionKernels::Select();
+  // One thread per image stream, like the color, depth and object threads
+  const uint32 Threads = 3;
+  const Placement Setups[] = {{false, false}, {false, true}, {true, false}, {true, true}};
+  for(const Placement &Setup : Setups)
+  {
+    const double Rate = ConvertImages(Setup, Threads, 0.5);
+    printf("%s, buffers touched by %s: %.1f VGA images/s\n", Setup.Pinned ? "pinned" : "unpinned",
+           Setup.FirstTouchedByWorker ? "worker" : "main thread", Rate);
+    CHECK(Rate > 0);
+  }
+}
+
+int main()
+{
+  return TestHarness::RunTests();
+}